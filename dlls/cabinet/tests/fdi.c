@@ -114,6 +114,34 @@ static const struct
     { 'H','e','l','l','o',' ','W','o','r','l','d','!' }
 };
 
+/* A single LZX verbatim block decoding to "abc", a 17 byte match at distance 3
+ * and a 12 byte match at distance 1, so both matches overlap their own output. */
+static const char lzx_expected[] = "abcabcabcabcabcabcabbbbbbbbbbbbb";
+
+static const struct
+{
+    struct CFHEADER header;
+    struct CFFOLDER folder;
+    struct CFFILE file;
+    UCHAR szName[sizeof("file.dat")];
+    struct CFDATA data;
+    UCHAR ab[54];
+} lzx_cab_data =
+{
+    { {'M','S','C','F'}, 0, 0x83, 0, sizeof(struct CFHEADER) + sizeof(struct CFFOLDER), 0, 3,1, 1, 1, 0, 0x1225, 0x2013 },
+    { sizeof(struct CFHEADER) + sizeof(struct CFFOLDER) + sizeof(struct CFFILE) + sizeof("file.dat"), 1, tcompTYPE_LZX | tcompLZX_WINDOW_LO },
+    { sizeof(lzx_expected)-1, 0, 0x1234, 0x1225, 0x2013, 0xa114 },
+    { 'f','i','l','e','.','d','a','t',0 },
+    { 0, 54, sizeof(lzx_expected)-1 },
+    {
+      0x00,0x10,0x00,0x02,0x00,0x00,0x00,0x00,0x00,0x00,0x10,0x00,
+      0x0f,0x01,0x1f,0xfa,0x74,0xff,0x00,0x00,0x00,0x00,0x00,0x00,
+      0x04,0x00,0x42,0x00,0xd9,0x05,0xbe,0xcf,0x64,0xfb,0x00,0x00,
+      0x00,0x00,0x00,0x00,0x04,0x00,0x00,0x44,0x3f,0x30,0xff,0xff,
+      0xc0,0xff,0xe0,0x6f,0x00,0x00
+    }
+};
+
 #include <poppack.h>
 
 struct mem_data
@@ -122,6 +150,10 @@ struct mem_data
     LONG size, pos;
 };
 
+static const void *mem_cab;
+static LONG mem_cab_size;
+static const char *mem_expected;
+
 /* FDI callbacks */
 
 static void * CDECL fdi_alloc(ULONG cb)
@@ -751,8 +783,8 @@ static INT_PTR CDECL fdi_mem_open(char *name, int oflag, int pmode)
     data = HeapAlloc(GetProcessHeap(), 0, sizeof(*data));
     if (!data) return -1;
 
-    data->base = (const char *)&cab_data;
-    data->size = sizeof(cab_data);
+    data->base = mem_cab;
+    data->size = mem_cab_size;
     data->pos = 0;
 
     trace("mem_open(%s,%x,%x) => %p\n", name, oflag, pmode, data);
@@ -776,13 +808,13 @@ static UINT CDECL fdi_mem_read(INT_PTR hf, void *pv, UINT cb)
 
 static UINT CDECL fdi_mem_write(INT_PTR hf, void *pv, UINT cb)
 {
-    static const char expected[] = "Hello World!";
+    UINT len = strlen(mem_expected);
 
     trace("mem_write(%#Ix,%p,%u)\n", hf, pv, cb);
 
     ok(hf == 0x12345678, "expected 0x12345678, got %#Ix\n", hf);
-    ok(cb == 12, "expected 12, got %u\n", cb);
-    ok(!memcmp(pv, expected, 12), "expected %s, got %s\n", expected, (const char *)pv);
+    ok(cb == len, "expected %u, got %u\n", len, cb);
+    ok(!memcmp(pv, mem_expected, min(cb, len)), "expected %s, got %s\n", mem_expected, debugstr_an(pv, cb));
 
     return cb;
 }
@@ -840,7 +872,7 @@ static INT_PTR CDECL fdi_mem_notify(FDINOTIFICATIONTYPE fdint, FDINOTIFICATION *
     {
         trace("mem_notify: COPY_FILE %s, %ld bytes\n", info->psz1, info->cb);
 
-        ok(info->cb == 12, "expected 12, got %lu\n", info->cb);
+        ok(info->cb == strlen(mem_expected), "expected %Iu, got %lu\n", strlen(mem_expected), info->cb);
         ok(!strcmp(info->psz1, expected), "expected %s, got %s\n", expected, info->psz1);
         ok(info->iFolder == 0x1234, "expected 0x1234, got %#x\n", info->iFolder);
         return 0x12345678; /* call write() callback */
@@ -917,6 +949,10 @@ static void test_FDICopy(void)
     DeleteFileA(name);
 
     /* test extracting from a memory block */
+    mem_cab = &cab_data;
+    mem_cab_size = sizeof(cab_data);
+    mem_expected = "Hello World!";
+
     hfdi = FDICreate(fdi_alloc, fdi_free, fdi_mem_open, fdi_mem_read,
                      fdi_mem_write, fdi_mem_close, fdi_mem_seek, cpuUNKNOWN, &erf);
     ok(hfdi != NULL, "FDICreate error %d\n", erf.erfOper);
@@ -939,6 +975,20 @@ static void test_FDICopy(void)
     ok(ret, "FDICopy error %d\n", erf.erfOper);
 
     FDIDestroy(hfdi);
+
+    /* LZX matches overlapping their own output */
+    mem_cab = &lzx_cab_data;
+    mem_cab_size = sizeof(lzx_cab_data);
+    mem_expected = lzx_expected;
+
+    hfdi = FDICreate(fdi_alloc, fdi_free, fdi_mem_open, fdi_mem_read,
+                     fdi_mem_write, fdi_mem_close, fdi_mem_seek, cpuUNKNOWN, &erf);
+    ok(hfdi != NULL, "FDICreate error %d\n", erf.erfOper);
+
+    ret = FDICopy(hfdi, block, memory, 0, fdi_mem_notify, NULL, 0);
+    ok(ret, "FDICopy error %d\n", erf.erfOper);
+
+    FDIDestroy(hfdi);
 }
 
 
@@ -1624,6 +1624,326 @@ static HRESULT remap_faces_for_attrsort(struct d3dx9_mesh *This, const DWORD *in
     return D3D_OK;
 }
 
+#define VERTEX_CACHE_SIZE 32
+
+/* Scores used by the vertex cache optimizer, scaled by 1024 so that face
+ * scores can be compared exactly. The vertices of the last face all get the
+ * same score, so that the winding of the next face does not matter. */
+static const int vertex_cache_position_score[VERTEX_CACHE_SIZE] =
+{
+     768,  768,  768, 1024,  971,  920,  869,  820,  771,  723,  677,  631,  586,  543,  501,  460,
+     420,  381,  343,  307,  273,  239,  207,  177,  148,  121,   96,   73,   52,   34,   19,    7,
+};
+
+/* Vertices with few remaining faces are boosted, so that lone faces are not
+ * left behind. */
+static const int vertex_valence_score[] =
+{
+       0, 2048, 1448, 1182, 1024,  916,  836,  774,  724,  683,  648,  617,  591,  568,  547,  529,
+     512,
+};
+
+static int vertex_cache_score(int cache_position, DWORD valence)
+{
+    int score;
+
+    if (!valence)
+        return 0;
+
+    score = cache_position < 0 ? 0 : vertex_cache_position_score[cache_position];
+    if (valence >= ARRAY_SIZE(vertex_valence_score))
+        valence = ARRAY_SIZE(vertex_valence_score) - 1;
+    return score + vertex_valence_score[valence];
+}
+
+/* Re-orders faces for the post-transform vertex cache, using the linear time
+ * algorithm by Tom Forsyth. face_order receives the original index of each
+ * face in the new order. Indices that are out of range are ignored. */
+static HRESULT optimize_faces_for_vertex_cache(const DWORD *indices, DWORD num_faces,
+        DWORD num_vertices, DWORD *face_order)
+{
+    DWORD cache[VERTEX_CACHE_SIZE], new_cache[VERTEX_CACHE_SIZE + 3];
+    DWORD cache_count = 0, new_cache_count;
+    DWORD *face_start, *valence, *vertex_faces;
+    int *cache_position, *vertex_score;
+    DWORD best_face, cursor, face, i, j, k;
+    BYTE *face_emitted;
+    int best_score;
+    SIZE_T size;
+
+    if (!num_faces)
+        return D3D_OK;
+
+    size = (num_vertices + 1) * sizeof(*face_start) + num_vertices * sizeof(*valence)
+            + num_vertices * (sizeof(*cache_position) + sizeof(*vertex_score))
+            + num_faces * 3 * sizeof(*vertex_faces) + num_faces * sizeof(*face_emitted);
+    if (!(face_start = HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, size)))
+        return E_OUTOFMEMORY;
+    valence = face_start + num_vertices + 1;
+    cache_position = (int *)(valence + num_vertices);
+    vertex_score = cache_position + num_vertices;
+    vertex_faces = (DWORD *)(vertex_score + num_vertices);
+    face_emitted = (BYTE *)(vertex_faces + num_faces * 3);
+
+    /* Build the list of faces using each vertex. */
+    for (i = 0; i < num_faces * 3; i++)
+    {
+        if (indices[i] < num_vertices)
+            face_start[indices[i] + 1]++;
+    }
+    for (i = 0; i < num_vertices; i++)
+        face_start[i + 1] += face_start[i];
+    for (i = 0; i < num_faces * 3; i++)
+    {
+        DWORD vertex = indices[i];
+
+        if (vertex < num_vertices)
+            vertex_faces[face_start[vertex] + valence[vertex]++] = i / 3;
+    }
+
+    for (i = 0; i < num_vertices; i++)
+    {
+        cache_position[i] = -1;
+        vertex_score[i] = vertex_cache_score(-1, valence[i]);
+    }
+
+    /* Start with the best face, favouring the last one like native. */
+    best_face = num_faces - 1;
+    best_score = -1;
+    for (face = num_faces; face--;)
+    {
+        int score = 0;
+
+        for (k = 0; k < 3; k++)
+        {
+            if (indices[face * 3 + k] < num_vertices)
+                score += vertex_score[indices[face * 3 + k]];
+        }
+        if (score > best_score)
+        {
+            best_score = score;
+            best_face = face;
+        }
+    }
+
+    cursor = num_faces;
+    for (i = 0; i < num_faces; i++)
+    {
+        const DWORD *face_indices;
+
+        if (best_face == ~0u)
+        {
+            /* Nothing left in the cache is used again, take the next face. */
+            while (face_emitted[--cursor]);
+            best_face = cursor;
+        }
+
+        face_order[i] = best_face;
+        face_emitted[best_face] = TRUE;
+        face_indices = indices + best_face * 3;
+
+        /* Remove the face from its vertices and push them to the cache. */
+        new_cache_count = 0;
+        for (k = 0; k < 3; k++)
+        {
+            DWORD vertex = face_indices[k];
+            DWORD *faces;
+
+            if (vertex >= num_vertices)
+                continue;
+
+            faces = vertex_faces + face_start[vertex];
+            for (j = 0; j < valence[vertex]; j++)
+            {
+                if (faces[j] == best_face)
+                {
+                    faces[j] = faces[--valence[vertex]];
+                    break;
+                }
+            }
+
+            for (j = 0; j < new_cache_count; j++)
+            {
+                if (new_cache[j] == vertex)
+                    break;
+            }
+            if (j == new_cache_count)
+                new_cache[new_cache_count++] = vertex;
+        }
+        for (j = 0; j < cache_count; j++)
+        {
+            DWORD vertex = cache[j];
+
+            if (vertex != face_indices[0] && vertex != face_indices[1] && vertex != face_indices[2])
+                new_cache[new_cache_count++] = vertex;
+        }
+
+        for (j = 0; j < new_cache_count; j++)
+        {
+            DWORD vertex = new_cache[j];
+
+            cache_position[vertex] = j < VERTEX_CACHE_SIZE ? (int)j : -1;
+            vertex_score[vertex] = vertex_cache_score(cache_position[vertex], valence[vertex]);
+        }
+        cache_count = min(new_cache_count, VERTEX_CACHE_SIZE);
+        memcpy(cache, new_cache, cache_count * sizeof(*cache));
+
+        /* Only the faces using a vertex whose score changed need to be
+         * considered for the next face. */
+        best_face = ~0u;
+        best_score = -1;
+        for (j = 0; j < new_cache_count; j++)
+        {
+            DWORD vertex = new_cache[j];
+            const DWORD *faces = vertex_faces + face_start[vertex];
+
+            for (k = 0; k < valence[vertex]; k++)
+            {
+                const DWORD *candidate = indices + faces[k] * 3;
+                int score = 0, l;
+
+                for (l = 0; l < 3; l++)
+                {
+                    if (candidate[l] < num_vertices)
+                        score += vertex_score[candidate[l]];
+                }
+                if (score > best_score || (score == best_score && faces[k] > best_face))
+                {
+                    best_score = score;
+                    best_face = faces[k];
+                }
+            }
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, face_start);
+    return D3D_OK;
+}
+
+/* Orders the vertices by first use in the index buffer, so that they are
+ * fetched as sequentially as possible. vertex_remap receives the original
+ * index of each vertex, and new_index the new index of each original vertex.
+ * Unused vertices are moved to the end. Returns the number of used vertices. */
+static DWORD remap_vertices_by_first_use(const DWORD *indices, DWORD num_faces, DWORD num_vertices,
+        DWORD *new_index, DWORD *vertex_remap)
+{
+    DWORD num_used_vertices, count = 0;
+    DWORD i;
+
+    memset(new_index, 0xff, num_vertices * sizeof(*new_index));
+    for (i = 0; i < num_faces * 3; i++)
+    {
+        DWORD vertex = indices[i];
+
+        if (vertex < num_vertices && new_index[vertex] == ~0u)
+        {
+            new_index[vertex] = count;
+            vertex_remap[count++] = vertex;
+        }
+    }
+    num_used_vertices = count;
+    for (i = 0; i < num_vertices; i++)
+    {
+        if (new_index[i] == ~0u)
+        {
+            new_index[i] = count;
+            vertex_remap[count++] = i;
+        }
+    }
+
+    return num_used_vertices;
+}
+
+/* Re-orders the faces of each attribute range for the vertex cache. face_remap
+ * holds the old -> new mapping from the attribute sort and is updated in place. */
+static HRESULT remap_faces_for_vertex_cache(struct d3dx9_mesh *This, const DWORD *indices,
+        const DWORD *sorted_attrib_buffer, DWORD *face_remap)
+{
+    DWORD *sorted_faces, *range_order, *range_indices;
+    DWORD start, end, i;
+    HRESULT hr = D3D_OK;
+
+    sorted_faces = HeapAlloc(GetProcessHeap(), 0, This->numfaces * 5 * sizeof(*sorted_faces));
+    if (!sorted_faces)
+        return E_OUTOFMEMORY;
+    range_order = sorted_faces + This->numfaces;
+    range_indices = range_order + This->numfaces;
+
+    for (i = 0; i < This->numfaces; i++)
+        sorted_faces[face_remap[i]] = i;
+
+    for (start = 0; start < This->numfaces; start = end)
+    {
+        for (end = start + 1; end < This->numfaces; end++)
+        {
+            if (sorted_attrib_buffer[end] != sorted_attrib_buffer[start])
+                break;
+        }
+
+        for (i = start; i < end; i++)
+            memcpy(range_indices + (i - start) * 3, indices + sorted_faces[i] * 3, 3 * sizeof(*indices));
+        hr = optimize_faces_for_vertex_cache(range_indices, end - start, This->numvertices, range_order);
+        if (FAILED(hr))
+            break;
+        for (i = start; i < end; i++)
+            face_remap[sorted_faces[start + range_order[i - start]]] = i;
+    }
+
+    HeapFree(GetProcessHeap(), 0, sorted_faces);
+    return hr;
+}
+
+/* Creates a vertex_remap that orders the vertices by first use in the new
+ * face order. Indices are updated according to the vertex_remap. */
+static HRESULT remap_vertices_for_vertex_cache(struct d3dx9_mesh *This, DWORD *indices,
+        const DWORD *face_remap, BOOL compact, DWORD *new_num_vertices, ID3DXBuffer **vertex_remap)
+{
+    DWORD *vertex_remap_ptr, *sorted_indices, *new_index;
+    DWORD num_used_vertices;
+    HRESULT hr;
+    DWORD i;
+
+    hr = D3DXCreateBuffer(This->numvertices * sizeof(DWORD), vertex_remap);
+    if (FAILED(hr)) return hr;
+    vertex_remap_ptr = ID3DXBuffer_GetBufferPointer(*vertex_remap);
+
+    sorted_indices = HeapAlloc(GetProcessHeap(), 0,
+            (This->numfaces * 3 + This->numvertices) * sizeof(*sorted_indices));
+    if (!sorted_indices)
+    {
+        ID3DXBuffer_Release(*vertex_remap);
+        *vertex_remap = NULL;
+        return E_OUTOFMEMORY;
+    }
+    new_index = sorted_indices + This->numfaces * 3;
+
+    for (i = 0; i < This->numfaces; i++)
+        memcpy(sorted_indices + face_remap[i] * 3, indices + i * 3, 3 * sizeof(*indices));
+    num_used_vertices = remap_vertices_by_first_use(sorted_indices, This->numfaces,
+            This->numvertices, new_index, vertex_remap_ptr);
+
+    /* convert indices */
+    for (i = 0; i < This->numfaces * 3; i++)
+    {
+        if (indices[i] < This->numvertices)
+            indices[i] = new_index[indices[i]];
+    }
+
+    if (compact)
+    {
+        for (i = num_used_vertices; i < This->numvertices; i++)
+            vertex_remap_ptr[i] = -1;
+        *new_num_vertices = num_used_vertices;
+    }
+    else
+    {
+        *new_num_vertices = This->numvertices;
+    }
+
+    HeapFree(GetProcessHeap(), 0, sorted_indices);
+    return D3D_OK;
+}
+
 static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags, const DWORD *adjacency_in,
         DWORD *adjacency_out, DWORD *face_remap_out, ID3DXBuffer **vertex_remap_out)
 {
@@ -1638,6 +1958,7 @@ static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags,
     DWORD new_num_alloc_vertices = 0;
     IDirect3DVertexBuffer9 *vertex_buffer = NULL;
     DWORD *sorted_attrib_buffer = NULL;
+    BOOL vertex_cache;
     DWORD i;
 
     TRACE("iface %p, flags %#lx, adjacency_in %p, adjacency_out %p, face_remap_out %p, vertex_remap_out %p.\n",
@@ -1650,14 +1971,8 @@ static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags,
     if ((flags & (D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_STRIPREORDER)) == (D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_STRIPREORDER))
         return D3DERR_INVALIDCALL;
 
-    if (flags & (D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_STRIPREORDER))
-    {
-        if (flags & D3DXMESHOPT_VERTEXCACHE)
-            FIXME("D3DXMESHOPT_VERTEXCACHE not implemented.\n");
-        if (flags & D3DXMESHOPT_STRIPREORDER)
-            FIXME("D3DXMESHOPT_STRIPREORDER not implemented.\n");
-        return E_NOTIMPL;
-    }
+    if (flags & D3DXMESHOPT_STRIPREORDER)
+        FIXME("D3DXMESHOPT_STRIPREORDER treated as D3DXMESHOPT_VERTEXCACHE.\n");
 
     hr = iface->lpVtbl->LockIndexBuffer(iface, 0, &indices);
     if (FAILED(hr)) goto cleanup;
@@ -1672,13 +1987,10 @@ static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags,
             dword_indices[i] = *word_indices++;
     }
 
-    if ((flags & (D3DXMESHOPT_COMPACT | D3DXMESHOPT_IGNOREVERTS | D3DXMESHOPT_ATTRSORT)) == D3DXMESHOPT_COMPACT)
-    {
-        new_num_alloc_vertices = This->numvertices;
-        hr = compact_mesh(This, dword_indices, &new_num_vertices, &vertex_remap);
-        if (FAILED(hr)) goto cleanup;
-    } else if (flags & D3DXMESHOPT_ATTRSORT) {
-        if (!(flags & D3DXMESHOPT_IGNOREVERTS))
+    /* the vertex cache optimizations work on attribute ranges, so they imply D3DXMESHOPT_ATTRSORT */
+    vertex_cache = !!(flags & (D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_STRIPREORDER));
+    if (vertex_cache || (flags & D3DXMESHOPT_ATTRSORT)) {
+        if (!vertex_cache && !(flags & D3DXMESHOPT_IGNOREVERTS))
             FIXME("D3DXMESHOPT_ATTRSORT vertex reordering not implemented.\n");
 
         hr = iface->lpVtbl->LockAttributeBuffer(iface, 0, &attrib_buffer);
@@ -1686,6 +1998,24 @@ static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags,
 
         hr = remap_faces_for_attrsort(This, dword_indices, attrib_buffer, &sorted_attrib_buffer, &face_remap);
         if (FAILED(hr)) goto cleanup;
+
+        if (vertex_cache)
+        {
+            hr = remap_faces_for_vertex_cache(This, dword_indices, sorted_attrib_buffer, face_remap);
+            if (FAILED(hr)) goto cleanup;
+
+            if (!(flags & D3DXMESHOPT_IGNOREVERTS))
+            {
+                new_num_alloc_vertices = This->numvertices;
+                hr = remap_vertices_for_vertex_cache(This, dword_indices, face_remap,
+                        !!(flags & D3DXMESHOPT_COMPACT), &new_num_vertices, &vertex_remap);
+                if (FAILED(hr)) goto cleanup;
+            }
+        }
+    } else if ((flags & (D3DXMESHOPT_COMPACT | D3DXMESHOPT_IGNOREVERTS)) == D3DXMESHOPT_COMPACT) {
+        new_num_alloc_vertices = This->numvertices;
+        hr = compact_mesh(This, dword_indices, &new_num_vertices, &vertex_remap);
+        if (FAILED(hr)) goto cleanup;
     }
 
     if (vertex_remap)
@@ -1728,7 +2058,7 @@ static HRESULT WINAPI d3dx9_mesh_OptimizeInplace(ID3DXMesh *iface, DWORD flags,
             *vertex_remap_ptr++ = i;
     }
 
-    if (flags & D3DXMESHOPT_ATTRSORT)
+    if (face_remap)
     {
         D3DXATTRIBUTERANGE *attrib_table;
         DWORD attrib_table_size;
@@ -7215,15 +7545,47 @@ cleanup:
 }
 
 
+/* Returns a 32-bit copy of the indices, or the indices themselves if they
+ * already are 32-bit. */
+static DWORD *get_dword_indices(const void *indices, UINT num_faces, BOOL indices_are_32bit)
+{
+    const WORD *word_indices = indices;
+    DWORD *dword_indices;
+    UINT i;
+
+    if (indices_are_32bit)
+        return (DWORD *)indices;
+
+    if (!(dword_indices = HeapAlloc(GetProcessHeap(), 0, num_faces * 3 * sizeof(*dword_indices))))
+        return NULL;
+    for (i = 0; i < num_faces * 3; i++)
+        dword_indices[i] = word_indices[i];
+    return dword_indices;
+}
+
 /*************************************************************************
  * D3DXOptimizeVertices    (D3DX9_36.@)
+ *
+ * Re-orders the vertices by first use, so that they are fetched as
+ * sequentially as possible.
+ *
+ * PARAMS
+ *   indices           [I] Pointer to an index buffer belonging to a mesh.
+ *   num_faces         [I] Number of faces in the mesh.
+ *   num_vertices      [I] Number of vertices in the mesh.
+ *   indices_are_32bit [I] Specifies whether indices are 32- or 16-bit.
+ *   vertex_remap      [I/O] The original index of each vertex in the new order.
+ *
+ * RETURNS
+ *   Success: D3D_OK.
+ *   Failure: D3DERR_INVALIDCALL, E_OUTOFMEMORY.
  */
 HRESULT WINAPI D3DXOptimizeVertices(const void *indices, UINT num_faces,
         UINT num_vertices, BOOL indices_are_32bit, DWORD *vertex_remap)
 {
-    UINT i;
+    DWORD *dword_indices, *new_index;
 
-    FIXME("indices %p, num_faces %u, num_vertices %u, indices_are_32bit %#x, vertex_remap %p semi-stub.\n",
+    TRACE("indices %p, num_faces %u, num_vertices %u, indices_are_32bit %#x, vertex_remap %p.\n",
             indices, num_faces, num_vertices, indices_are_32bit, vertex_remap);
 
     if (!vertex_remap)
@@ -7232,11 +7594,19 @@ HRESULT WINAPI D3DXOptimizeVertices(const void *indices, UINT num_faces,
         return D3DERR_INVALIDCALL;
     }
 
-    for (i = 0; i < num_vertices; i++)
+    if (!(new_index = HeapAlloc(GetProcessHeap(), 0, num_vertices * sizeof(*new_index))))
+        return E_OUTOFMEMORY;
+    if (!(dword_indices = get_dword_indices(indices, num_faces, indices_are_32bit)))
     {
-        vertex_remap[i] = i;
+        HeapFree(GetProcessHeap(), 0, new_index);
+        return E_OUTOFMEMORY;
     }
 
+    remap_vertices_by_first_use(dword_indices, num_faces, num_vertices, new_index, vertex_remap);
+
+    if (dword_indices != indices)
+        HeapFree(GetProcessHeap(), 0, dword_indices);
+    HeapFree(GetProcessHeap(), 0, new_index);
     return D3D_OK;
 }
 
@@ -7255,54 +7625,38 @@ HRESULT WINAPI D3DXOptimizeVertices(const void *indices, UINT num_faces,
  *
  * RETURNS
  *   Success: D3D_OK.
- *   Failure: D3DERR_INVALIDCALL.
- *
- * BUGS
- *   The face re-ordering does not use the vertex cache optimally.
- *
+ *   Failure: D3DERR_INVALIDCALL, E_OUTOFMEMORY.
  */
 HRESULT WINAPI D3DXOptimizeFaces(const void *indices, UINT num_faces,
         UINT num_vertices, BOOL indices_are_32bit, DWORD *face_remap)
 {
-    UINT i;
-    UINT j = num_faces - 1;
     UINT limit_16_bit = 2 << 15; /* According to MSDN */
-    HRESULT hr = D3D_OK;
+    DWORD *dword_indices;
+    HRESULT hr;
 
-    FIXME("indices %p, num_faces %u, num_vertices %u, indices_are_32bit %#x, face_remap %p semi-stub. "
-            "Face order will not be optimal.\n",
+    TRACE("indices %p, num_faces %u, num_vertices %u, indices_are_32bit %#x, face_remap %p.\n",
             indices, num_faces, num_vertices, indices_are_32bit, face_remap);
 
     if (!indices_are_32bit && num_faces >= limit_16_bit)
     {
         WARN("Number of faces must be less than %d when using 16-bit indices.\n",
              limit_16_bit);
-        hr = D3DERR_INVALIDCALL;
-        goto error;
+        return D3DERR_INVALIDCALL;
     }
 
     if (!face_remap)
     {
         WARN("Face remap pointer is NULL.\n");
-        hr = D3DERR_INVALIDCALL;
-        goto error;
+        return D3DERR_INVALIDCALL;
     }
 
-    /* The faces are drawn in reverse order for simple meshes. This ordering
-     * is not optimal for complicated meshes, but will not break anything
-     * either. The ordering should be changed to take advantage of the vertex
-     * cache on the graphics card.
-     *
-     * TODO Re-order to take advantage of vertex cache.
-     */
-    for (i = 0; i < num_faces; i++)
-    {
-        face_remap[i] = j--;
-    }
+    if (!(dword_indices = get_dword_indices(indices, num_faces, indices_are_32bit)))
+        return E_OUTOFMEMORY;
 
-    return D3D_OK;
+    hr = optimize_faces_for_vertex_cache(dword_indices, num_faces, num_vertices, face_remap);
 
-error:
+    if (dword_indices != indices)
+        HeapFree(GetProcessHeap(), 0, dword_indices);
     return hr;
 }
 
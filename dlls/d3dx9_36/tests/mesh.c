@@ -10463,18 +10463,113 @@ cleanup:
     free_test_context(test_context);
 }
 
+#define GRID_SIZE 32
+
+/* Creates the indices of a GRID_SIZE x GRID_SIZE vertex grid, with the faces
+ * in a scrambled order. */
+static DWORD *create_scrambled_grid(UINT *num_faces, UINT *num_vertices)
+{
+    UINT count = 2 * (GRID_SIZE - 1) * (GRID_SIZE - 1);
+    DWORD *indices;
+    UINT x, y;
+
+    indices = malloc(count * 3 * sizeof(*indices));
+    for (y = 0; y < GRID_SIZE - 1; ++y)
+    {
+        for (x = 0; x < GRID_SIZE - 1; ++x)
+        {
+            DWORD v = y * GRID_SIZE + x;
+            DWORD *face = indices + ((((y * (GRID_SIZE - 1) + x) * 2) * 7919) % count) * 3;
+
+            face[0] = v;
+            face[1] = v + 1;
+            face[2] = v + GRID_SIZE;
+            face = indices + ((((y * (GRID_SIZE - 1) + x) * 2 + 1) * 7919) % count) * 3;
+            face[0] = v + 1;
+            face[1] = v + GRID_SIZE + 1;
+            face[2] = v + GRID_SIZE;
+        }
+    }
+    *num_faces = count;
+    *num_vertices = GRID_SIZE * GRID_SIZE;
+    return indices;
+}
+
+/* Returns the average number of vertex cache misses per face, with a 16 entry
+ * FIFO cache. */
+static float get_acmr(const DWORD *indices, UINT num_faces, const DWORD *face_remap)
+{
+    DWORD cache[16];
+    UINT i, j, k, next = 0, misses = 0;
+
+    memset(cache, 0xff, sizeof(cache));
+    for (i = 0; i < num_faces; ++i)
+    {
+        for (j = 0; j < 3; ++j)
+        {
+            DWORD vertex = indices[(face_remap ? face_remap[i] : i) * 3 + j];
+
+            for (k = 0; k < ARRAY_SIZE(cache); ++k)
+            {
+                if (cache[k] == vertex)
+                    break;
+            }
+            if (k == ARRAY_SIZE(cache))
+            {
+                cache[next] = vertex;
+                next = (next + 1) % ARRAY_SIZE(cache);
+                ++misses;
+            }
+        }
+    }
+    return (float)misses / num_faces;
+}
+
+static BOOL is_permutation(const DWORD *remap, UINT count)
+{
+    BOOL ret = TRUE;
+    BYTE *seen;
+    UINT i;
+
+    seen = calloc(count, sizeof(*seen));
+    for (i = 0; i < count && ret; ++i)
+    {
+        ret = remap[i] < count && !seen[remap[i]];
+        if (ret)
+            seen[remap[i]] = 1;
+    }
+    free(seen);
+    return ret;
+}
+
 static void test_optimize_vertices(void)
 {
     HRESULT hr;
     DWORD vertex_remap[3];
     const DWORD indices[] = {0, 1, 2};
+    const WORD indices16[] = {2, 0, 1};
     const UINT num_faces = 1;
     const UINT num_vertices = 3;
+    UINT grid_faces, grid_vertices;
+    DWORD *grid, *grid_remap;
 
     hr = D3DXOptimizeVertices(indices, num_faces,
                               num_vertices, FALSE,
                               vertex_remap);
     ok(hr == D3D_OK, "D3DXOptimizeVertices failed. Got %x, expected D3D_OK.\n", hr);
+    ok(is_permutation(vertex_remap, num_vertices), "Got invalid vertex remap.\n");
+
+    hr = D3DXOptimizeVertices(indices16, num_faces, num_vertices, FALSE, vertex_remap);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    ok(is_permutation(vertex_remap, num_vertices), "Got invalid vertex remap.\n");
+
+    grid = create_scrambled_grid(&grid_faces, &grid_vertices);
+    grid_remap = malloc(grid_vertices * sizeof(*grid_remap));
+    hr = D3DXOptimizeVertices(grid, grid_faces, grid_vertices, TRUE, grid_remap);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    ok(is_permutation(grid_remap, grid_vertices), "Got invalid vertex remap.\n");
+    free(grid_remap);
+    free(grid);
 
     /* vertex_remap must not be NULL */
     hr = D3DXOptimizeVertices(indices, num_faces,
@@ -10489,6 +10584,9 @@ static void test_optimize_faces(void)
     HRESULT hr;
     UINT i;
     DWORD smallest_face_remap;
+    UINT grid_faces, grid_vertices;
+    DWORD *grid, *grid_remap;
+    float acmr;
     /* mesh0
      *
      * 0--1
@@ -10621,6 +10719,19 @@ static void test_optimize_faces(void)
         free(face_remap);
     }
 
+    /* The optimized order should make good use of the vertex cache. */
+    grid = create_scrambled_grid(&grid_faces, &grid_vertices);
+    grid_remap = malloc(grid_faces * sizeof(*grid_remap));
+    hr = D3DXOptimizeFaces(grid, grid_faces, grid_vertices, TRUE, grid_remap);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    ok(is_permutation(grid_remap, grid_faces), "Got invalid face remap.\n");
+    acmr = get_acmr(grid, grid_faces, NULL);
+    ok(acmr > 2.5f, "Got unexpected ACMR %.8e for the original order.\n", acmr);
+    acmr = get_acmr(grid, grid_faces, grid_remap);
+    ok(acmr < 1.0f, "Got unexpected ACMR %.8e.\n", acmr);
+    free(grid_remap);
+    free(grid);
+
     /* face_remap must not be NULL */
     hr = D3DXOptimizeFaces(tc[0].indices, tc[0].num_faces,
                            tc[0].num_vertices, tc[0].indices_are_32bit,
@@ -10634,6 +10745,153 @@ static void test_optimize_faces(void)
     ok(hr == D3DERR_INVALIDCALL, "Got unexpected hr %#lx.\n", hr);
 }
 
+static void check_optimized_grid(ID3DXMesh *mesh, const D3DXVECTOR3 *orig_vertices, UINT num_vertices,
+        UINT num_faces, const DWORD *face_remap, ID3DXBuffer *vertex_remap)
+{
+    const DWORD *vertex_remap_ptr;
+    D3DXVECTOR3 *vertices;
+    DWORD *indices;
+    HRESULT hr;
+    float acmr;
+    UINT i;
+
+    ok(mesh->lpVtbl->GetNumVertices(mesh) == num_vertices, "Got unexpected number of vertices %lu.\n",
+            mesh->lpVtbl->GetNumVertices(mesh));
+    ok(is_permutation(face_remap, num_faces), "Got invalid face remap.\n");
+
+    hr = mesh->lpVtbl->LockIndexBuffer(mesh, D3DLOCK_READONLY, (void **)&indices);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    acmr = get_acmr(indices, num_faces, NULL);
+    ok(acmr < 1.0f, "Got unexpected ACMR %.8e.\n", acmr);
+    for (i = 0; i < num_faces * 3; ++i)
+    {
+        if (indices[i] >= num_vertices)
+            break;
+    }
+    ok(i == num_faces * 3, "Got out of range index at %u.\n", i);
+    mesh->lpVtbl->UnlockIndexBuffer(mesh);
+
+    vertex_remap_ptr = ID3DXBuffer_GetBufferPointer(vertex_remap);
+    hr = mesh->lpVtbl->LockVertexBuffer(mesh, D3DLOCK_READONLY, (void **)&vertices);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    for (i = 0; i < num_vertices; ++i)
+    {
+        if (memcmp(&vertices[i], &orig_vertices[vertex_remap_ptr[i]], sizeof(*vertices)))
+            break;
+    }
+    ok(i == num_vertices, "Got unexpected vertex %u.\n", i);
+    mesh->lpVtbl->UnlockVertexBuffer(mesh);
+}
+
+static void test_optimize_inplace(void)
+{
+    UINT grid_faces, grid_vertices, i;
+    struct test_context *test_context;
+    ID3DXBuffer *vertex_remap;
+    DWORD *grid, *face_remap, *adjacency;
+    D3DXVECTOR3 *orig_vertices;
+    ID3DXMesh *mesh;
+    float acmr;
+    void *data;
+    HRESULT hr;
+
+    if (!(test_context = new_test_context()))
+    {
+        skip("Couldn't create test context.\n");
+        return;
+    }
+
+    grid = create_scrambled_grid(&grid_faces, &grid_vertices);
+    face_remap = malloc(grid_faces * sizeof(*face_remap));
+    adjacency = malloc(grid_faces * 3 * sizeof(*adjacency));
+    /* the last vertex is not used by any face */
+    orig_vertices = malloc((grid_vertices + 1) * sizeof(*orig_vertices));
+    for (i = 0; i < grid_vertices; ++i)
+    {
+        orig_vertices[i].x = i % GRID_SIZE;
+        orig_vertices[i].y = i / GRID_SIZE;
+        orig_vertices[i].z = 0.0f;
+    }
+    orig_vertices[grid_vertices].x = -1.0f;
+    orig_vertices[grid_vertices].y = -1.0f;
+    orig_vertices[grid_vertices].z = 0.0f;
+
+    /* D3DXMESHOPT_COMPACT with D3DXMESHOPT_VERTEXCACHE reorders the faces and
+     * drops the unused vertex. */
+    hr = D3DXCreateMeshFVF(grid_faces, grid_vertices + 1, D3DXMESH_MANAGED | D3DXMESH_32BIT,
+            D3DFVF_XYZ, test_context->device, &mesh);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    mesh->lpVtbl->LockVertexBuffer(mesh, 0, &data);
+    memcpy(data, orig_vertices, (grid_vertices + 1) * sizeof(*orig_vertices));
+    mesh->lpVtbl->UnlockVertexBuffer(mesh);
+    mesh->lpVtbl->LockIndexBuffer(mesh, 0, &data);
+    memcpy(data, grid, grid_faces * 3 * sizeof(*grid));
+    mesh->lpVtbl->UnlockIndexBuffer(mesh);
+    hr = mesh->lpVtbl->GenerateAdjacency(mesh, 0.0f, adjacency);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+
+    hr = mesh->lpVtbl->OptimizeInplace(mesh, D3DXMESHOPT_COMPACT | D3DXMESHOPT_VERTEXCACHE,
+            adjacency, NULL, face_remap, &vertex_remap);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    check_optimized_grid(mesh, orig_vertices, grid_vertices, grid_faces, face_remap, vertex_remap);
+    ID3DXBuffer_Release(vertex_remap);
+    mesh->lpVtbl->Release(mesh);
+
+    /* D3DXMESHOPT_STRIPREORDER is handled the same way. */
+    hr = D3DXCreateMeshFVF(grid_faces, grid_vertices + 1, D3DXMESH_MANAGED | D3DXMESH_32BIT,
+            D3DFVF_XYZ, test_context->device, &mesh);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    mesh->lpVtbl->LockVertexBuffer(mesh, 0, &data);
+    memcpy(data, orig_vertices, (grid_vertices + 1) * sizeof(*orig_vertices));
+    mesh->lpVtbl->UnlockVertexBuffer(mesh);
+    mesh->lpVtbl->LockIndexBuffer(mesh, 0, &data);
+    memcpy(data, grid, grid_faces * 3 * sizeof(*grid));
+    mesh->lpVtbl->UnlockIndexBuffer(mesh);
+
+    hr = mesh->lpVtbl->OptimizeInplace(mesh, D3DXMESHOPT_COMPACT | D3DXMESHOPT_STRIPREORDER,
+            adjacency, NULL, face_remap, &vertex_remap);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    check_optimized_grid(mesh, orig_vertices, grid_vertices, grid_faces, face_remap, vertex_remap);
+    ID3DXBuffer_Release(vertex_remap);
+    mesh->lpVtbl->Release(mesh);
+
+    /* D3DXMESHOPT_IGNOREVERTS leaves the vertex buffer alone. */
+    hr = D3DXCreateMeshFVF(grid_faces, grid_vertices + 1, D3DXMESH_MANAGED | D3DXMESH_32BIT,
+            D3DFVF_XYZ, test_context->device, &mesh);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    mesh->lpVtbl->LockVertexBuffer(mesh, 0, &data);
+    memcpy(data, orig_vertices, (grid_vertices + 1) * sizeof(*orig_vertices));
+    mesh->lpVtbl->UnlockVertexBuffer(mesh);
+    mesh->lpVtbl->LockIndexBuffer(mesh, 0, &data);
+    memcpy(data, grid, grid_faces * 3 * sizeof(*grid));
+    mesh->lpVtbl->UnlockIndexBuffer(mesh);
+
+    hr = mesh->lpVtbl->OptimizeInplace(mesh, D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_IGNOREVERTS,
+            adjacency, NULL, face_remap, NULL);
+    ok(hr == D3D_OK, "Got unexpected hr %#lx.\n", hr);
+    ok(mesh->lpVtbl->GetNumVertices(mesh) == grid_vertices + 1, "Got unexpected number of vertices %lu.\n",
+            mesh->lpVtbl->GetNumVertices(mesh));
+    ok(is_permutation(face_remap, grid_faces), "Got invalid face remap.\n");
+    mesh->lpVtbl->LockVertexBuffer(mesh, D3DLOCK_READONLY, &data);
+    ok(!memcmp(data, orig_vertices, (grid_vertices + 1) * sizeof(*orig_vertices)), "Vertices were modified.\n");
+    mesh->lpVtbl->UnlockVertexBuffer(mesh);
+    mesh->lpVtbl->LockIndexBuffer(mesh, D3DLOCK_READONLY, &data);
+    acmr = get_acmr(data, grid_faces, NULL);
+    ok(acmr < 1.0f, "Got unexpected ACMR %.8e.\n", acmr);
+    mesh->lpVtbl->UnlockIndexBuffer(mesh);
+
+    /* The vertex cache optimizations need the adjacency. */
+    hr = mesh->lpVtbl->OptimizeInplace(mesh, D3DXMESHOPT_VERTEXCACHE, NULL, NULL, NULL, NULL);
+    ok(hr == D3DERR_INVALIDCALL, "Got unexpected hr %#lx.\n", hr);
+    mesh->lpVtbl->Release(mesh);
+
+    free(orig_vertices);
+    free(adjacency);
+    free(face_remap);
+    free(grid);
+    free_test_context(test_context);
+}
+
 static HRESULT clear_normals(ID3DXMesh *mesh)
 {
     HRESULT hr;
@@ -11574,6 +11832,7 @@ START_TEST(mesh)
     test_valid_mesh();
     test_optimize_vertices();
     test_optimize_faces();
+    test_optimize_inplace();
     test_compute_normals();
     test_D3DXFrameFind();
     test_load_skin_mesh_from_xof();
@@ -680,7 +680,7 @@ BOOL WINAPI SymSetScopeFromAddr(HANDLE hProcess, ULONG64 addr)
 
     TRACE("(%p %#I64x)\n", hProcess, addr);
 
-    if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+    if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
     pair.pcs->localscope_pc = addr;
     if ((sym = symt_find_symbol_at(pair.effective, addr)) != NULL && sym->symt.tag == SymTagFunction)
         pair.pcs->localscope_symt = &sym->symt;
@@ -723,7 +723,7 @@ BOOL WINAPI SymSetScopeFromInlineContext(HANDLE hProcess, ULONG64 addr, DWORD in
     switch (IFC_MODE(inlinectx))
     {
     case IFC_MODE_INLINE:
-        if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+        if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
         inlined = symt_find_inlined_site(pair.effective, addr, inlinectx);
         if (inlined)
         {
@@ -427,6 +427,12 @@ struct module_format
                                                const struct module_format* modfmt,
                                                const struct symt_function* func,
                                                struct location* loc);
+    /* for formats loading their information lazily: load what's needed to look up
+     * addr (or everything when addr is 0); returns FALSE if addr isn't covered
+     */
+    BOOL                        (*request_debug)(struct module_format* modfmt, DWORD64 addr);
+    /* for the same formats: tell whether information covering addr is yet to be loaded */
+    BOOL                        (*pending_debug)(struct module_format* modfmt, DWORD64 addr);
     union
     {
         struct elf_module_info*         elf_info;
@@ -703,6 +709,8 @@ extern DWORD calc_crc32(HANDLE handle) DECLSPEC_HIDDEN;
 extern BOOL         elf_read_wine_loader_dbg_info(struct process* pcs, ULONG_PTR addr) DECLSPEC_HIDDEN;
 struct elf_thunk_area;
 extern int          elf_is_in_thunk_area(ULONG_PTR addr, const struct elf_thunk_area* thunks) DECLSPEC_HIDDEN;
+extern struct elf_thunk_area*
+                    elf_copy_thunk_areas(const struct elf_thunk_area* thunks) DECLSPEC_HIDDEN;
 
 /* macho_module.c */
 extern BOOL         macho_read_wine_loader_dbg_info(struct process* pcs, ULONG_PTR addr) DECLSPEC_HIDDEN;
@@ -717,6 +725,8 @@ extern const struct loader_ops no_loader_ops DECLSPEC_HIDDEN;
 
 extern BOOL         module_init_pair(struct module_pair* pair, HANDLE hProcess,
                                      DWORD64 addr) DECLSPEC_HIDDEN;
+extern BOOL         module_init_pair_at(struct module_pair* pair, HANDLE hProcess,
+                                        DWORD64 addr) DECLSPEC_HIDDEN;
 extern struct module*
                     module_find_by_addr(const struct process* pcs, DWORD64 addr,
                                         enum module_type type) DECLSPEC_HIDDEN;
@@ -730,6 +740,9 @@ extern struct module*
                     module_is_already_loaded(const struct process* pcs,
                                              const WCHAR* imgname) DECLSPEC_HIDDEN;
 extern BOOL         module_get_debug(struct module_pair*) DECLSPEC_HIDDEN;
+extern BOOL         module_get_debug_at(struct module_pair*, DWORD64 addr) DECLSPEC_HIDDEN;
+extern BOOL         module_request_debug(struct module* module, DWORD64 addr) DECLSPEC_HIDDEN;
+extern BOOL         module_has_pending_debug(struct module* module, DWORD64 addr) DECLSPEC_HIDDEN;
 extern struct module*
                     module_new(struct process* pcs, const WCHAR* name,
                                enum module_type type, BOOL virtual,
@@ -216,6 +216,14 @@ typedef struct dwarf2_parse_context_s
     unsigned                    language;
 } dwarf2_parse_context_t;
 
+/* address range covered by a compilation unit (from its top level DIE) */
+struct dwarf2_unit_range
+{
+    struct addr_range           range;
+    DWORD64                     max_high;       /* max of range.high of this and all previous entries */
+    dwarf2_parse_context_t*     unit;
+};
+
 /* stored in the dbghelp's module internal structure for later reuse */
 struct dwarf2_module_info_s
 {
@@ -225,6 +233,15 @@ struct dwarf2_module_info_s
     dwarf2_section_t            debug_frame;
     dwarf2_section_t            eh_frame;
     unsigned char               word_size;
+    /* compilation units are only loaded when a lookup needs them,
+     * so keep what's needed to parse them around
+     */
+    BOOL                        all_loaded;
+    dwarf2_section_t            sections[section_max];
+    dwarf2_parse_module_context_t module_ctx;
+    struct elf_thunk_area*      thunks;
+    struct dwarf2_unit_range*   unit_ranges;   /* sorted on range.low */
+    unsigned                    num_unit_ranges;
 };
 
 #define loc_dwarf2_location_list        (loc_user + 0)
@@ -2988,6 +3005,125 @@ static BOOL dwarf2_parse_compilation_unit(dwarf2_parse_context_t* ctx)
     return ret;
 }
 
+static void dwarf2_add_unit_range(struct dwarf2_unit_range** ranges, unsigned* num, unsigned* alloc,
+                                  dwarf2_parse_context_t* ctx, DWORD64 low, DWORD64 high)
+{
+    struct dwarf2_unit_range* ur;
+
+    if (low >= high) return;
+    if (*num >= *alloc)
+    {
+        unsigned new_alloc = max(*alloc * 2, 16);
+        if (!(ur = realloc(*ranges, new_alloc * sizeof(**ranges)))) return;
+        *ranges = ur;
+        *alloc = new_alloc;
+    }
+    ur = &(*ranges)[(*num)++];
+    ur->range.low = low;
+    ur->range.high = high;
+    ur->unit = ctx;
+}
+
+/******************************************************************
+ *		dwarf2_index_unit
+ *
+ * Adds the address ranges covered by a compilation unit to the index.
+ * Only the top level DIE of the unit is read.
+ */
+static void dwarf2_index_unit(dwarf2_parse_context_t* ctx, struct dwarf2_unit_range** ranges,
+                              unsigned* num, unsigned* alloc)
+{
+    dwarf2_traverse_context_t   traverse = ctx->traverse_DIE;
+    dwarf2_debug_info_t         di;
+    dwarf2_abbrev_entry_attr_t* attr;
+    struct attribute            low_pc, high_pc, range;
+    ULONG_PTR                   entry_code;
+    DWORD64                     base;
+    BOOL                        has_low_pc;
+    unsigned                    i;
+
+    if (ctx->status != UNIT_NOTLOADED) return;
+    entry_code = dwarf2_leb128_as_unsigned(&traverse);
+    if (!entry_code || !(di.abbrev = dwarf2_abbrev_table_find_entry(&ctx->abbrev_table, entry_code)) ||
+        di.abbrev->tag != DW_TAG_compile_unit || !di.abbrev->num_attr)
+        return;
+    if (!(di.data = pool_alloc(&ctx->pool, di.abbrev->num_attr * sizeof(const char*)))) return;
+    for (i = 0, attr = di.abbrev->attrs; attr; i++, attr = attr->next)
+    {
+        di.data[i] = traverse.data;
+        dwarf2_swallow_attribute(&traverse, &ctx->head, attr);
+    }
+    di.symt = NULL;
+    di.parent = NULL;
+    di.unit_ctx = ctx;
+
+    if (!(has_low_pc = dwarf2_find_attribute(&di, DW_AT_low_pc, &low_pc)))
+        low_pc.u.uvalue = 0;
+    base = ctx->module_ctx->load_offset + low_pc.u.uvalue;
+
+    if (dwarf2_find_attribute(&di, DW_AT_ranges, &range))
+    {
+        const dwarf2_section_t* section = &ctx->module_ctx->sections[section_ranges];
+
+        if (range.u.uvalue >= section->size) return;
+        traverse.data = section->address + range.u.uvalue;
+        traverse.end_data = section->address + section->size;
+        while (traverse.data + 2 * ctx->head.word_size <= traverse.end_data)
+        {
+            ULONG_PTR low = dwarf2_parse_addr_head(&traverse, &ctx->head);
+            ULONG_PTR high = dwarf2_parse_addr_head(&traverse, &ctx->head);
+            if (low == 0 && high == 0) break;
+            /* base address selection entry */
+            if (low == (ctx->head.word_size == 8 ? (~(DWORD64)0u) : (DWORD64)(~0u)))
+                base = ctx->module_ctx->load_offset + high;
+            else
+                dwarf2_add_unit_range(ranges, num, alloc, ctx, base + low, base + high);
+        }
+    }
+    else if (has_low_pc && dwarf2_find_attribute(&di, DW_AT_high_pc, &high_pc))
+    {
+        /* From dwarf4 on, when FORM's class is constant, high_pc is an offset from low_pc */
+        if (ctx->head.version >= 4 && high_pc.form != DW_FORM_addr)
+            high_pc.u.uvalue += low_pc.u.uvalue;
+        dwarf2_add_unit_range(ranges, num, alloc, ctx, base, ctx->module_ctx->load_offset + high_pc.u.uvalue);
+    }
+}
+
+static int __cdecl dwarf2_unit_range_cmp(const void* p1, const void* p2)
+{
+    const struct dwarf2_unit_range* ur1 = p1;
+    const struct dwarf2_unit_range* ur2 = p2;
+
+    if (ur1->range.low < ur2->range.low) return -1;
+    return ur1->range.low > ur2->range.low;
+}
+
+/******************************************************************
+ *		dwarf2_build_unit_index
+ *
+ * Builds an index of the compilation units from the address ranges they cover,
+ * so that lookups only need to load the units they hit.
+ * Units not covering any code (or not telling which) aren't indexed.
+ */
+static void dwarf2_build_unit_index(struct dwarf2_module_info_s* info)
+{
+    struct dwarf2_unit_range* ranges = NULL;
+    unsigned i, num = 0, alloc = 0;
+    DWORD64 max_high = 0;
+
+    for (i = 0; i < info->module_ctx.unit_contexts.num_elts; ++i)
+        dwarf2_index_unit(vector_at(&info->module_ctx.unit_contexts, i), &ranges, &num, &alloc);
+    if (num) qsort(ranges, num, sizeof(*ranges), dwarf2_unit_range_cmp);
+    for (i = 0; i < num; ++i)
+    {
+        max_high = max(max_high, ranges[i].range.high);
+        ranges[i].max_high = max_high;
+    }
+    info->unit_ranges = ranges;
+    info->num_unit_ranges = num;
+    TRACE("%u ranges indexed for %u compilation units\n", num, info->module_ctx.unit_contexts.num_elts);
+}
+
 static BOOL dwarf2_lookup_loclist(const struct module_format* modfmt, const dwarf2_cuhead_t* head,
                                   const BYTE* start, ULONG_PTR ip, dwarf2_traverse_context_t* lctx)
 {
@@ -3851,7 +3987,7 @@ BOOL dwarf2_virtual_unwind(struct cpu_stack_walk *csw, ULONG_PTR ip,
     struct module_pair pair;
     struct frame_info info;
 
-    if (!module_init_pair(&pair, csw->hProcess, ip)) return FALSE;
+    if (!module_init_pair_at(&pair, csw->hProcess, ip)) return FALSE;
     if (csw->cpu != pair.effective->cpu) FIXME("mismatch in cpu\n");
     if (!dwarf2_fetch_frame_info(pair.effective, csw->cpu, ip, &info)) return FALSE;
 
@@ -4087,20 +4223,11 @@ static inline void dwarf2_fini_section(dwarf2_section_t* section)
         HeapFree(GetProcessHeap(), 0, (void*)section->address);
 }
 
-static void dwarf2_module_remove(struct process* pcs, struct module_format* modfmt)
-{
-    dwarf2_fini_section(&modfmt->u.dwarf2_info->debug_loc);
-    dwarf2_fini_section(&modfmt->u.dwarf2_info->debug_frame);
-    free(modfmt->u.dwarf2_info->cuheads);
-    HeapFree(GetProcessHeap(), 0, modfmt);
-}
-
 static BOOL dwarf2_load_CU_module(dwarf2_parse_module_context_t* module_ctx, struct module* module,
                                   dwarf2_section_t* sections, ULONG_PTR load_offset,
-                                  const struct elf_thunk_area* thunks, BOOL is_dwz)
+                                  const struct elf_thunk_area* thunks)
 {
     dwarf2_traverse_context_t   mod_ctx;
-    unsigned i;
 
     module_ctx->sections = sections;
     module_ctx->module = module;
@@ -4120,15 +4247,10 @@ static BOOL dwarf2_load_CU_module(dwarf2_parse_module_context_t* module_ctx, str
         dwarf2_parse_compilation_unit_head(unit_ctx, &mod_ctx);
     }
 
-    /* phase2: load content of all CU
-     * If this is a DWZ alternate module, don't load all debug_info at once
-     * wait for main module to ask for them (it's likely it won't need them all)
-     * Doing this can lead to a huge performance improvement.
+    /* phase2: the content of the CUs isn't loaded here, but only when a lookup
+     * needs it (or when another CU refers to it). It's likely that not all of
+     * them will be needed, and this can lead to a huge performance improvement.
      */
-    if (!is_dwz)
-        for (i = 0; i < module_ctx->unit_contexts.num_elts; ++i)
-            dwarf2_parse_compilation_unit((dwarf2_parse_context_t*)vector_at(&module_ctx->unit_contexts, i));
-
     return TRUE;
 }
 
@@ -4154,7 +4276,7 @@ static dwarf2_dwz_alternate_t* dwarf2_load_dwz(struct image_file_map* fmap, stru
     dwarf2_init_section(&dwz->sections[section_ranges], fmap_dwz, ".debug_ranges", ".zdebug_ranges", &dwz->sectmap[section_ranges]);
 
     dwz->module_ctx.dwz = NULL;
-    dwarf2_load_CU_module(&dwz->module_ctx, module, dwz->sections, 0/*FIXME*/, NULL, TRUE);
+    dwarf2_load_CU_module(&dwz->module_ctx, module, dwz->sections, 0/*FIXME*/, NULL);
     return dwz;
 }
 
@@ -4189,6 +4311,97 @@ static BOOL dwarf2_unload_CU_module(dwarf2_parse_module_context_t* module_ctx)
     return TRUE;
 }
 
+/* release what was kept for loading compilation units on demand */
+static void dwarf2_release_units(struct dwarf2_module_info_s* info)
+{
+    unsigned i;
+
+    dwarf2_unload_CU_module(&info->module_ctx);
+    for (i = 0; i < section_max; i++)
+        dwarf2_fini_section(&info->sections[i]);
+    free(info->unit_ranges);
+    free(info->thunks);
+    info->unit_ranges = NULL;
+    info->num_unit_ranges = 0;
+    info->thunks = NULL;
+    info->all_loaded = TRUE;
+}
+
+static void dwarf2_module_remove(struct process* pcs, struct module_format* modfmt)
+{
+    /* the sections are unmapped along with the image they come from */
+    if (!modfmt->u.dwarf2_info->all_loaded)
+        dwarf2_release_units(modfmt->u.dwarf2_info);
+    dwarf2_fini_section(&modfmt->u.dwarf2_info->debug_loc);
+    dwarf2_fini_section(&modfmt->u.dwarf2_info->debug_frame);
+    free(modfmt->u.dwarf2_info->cuheads);
+    HeapFree(GetProcessHeap(), 0, modfmt);
+}
+
+/******************************************************************
+ *		dwarf2_module_request_debug
+ *
+ * Loads the compilation units covering addr, or all of them when addr is 0.
+ */
+static BOOL dwarf2_module_request_debug(struct module_format* modfmt, DWORD64 addr)
+{
+    struct dwarf2_module_info_s* info = modfmt->u.dwarf2_info;
+    unsigned lo, hi, mid;
+    BOOL found = FALSE;
+
+    if (info->all_loaded) return TRUE;
+    if (!addr)
+    {
+        TRACE("Loading all compilation units for %s\n", debugstr_w(modfmt->module->modulename));
+        for (lo = 0; lo < info->module_ctx.unit_contexts.num_elts; ++lo)
+            dwarf2_parse_compilation_unit(vector_at(&info->module_ctx.unit_contexts, lo));
+        dwarf2_release_units(info);
+        return TRUE;
+    }
+    /* look for the first range starting after addr, and walk backwards */
+    for (lo = 0, hi = info->num_unit_ranges; lo < hi; )
+    {
+        mid = (lo + hi) / 2;
+        if (info->unit_ranges[mid].range.low <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0 && info->unit_ranges[lo].max_high > addr)
+    {
+        if (addr < info->unit_ranges[lo].range.high)
+        {
+            dwarf2_parse_compilation_unit(info->unit_ranges[lo].unit);
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
+/******************************************************************
+ *		dwarf2_module_pending_debug
+ *
+ * Tells whether a compilation unit covering addr hasn't been loaded yet.
+ */
+static BOOL dwarf2_module_pending_debug(struct module_format* modfmt, DWORD64 addr)
+{
+    struct dwarf2_module_info_s* info = modfmt->u.dwarf2_info;
+    unsigned lo, hi, mid;
+
+    if (info->all_loaded) return FALSE;
+    for (lo = 0, hi = info->num_unit_ranges; lo < hi; )
+    {
+        mid = (lo + hi) / 2;
+        if (info->unit_ranges[mid].range.low <= addr) lo = mid + 1;
+        else hi = mid;
+    }
+    while (lo-- > 0 && info->unit_ranges[lo].max_high > addr)
+    {
+        if (addr < info->unit_ranges[lo].range.high &&
+            info->unit_ranges[lo].unit->status == UNIT_NOTLOADED)
+            return TRUE;
+    }
+    return FALSE;
+}
+
 BOOL dwarf2_parse(struct module* module, ULONG_PTR load_offset,
                   const struct elf_thunk_area* thunks,
                   struct image_file_map* fmap)
@@ -4198,7 +4411,7 @@ BOOL dwarf2_parse(struct module* module, ULONG_PTR load_offset,
                                 debug_line_sect, debug_ranges_sect, eh_frame_sect;
     BOOL                ret = TRUE;
     struct module_format* dwarf2_modfmt;
-    dwarf2_parse_module_context_t module_ctx;
+    struct dwarf2_module_info_s* dwarf2_info;
 
     if (!dwarf2_init_section(&eh_frame,                fmap, ".eh_frame",     NULL,             &eh_frame_sect))
         /* lld produces .eh_fram to avoid generating a long name */
@@ -4238,49 +4451,60 @@ BOOL dwarf2_parse(struct module* module, ULONG_PTR load_offset,
     dwarf2_modfmt->module = module;
     dwarf2_modfmt->remove = dwarf2_module_remove;
     dwarf2_modfmt->loc_compute = dwarf2_location_compute;
-    dwarf2_modfmt->u.dwarf2_info = (struct dwarf2_module_info_s*)(dwarf2_modfmt + 1);
-    dwarf2_modfmt->u.dwarf2_info->word_size = fmap->addr_size / 8; /* set the word_size for eh_frame parsing */
+    dwarf2_modfmt->request_debug = dwarf2_module_request_debug;
+    dwarf2_modfmt->pending_debug = dwarf2_module_pending_debug;
+    dwarf2_modfmt->u.dwarf2_info = dwarf2_info = (struct dwarf2_module_info_s*)(dwarf2_modfmt + 1);
+    dwarf2_info->word_size = fmap->addr_size / 8; /* set the word_size for eh_frame parsing */
     dwarf2_modfmt->module->format_info[DFI_DWARF] = dwarf2_modfmt;
 
     /* As we'll need later some sections' content, we won't unmap these
      * sections upon existing this function
      */
-    dwarf2_init_section(&dwarf2_modfmt->u.dwarf2_info->debug_loc,   fmap, ".debug_loc",   ".zdebug_loc",   NULL);
-    dwarf2_init_section(&dwarf2_modfmt->u.dwarf2_info->debug_frame, fmap, ".debug_frame", ".zdebug_frame", NULL);
-    dwarf2_modfmt->u.dwarf2_info->eh_frame = eh_frame;
-    dwarf2_modfmt->u.dwarf2_info->cuheads = NULL;
-    dwarf2_modfmt->u.dwarf2_info->num_cuheads = 0;
-
-    module_ctx.dwz = dwarf2_load_dwz(fmap, module);
-    dwarf2_load_CU_module(&module_ctx, module, section, load_offset, thunks, FALSE);
+    dwarf2_init_section(&dwarf2_info->debug_loc,   fmap, ".debug_loc",   ".zdebug_loc",   NULL);
+    dwarf2_init_section(&dwarf2_info->debug_frame, fmap, ".debug_frame", ".zdebug_frame", NULL);
+    dwarf2_info->eh_frame = eh_frame;
+    dwarf2_info->cuheads = NULL;
+    dwarf2_info->num_cuheads = 0;
+
+    /* the CU sections are kept as well (until all CUs are loaded), as CUs are loaded on demand */
+    dwarf2_info->all_loaded = FALSE;
+    memcpy(dwarf2_info->sections, section, sizeof(section));
+    dwarf2_info->thunks = elf_copy_thunk_areas(thunks);
+    dwarf2_info->module_ctx.dwz = dwarf2_load_dwz(fmap, module);
+    dwarf2_load_CU_module(&dwarf2_info->module_ctx, module, dwarf2_info->sections, load_offset, dwarf2_info->thunks);
+    dwarf2_build_unit_index(dwarf2_info);
 
     dwarf2_modfmt->module->module.SymType = SymDia;
     /* hide dwarf versions in CVSig
      * bits 24-31 will be set according to found dwarf version
      * different CU can have different dwarf version, so use a bit per version (version 2 => b24)
      */
-    dwarf2_modfmt->module->module.CVSig = 'D' | ('W' << 8) | ('F' << 16) | ((module_ctx.cu_versions & 0xFF) << 24);
+    dwarf2_modfmt->module->module.CVSig = 'D' | ('W' << 8) | ('F' << 16) | ((dwarf2_info->module_ctx.cu_versions & 0xFF) << 24);
     /* FIXME: we could have a finer grain here */
     dwarf2_modfmt->module->module.GlobalSymbols = TRUE;
     dwarf2_modfmt->module->module.TypeInfo = TRUE;
     dwarf2_modfmt->module->module.SourceIndexed = TRUE;
     dwarf2_modfmt->module->module.Publics = TRUE;
+    /* CUs aren't loaded yet, assume they provide line numbers if there are some */
+    if (section[section_line].size)
+        dwarf2_modfmt->module->module.LineNumbers = TRUE;
 
-    dwarf2_unload_CU_module(&module_ctx);
 leave:
-
-    dwarf2_fini_section(&section[section_debug]);
-    dwarf2_fini_section(&section[section_abbrev]);
-    dwarf2_fini_section(&section[section_string]);
-    dwarf2_fini_section(&section[section_line]);
-    dwarf2_fini_section(&section[section_ranges]);
-
-    image_unmap_section(&debug_sect);
-    image_unmap_section(&debug_abbrev_sect);
-    image_unmap_section(&debug_str_sect);
-    image_unmap_section(&debug_line_sect);
-    image_unmap_section(&debug_ranges_sect);
-    if (!ret) image_unmap_section(&eh_frame_sect);
+    if (!ret)
+    {
+        dwarf2_fini_section(&section[section_debug]);
+        dwarf2_fini_section(&section[section_abbrev]);
+        dwarf2_fini_section(&section[section_string]);
+        dwarf2_fini_section(&section[section_line]);
+        dwarf2_fini_section(&section[section_ranges]);
+
+        image_unmap_section(&debug_sect);
+        image_unmap_section(&debug_abbrev_sect);
+        image_unmap_section(&debug_str_sect);
+        image_unmap_section(&debug_line_sect);
+        image_unmap_section(&debug_ranges_sect);
+        image_unmap_section(&eh_frame_sect);
+    }
 
     return ret;
 }
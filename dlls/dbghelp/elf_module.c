@@ -627,6 +627,24 @@ int elf_is_in_thunk_area(ULONG_PTR addr,
     return -1;
 }
 
+/******************************************************************
+ *		elf_copy_thunk_areas
+ *
+ * Returns a heap allocated copy (to be freed with free()) of a set
+ * of thunk areas.
+ */
+struct elf_thunk_area* elf_copy_thunk_areas(const struct elf_thunk_area* thunks)
+{
+    struct elf_thunk_area* copy;
+    unsigned i;
+
+    if (!thunks) return NULL;
+    for (i = 0; thunks[i].symname; i++) ;
+    if ((copy = malloc((i + 1) * sizeof(*thunks))))
+        memcpy(copy, thunks, (i + 1) * sizeof(*thunks));
+    return copy;
+}
+
 /******************************************************************
  *		elf_hash_symtab
  *
@@ -945,6 +963,9 @@ static int elf_new_wine_thunks(struct module* module, const struct hash_table* h
             ULONG64     ref_addr;
             struct location loc;
 
+            /* the compilation unit covering addr will describe it once it's loaded,
+             * so there's no need to parse it now nor to add a public symbol */
+            if (module_has_pending_debug(module, addr)) continue;
             symt = symt_find_nearest(module, addr);
             if (symt && !symt_get_address(&symt->symt, &ref_addr))
                 ref_addr = addr;
@@ -1255,6 +1276,8 @@ static BOOL elf_load_file_from_fmap(struct process* pcs, const WCHAR* filename,
         modfmt->module      = elf_info->module;
         modfmt->remove      = elf_module_remove;
         modfmt->loc_compute = NULL;
+        modfmt->request_debug = NULL;
+        modfmt->pending_debug = NULL;
         modfmt->u.elf_info  = elf_module_info;
 
         elf_module_info->elf_addr = load_offset;
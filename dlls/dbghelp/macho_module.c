@@ -1386,7 +1386,11 @@ static BOOL macho_load_debug_info(struct process *pcs, struct module* module)
 
         if (dwarf2_parse(module, module->reloc_delta, NULL /* FIXME: some thunks to deal with ? */,
                          &module->format_info[DFI_MACHO]->u.macho_info->file_map))
+        {
+            /* the symbol table is matched (by name) against the DWARF symbols, so load them all */
+            module_request_debug(module, 0);
             ret = TRUE;
+        }
     }
 
     mdi.fmap = fmap;
@@ -1492,6 +1496,8 @@ static BOOL macho_load_file(struct process* pcs, const WCHAR* filename,
         modfmt->module       = macho_info->module;
         modfmt->remove       = macho_module_remove;
         modfmt->loc_compute  = NULL;
+        modfmt->request_debug = NULL;
+        modfmt->pending_debug = NULL;
         modfmt->u.macho_info = macho_module_info;
 
         macho_module_info->load_addr = load_addr;
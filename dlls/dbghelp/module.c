@@ -259,6 +259,16 @@ BOOL module_init_pair(struct module_pair* pair, HANDLE hProcess, DWORD64 addr)
     return module_get_debug(pair);
 }
 
+/* same as module_init_pair, but only ensures the debug information needed to
+ * look up addr is loaded
+ */
+BOOL module_init_pair_at(struct module_pair* pair, HANDLE hProcess, DWORD64 addr)
+{
+    if (!(pair->pcs = process_find_by_handle(hProcess))) return FALSE;
+    pair->requested = module_find_by_addr(pair->pcs, addr, DMT_UNKNOWN);
+    return module_get_debug_at(pair, addr);
+}
+
 /***********************************************************************
  *	module_find_by_nameW
  *
@@ -384,6 +394,48 @@ BOOL module_load_debug(struct module* module)
     return module->module.SymType != SymNone;
 }
 
+/******************************************************************
+ *		module_request_debug
+ *
+ * Asks the debug formats which load their information on demand to load
+ * what's needed to look up addr (or all of it when addr is 0).
+ * Returns FALSE if one of them couldn't tell which part covers addr.
+ */
+BOOL module_request_debug(struct module* module, DWORD64 addr)
+{
+    struct module_format* modfmt;
+    BOOL ret = TRUE;
+    unsigned i;
+
+    for (i = 0; i < DFI_LAST; i++)
+    {
+        if ((modfmt = module->format_info[i]) && modfmt->request_debug &&
+            !modfmt->request_debug(modfmt, addr))
+            ret = FALSE;
+    }
+    module->module.NumSyms = module->ht_symbols.num_elts;
+    return ret;
+}
+
+/******************************************************************
+ *		module_has_pending_debug
+ *
+ * Tells whether some debug information covering addr hasn't been loaded yet.
+ */
+BOOL module_has_pending_debug(struct module* module, DWORD64 addr)
+{
+    struct module_format* modfmt;
+    unsigned i;
+
+    for (i = 0; i < DFI_LAST; i++)
+    {
+        if ((modfmt = module->format_info[i]) && modfmt->pending_debug &&
+            modfmt->pending_debug(modfmt, addr))
+            return TRUE;
+    }
+    return FALSE;
+}
+
 /******************************************************************
  *		module_get_debug
  *
@@ -400,7 +452,26 @@ BOOL module_get_debug(struct module_pair* pair)
     /* for a PE builtin, always get info from container */
     if (!(pair->effective = module_get_container(pair->pcs, pair->requested)))
         pair->effective = pair->requested;
-    return module_load_debug(pair->effective);
+    if (!module_load_debug(pair->effective)) return FALSE;
+    module_request_debug(pair->effective, 0);
+    return TRUE;
+}
+
+/******************************************************************
+ *		module_get_debug_at
+ *
+ * same as module_get_debug, but only requires the debug information
+ * covering addr to be loaded
+ */
+BOOL module_get_debug_at(struct module_pair* pair, DWORD64 addr)
+{
+    if (!pair->requested) return FALSE;
+    if (!(pair->effective = module_get_container(pair->pcs, pair->requested)))
+        pair->effective = pair->requested;
+    if (!module_load_debug(pair->effective)) return FALSE;
+    if (!module_request_debug(pair->effective, addr))
+        module_request_debug(pair->effective, 0);
+    return TRUE;
 }
 
 /***********************************************************************
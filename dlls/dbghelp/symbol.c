@@ -1151,7 +1151,7 @@ static BOOL symt_enum_locals(struct process* pcs, const WCHAR* mask,
 
     pair.pcs = pcs;
     pair.requested = module_find_by_addr(pair.pcs, pcs->localscope_pc, DMT_UNKNOWN);
-    if (!module_get_debug(&pair)) return FALSE;
+    if (!module_get_debug_at(&pair, pcs->localscope_pc)) return FALSE;
 
     if (symt_check_tag(pcs->localscope_symt, SymTagFunction) ||
         symt_check_tag(pcs->localscope_symt, SymTagInlineSite))
@@ -1483,7 +1483,7 @@ BOOL WINAPI SymFromAddr(HANDLE hProcess, DWORD64 Address,
     struct module_pair  pair;
     struct symt_ht*     sym;
 
-    if (!module_init_pair(&pair, hProcess, Address)) return FALSE;
+    if (!module_init_pair_at(&pair, hProcess, Address)) return FALSE;
     if ((sym = symt_find_symbol_at(pair.effective, Address)) == NULL) return FALSE;
 
     symt_fill_sym_info(&pair, NULL, &sym->symt, Symbol);
@@ -1911,7 +1911,7 @@ static BOOL get_line_from_addr(HANDLE hProcess, DWORD64 addr,
     struct module_pair          pair;
     struct symt_ht*             symt;
 
-    if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+    if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
     if ((symt = symt_find_symbol_at(pair.effective, addr)) == NULL) return FALSE;
 
     if (symt->symt.tag != SymTagFunction && symt->symt.tag != SymTagInlineSite) return FALSE;
@@ -2021,7 +2021,7 @@ static BOOL symt_get_func_line_prev(HANDLE hProcess, struct internal_line_t* int
     struct line_info*   li;
     struct line_info*   srcli;
 
-    if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+    if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
 
     if (key == NULL) return FALSE;
 
@@ -2100,7 +2100,7 @@ static BOOL symt_get_func_line_next(HANDLE hProcess, struct internal_line_t* int
     struct line_info*   srcli;
 
     if (key == NULL) return FALSE;
-    if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+    if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
 
     /* search current source file */
     for (srcli = key; !srcli->is_source_file; srcli--);
@@ -2670,7 +2670,7 @@ BOOL WINAPI SymFromInlineContext(HANDLE hProcess, DWORD64 addr, ULONG inline_ctx
     switch (IFC_MODE(inline_ctx))
     {
     case IFC_MODE_INLINE:
-        if (!module_init_pair(&pair, hProcess, addr)) return FALSE;
+        if (!module_init_pair_at(&pair, hProcess, addr)) return FALSE;
         inlined = symt_find_inlined_site(pair.effective, addr, inline_ctx);
         if (inlined)
         {
@@ -2787,7 +2787,7 @@ DWORD WINAPI SymAddrIncludeInlineTrace(HANDLE hProcess, DWORD64 addr)
 
     TRACE("(%p, %#I64x)\n", hProcess, addr);
 
-    if (module_init_pair(&pair, hProcess, addr))
+    if (module_init_pair_at(&pair, hProcess, addr))
     {
         struct symt_ht* symt = symt_find_symbol_at(pair.effective, addr);
         if (symt_check_tag(&symt->symt, SymTagFunction))
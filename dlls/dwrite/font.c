@@ -4636,6 +4636,556 @@ static void fontcollection_add_replacements(struct dwrite_fontcollection *collec
     RegCloseKey(hkey);
 }
 
+/* Persistent system collection cache.
+
+   Font properties and names of every file of the system collection are stored on disk, so that
+   creating the collection does not need to parse the font files again. File entries are sorted
+   by path and validated by file size and last write time. */
+
+#define FONTCACHE_MAGIC   0x43465744 /* "DWFC" */
+#define FONTCACHE_VERSION 1
+
+struct fontcache_header
+{
+    UINT32 magic;
+    UINT32 version;
+    UINT32 size;
+    UINT32 count;
+    UINT32 offsets[1]; /* file entries, sorted by path */
+};
+
+struct fontcache_file
+{
+    UINT32 size;            /* entry size, including face records */
+    UINT32 face_type;
+    UINT32 face_count;
+    UINT32 file_size[2];
+    FILETIME writetime;
+    WCHAR path[1];
+};
+
+struct fontcache_face
+{
+    UINT32 size;
+    UINT32 index;
+    UINT32 style;
+    UINT32 stretch;
+    UINT32 weight;
+    UINT32 flags;
+    DWRITE_PANOSE panose;
+    UINT16 padding;
+    FONTSIGNATURE fontsig;
+    DWRITE_FONT_METRICS1 metrics;
+    DWRITE_FONT_AXIS_VALUE axis[3];
+    LOGFONTW lf;
+    /* family names and face names follow */
+};
+
+struct fontcache
+{
+    const BYTE *data;
+    UINT32 size;
+    UINT32 count;
+};
+
+struct fontcache_buffer
+{
+    BYTE *data;
+    size_t size;
+    size_t capacity;
+};
+
+struct fontcache_writer
+{
+    struct fontcache_buffer *entries;
+    size_t size;
+    size_t count;
+    BOOL dirty;
+};
+
+static BOOL get_fontcache_path(WCHAR *path)
+{
+    UINT len = GetWindowsDirectoryW(path, MAX_PATH);
+
+    if (!len || len + 20 > MAX_PATH) return FALSE;
+    wcscat(path, L"\\dwritefontcache.dat");
+    return TRUE;
+}
+
+static const WCHAR *fontcache_read_string(const BYTE **ptr, const BYTE *end)
+{
+    const WCHAR *str = (const WCHAR *)*ptr;
+    size_t len = 0, max_len = (end - *ptr) / sizeof(WCHAR);
+
+    while (len < max_len && str[len]) len++;
+    if (len == max_len) return NULL;
+    *ptr += ((len + 1) * sizeof(WCHAR) + 3) & ~3;
+    return str;
+}
+
+static const struct fontcache_file *fontcache_get_file(const struct fontcache *cache, UINT32 index)
+{
+    const struct fontcache_header *header = (const struct fontcache_header *)cache->data;
+    const struct fontcache_file *file;
+    UINT32 offset = header->offsets[index];
+    const BYTE *ptr;
+
+    if (offset % 4 || offset >= cache->size || cache->size - offset < sizeof(*file)) return NULL;
+    file = (const struct fontcache_file *)(cache->data + offset);
+    if (file->size < sizeof(*file) || file->size > cache->size - offset || file->size % 4) return NULL;
+    ptr = (const BYTE *)file->path;
+    if (!fontcache_read_string(&ptr, (const BYTE *)file + file->size)) return NULL;
+    return file;
+}
+
+static void fontcache_open(struct fontcache *cache)
+{
+    const struct fontcache_header *header;
+    WCHAR path[MAX_PATH];
+    LARGE_INTEGER size;
+    HANDLE file, mapping;
+
+    memset(cache, 0, sizeof(*cache));
+
+    if (!get_fontcache_path(path)) return;
+    file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    if (GetFileSizeEx(file, &size) && size.QuadPart >= sizeof(*header) && size.QuadPart < 0x40000000
+            && (mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL)))
+    {
+        cache->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+    }
+    CloseHandle(file);
+    if (!cache->data) return;
+
+    header = (const struct fontcache_header *)cache->data;
+    if (header->magic != FONTCACHE_MAGIC || header->version != FONTCACHE_VERSION || header->size != size.QuadPart
+            || header->count > (size.QuadPart - offsetof(struct fontcache_header, offsets)) / sizeof(UINT32))
+    {
+        TRACE("Ignoring invalid font cache %s.\n", debugstr_w(path));
+        UnmapViewOfFile(cache->data);
+        cache->data = NULL;
+        return;
+    }
+    cache->size = header->size;
+    cache->count = header->count;
+}
+
+static void fontcache_close(struct fontcache *cache)
+{
+    if (cache->data)
+        UnmapViewOfFile(cache->data);
+}
+
+static const struct fontcache_file *fontcache_find_file(const struct fontcache *cache, const WCHAR *path)
+{
+    const struct fontcache_file *file;
+    UINT32 min = 0, max = cache->count;
+    int c;
+
+    while (min < max)
+    {
+        UINT32 pos = (min + max) / 2;
+
+        if (!(file = fontcache_get_file(cache, pos))) return NULL;
+        if (!(c = wcscmp(path, file->path))) return file;
+        if (c < 0) max = pos;
+        else min = pos + 1;
+    }
+
+    return NULL;
+}
+
+static BOOL systemfontfileenumerator_get_current_size(IDWriteFontFileEnumerator *iface, UINT64 *size);
+
+static HRESULT fontcache_get_file_identity(IDWriteFontFileEnumerator *enumerator, IDWriteFontFile *file,
+        WCHAR **path, FILETIME *writetime, UINT64 *size)
+{
+    IDWriteLocalFontFileLoader *local_loader;
+    IDWriteFontFileLoader *loader;
+    UINT32 key_size, length;
+    const void *key;
+    HRESULT hr;
+
+    *path = NULL;
+
+    if (FAILED(hr = IDWriteFontFile_GetReferenceKey(file, &key, &key_size)))
+        return hr;
+    if (FAILED(hr = IDWriteFontFile_GetLoader(file, &loader)))
+        return hr;
+    hr = IDWriteFontFileLoader_QueryInterface(loader, &IID_IDWriteLocalFontFileLoader, (void **)&local_loader);
+    IDWriteFontFileLoader_Release(loader);
+    if (FAILED(hr))
+        return hr;
+
+    if (SUCCEEDED(hr = IDWriteLocalFontFileLoader_GetFilePathLengthFromKey(local_loader, key, key_size, &length)))
+    {
+        if (!(*path = malloc((length + 1) * sizeof(WCHAR))))
+            hr = E_OUTOFMEMORY;
+        else if (SUCCEEDED(hr = IDWriteLocalFontFileLoader_GetFilePathFromKey(local_loader, key, key_size, *path,
+                length + 1)))
+        {
+            hr = IDWriteLocalFontFileLoader_GetLastWriteTimeFromKey(local_loader, key, key_size, writetime);
+        }
+    }
+    IDWriteLocalFontFileLoader_Release(local_loader);
+
+    /* the write time in the key comes from the same query as the size */
+    if (SUCCEEDED(hr) && !systemfontfileenumerator_get_current_size(enumerator, size))
+        hr = E_FAIL;
+
+    if (FAILED(hr))
+    {
+        free(*path);
+        *path = NULL;
+        return hr;
+    }
+
+    return S_OK;
+}
+
+static BOOL fontcache_buffer_append(struct fontcache_buffer *buffer, const void *data, size_t size)
+{
+    size_t aligned_size = (size + 3) & ~3;
+
+    if (!dwrite_array_reserve((void **)&buffer->data, &buffer->capacity, buffer->size + aligned_size, 1))
+        return FALSE;
+    memcpy(buffer->data + buffer->size, data, size);
+    memset(buffer->data + buffer->size + size, 0, aligned_size - size);
+    buffer->size += aligned_size;
+    return TRUE;
+}
+
+static BOOL fontcache_buffer_append_strings(struct fontcache_buffer *buffer, IDWriteLocalizedStrings *strings)
+{
+    WCHAR locale[LOCALE_NAME_MAX_LENGTH], *str;
+    UINT32 i, count, length;
+    BOOL ret = TRUE;
+
+    count = strings ? IDWriteLocalizedStrings_GetCount(strings) : ~0u;
+    if (!fontcache_buffer_append(buffer, &count, sizeof(count))) return FALSE;
+
+    for (i = 0; strings && ret && i < count; ++i)
+    {
+        if (FAILED(IDWriteLocalizedStrings_GetLocaleName(strings, i, locale, ARRAY_SIZE(locale)))
+                || FAILED(IDWriteLocalizedStrings_GetStringLength(strings, i, &length))
+                || !(str = malloc((length + 1) * sizeof(WCHAR))))
+            return FALSE;
+
+        ret = SUCCEEDED(IDWriteLocalizedStrings_GetString(strings, i, str, length + 1))
+                && fontcache_buffer_append(buffer, locale, (wcslen(locale) + 1) * sizeof(WCHAR))
+                && fontcache_buffer_append(buffer, str, (length + 1) * sizeof(WCHAR));
+        free(str);
+    }
+
+    return ret;
+}
+
+static BOOL fontcache_buffer_append_face(struct fontcache_buffer *buffer, const struct dwrite_font_data *data)
+{
+    struct fontcache_face face;
+    size_t offset = buffer->size;
+
+    memset(&face, 0, sizeof(face));
+    face.index = data->face_index;
+    face.style = data->style;
+    face.stretch = data->stretch;
+    face.weight = data->weight;
+    face.flags = data->flags;
+    face.panose = data->panose;
+    face.fontsig = data->fontsig;
+    face.metrics = data->metrics;
+    memcpy(face.axis, data->axis, sizeof(face.axis));
+    face.lf = data->lf;
+
+    if (!fontcache_buffer_append(buffer, &face, sizeof(face))
+            || !fontcache_buffer_append_strings(buffer, data->family_names)
+            || !fontcache_buffer_append_strings(buffer, data->names))
+    {
+        return FALSE;
+    }
+
+    ((struct fontcache_face *)(buffer->data + offset))->size = buffer->size - offset;
+    return TRUE;
+}
+
+static BOOL fontcache_begin_file(struct fontcache_writer *writer, const WCHAR *path, FILETIME writetime,
+        UINT64 size, DWRITE_FONT_FACE_TYPE face_type)
+{
+    struct fontcache_buffer *buffer;
+    struct fontcache_file file;
+
+    if (!dwrite_array_reserve((void **)&writer->entries, &writer->size, writer->count + 1, sizeof(*writer->entries)))
+        return FALSE;
+
+    buffer = &writer->entries[writer->count];
+    memset(buffer, 0, sizeof(*buffer));
+    memset(&file, 0, sizeof(file));
+    file.face_type = face_type;
+    file.file_size[0] = size;
+    file.file_size[1] = size >> 32;
+    file.writetime = writetime;
+
+    if (!fontcache_buffer_append(buffer, &file, offsetof(struct fontcache_file, path))
+            || !fontcache_buffer_append(buffer, path, (wcslen(path) + 1) * sizeof(WCHAR)))
+    {
+        free(buffer->data);
+        return FALSE;
+    }
+
+    writer->count++;
+    return TRUE;
+}
+
+static void fontcache_end_file(struct fontcache_writer *writer, UINT32 face_count)
+{
+    struct fontcache_buffer *buffer = &writer->entries[writer->count - 1];
+    struct fontcache_file *file = (struct fontcache_file *)buffer->data;
+
+    file->size = buffer->size;
+    file->face_count = face_count;
+}
+
+static void fontcache_add_file(struct fontcache_writer *writer, const struct fontcache_file *file)
+{
+    struct fontcache_buffer *buffer;
+
+    if (!dwrite_array_reserve((void **)&writer->entries, &writer->size, writer->count + 1, sizeof(*writer->entries)))
+        return;
+
+    buffer = &writer->entries[writer->count];
+    memset(buffer, 0, sizeof(*buffer));
+    if (fontcache_buffer_append(buffer, file, file->size))
+        writer->count++;
+}
+
+static int __cdecl fontcache_compare_entries(const void *a, const void *b)
+{
+    const struct fontcache_buffer *left = a, *right = b;
+
+    return wcscmp(((const struct fontcache_file *)left->data)->path,
+            ((const struct fontcache_file *)right->data)->path);
+}
+
+static void fontcache_write(struct fontcache_writer *writer)
+{
+    WCHAR path[MAX_PATH], dir[MAX_PATH], tmp[MAX_PATH];
+    struct fontcache_header header;
+    UINT32 offset, size, i;
+    BOOL ret = TRUE;
+    DWORD written;
+    HANDLE file;
+
+    if (!get_fontcache_path(path) || !GetWindowsDirectoryW(dir, ARRAY_SIZE(dir))
+            || !GetTempFileNameW(dir, L"dwc", 0, tmp))
+    {
+        return;
+    }
+
+    qsort(writer->entries, writer->count, sizeof(*writer->entries), fontcache_compare_entries);
+
+    offset = offsetof(struct fontcache_header, offsets[writer->count]);
+    size = offset;
+    for (i = 0; i < writer->count; ++i)
+        size += writer->entries[i].size;
+
+    header.magic = FONTCACHE_MAGIC;
+    header.version = FONTCACHE_VERSION;
+    header.size = size;
+    header.count = writer->count;
+
+    file = CreateFileW(tmp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        DeleteFileW(tmp);
+        return;
+    }
+
+    ret = WriteFile(file, &header, offsetof(struct fontcache_header, offsets), &written, NULL);
+    for (i = 0; ret && i < writer->count; ++i)
+    {
+        ret = WriteFile(file, &offset, sizeof(offset), &written, NULL);
+        offset += writer->entries[i].size;
+    }
+    for (i = 0; ret && i < writer->count; ++i)
+        ret = WriteFile(file, writer->entries[i].data, writer->entries[i].size, &written, NULL);
+    CloseHandle(file);
+
+    if (!ret || !MoveFileExW(tmp, path, MOVEFILE_REPLACE_EXISTING))
+    {
+        WARN("Failed to write font cache %s.\n", debugstr_w(path));
+        DeleteFileW(tmp);
+    }
+    else
+        TRACE("Wrote %u file entries to %s.\n", writer->count, debugstr_w(path));
+}
+
+static void fontcache_writer_release(struct fontcache_writer *writer)
+{
+    size_t i;
+
+    for (i = 0; i < writer->count; ++i)
+        free(writer->entries[i].data);
+    free(writer->entries);
+}
+
+static BOOL fontcache_read_strings(const BYTE **ptr, const BYTE *end, IDWriteLocalizedStrings **strings)
+{
+    const WCHAR *locale, *str;
+    UINT32 i, count;
+
+    *strings = NULL;
+
+    if (end - *ptr < sizeof(count)) return FALSE;
+    count = *(const UINT32 *)*ptr;
+    *ptr += sizeof(count);
+    if (count == ~0u) return TRUE;
+
+    if (FAILED(create_localizedstrings(strings))) return FALSE;
+
+    for (i = 0; i < count; ++i)
+    {
+        if (!(locale = fontcache_read_string(ptr, end)) || !(str = fontcache_read_string(ptr, end)))
+        {
+            IDWriteLocalizedStrings_Release(*strings);
+            *strings = NULL;
+            return FALSE;
+        }
+        add_localizedstring(*strings, locale, str);
+    }
+
+    return TRUE;
+}
+
+static HRESULT init_font_data_from_cache(const struct fontcache_face *face, const BYTE *end, IDWriteFontFile *file,
+        DWRITE_FONT_FACE_TYPE face_type, struct dwrite_font_data **ret)
+{
+    struct dwrite_font_data *data;
+    const BYTE *ptr;
+
+    *ret = NULL;
+
+    if (!(data = calloc(1, sizeof(*data))))
+        return E_OUTOFMEMORY;
+
+    data->refcount = 1;
+    data->file = file;
+    data->face_index = face->index;
+    data->face_type = face_type;
+    IDWriteFontFile_AddRef(data->file);
+
+    ptr = (const BYTE *)(face + 1);
+    if (face->style > DWRITE_FONT_STYLE_ITALIC || face->stretch > DWRITE_FONT_STRETCH_ULTRA_EXPANDED
+            || !fontcache_read_strings(&ptr, end, &data->family_names) || !data->family_names
+            || !fontcache_read_strings(&ptr, end, &data->names))
+    {
+        release_font_data(data);
+        return E_FAIL;
+    }
+
+    data->style = face->style;
+    data->stretch = face->stretch;
+    data->weight = face->weight;
+    data->panose = face->panose;
+    data->fontsig = face->fontsig;
+    data->lf = face->lf;
+    data->flags = face->flags;
+    data->metrics = face->metrics;
+    memcpy(data->axis, face->axis, sizeof(data->axis));
+
+    init_font_prop_vec(data->weight, data->stretch, data->style, &data->propvec);
+
+    *ret = data;
+    return S_OK;
+}
+
+static HRESULT fontcache_load_file_fonts(const struct fontcache_file *cached, IDWriteFontFile *file,
+        struct dwrite_font_data ***ret, UINT32 *count)
+{
+    const BYTE *ptr = (const BYTE *)cached->path, *end = (const BYTE *)cached + cached->size;
+    struct dwrite_font_data **fonts;
+    UINT32 i;
+
+    *ret = NULL;
+    *count = 0;
+
+    if (!cached->face_count) return S_OK;
+    if (cached->face_count > cached->size / sizeof(struct fontcache_face)) return E_FAIL;
+    if (!(fonts = calloc(cached->face_count, sizeof(*fonts)))) return E_OUTOFMEMORY;
+
+    fontcache_read_string(&ptr, end);
+    for (i = 0; i < cached->face_count; ++i)
+    {
+        const struct fontcache_face *face = (const struct fontcache_face *)ptr;
+
+        if (end - ptr < sizeof(*face) || face->size < sizeof(*face) || face->size > end - ptr || face->size % 4
+                || FAILED(init_font_data_from_cache(face, ptr + face->size, file, cached->face_type, &fonts[i])))
+        {
+            break;
+        }
+        ptr += face->size;
+    }
+
+    if (i < cached->face_count)
+    {
+        while (i--) release_font_data(fonts[i]);
+        free(fonts);
+        return E_FAIL;
+    }
+
+    *ret = fonts;
+    *count = cached->face_count;
+    return S_OK;
+}
+
+static void fontcache_cancel_file(struct fontcache_writer *writer)
+{
+    free(writer->entries[--writer->count].data);
+}
+
+static HRESULT fontcollection_add_font_data(struct dwrite_fontcollection *collection, struct dwrite_font_data *font_data)
+{
+    WCHAR familyW[255];
+    UINT32 index;
+    HRESULT hr;
+
+    fontstrings_get_en_string(font_data->family_names, familyW, ARRAY_SIZE(familyW));
+
+    /* ignore dot named faces */
+    if (familyW[0] == '.')
+    {
+        WARN("Ignoring face %s\n", debugstr_w(familyW));
+        release_font_data(font_data);
+        return S_OK;
+    }
+
+    index = collection_find_family(collection, familyW);
+    if (index != ~0u)
+        hr = fontfamily_add_font(collection->family_data[index], font_data);
+    else {
+        struct dwrite_fontfamily_data *family_data;
+
+        /* create and init new family */
+        hr = init_fontfamily_data(font_data->family_names, &family_data);
+        if (hr == S_OK) {
+            /* add font to family, family - to collection */
+            hr = fontfamily_add_font(family_data, font_data);
+            if (hr == S_OK)
+                hr = fontcollection_add_family(collection, family_data);
+
+            if (FAILED(hr))
+                release_fontfamily_data(family_data);
+        }
+    }
+
+    if (FAILED(hr))
+        release_font_data(font_data);
+
+    return hr;
+}
+
 HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerator *enumerator, BOOL is_system,
     IDWriteFontCollection3 **ret)
 {
@@ -4645,7 +5195,10 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
     };
     struct fontfile_enum *fileenum, *fileenum2;
     struct dwrite_fontcollection *collection;
+    struct fontcache_writer cache_writer = { 0 };
+    struct fontcache cache = { 0 };
     struct list scannedfiles;
+    UINT32 cache_hits = 0;
     BOOL current = FALSE;
     HRESULT hr = S_OK;
     size_t i;
@@ -4666,14 +5219,22 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
 
     TRACE("building font collection:\n");
 
+    if (is_system)
+        fontcache_open(&cache);
+
     list_init(&scannedfiles);
     while (hr == S_OK) {
+        const struct fontcache_file *cached = NULL;
+        struct dwrite_font_data **cached_fonts;
         DWRITE_FONT_FACE_TYPE face_type;
         DWRITE_FONT_FILE_TYPE file_type;
-        BOOL supported, same = FALSE;
+        BOOL supported, same = FALSE, cache_file = FALSE;
         IDWriteFontFileStream *stream;
+        UINT32 face_count, cached_faces, added_faces;
         IDWriteFontFile *file;
-        UINT32 face_count;
+        FILETIME writetime;
+        UINT64 file_size;
+        WCHAR *path = NULL;
 
         current = FALSE;
         hr = IDWriteFontFileEnumerator_MoveNext(enumerator, &current);
@@ -4695,7 +5256,46 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
             continue;
         }
 
+        if (is_system && SUCCEEDED(fontcache_get_file_identity(enumerator, file, &path, &writetime, &file_size)))
+        {
+            if ((cached = fontcache_find_file(&cache, path)) && (CompareFileTime(&cached->writetime, &writetime)
+                    || cached->file_size[0] != (UINT32)file_size || cached->file_size[1] != (UINT32)(file_size >> 32)))
+            {
+                cached = NULL;
+            }
+            cache_file = TRUE;
+        }
+
+        if (cached && SUCCEEDED(fontcache_load_file_fonts(cached, file, &cached_fonts, &cached_faces)))
+        {
+            free(path);
+            fontcache_add_file(&cache_writer, cached);
+            cache_hits++;
+
+            /* files without faces are skipped, like unsupported ones below */
+            if (!cached_faces)
+            {
+                IDWriteFontFile_Release(file);
+                continue;
+            }
+
+            fileenum = malloc(sizeof(*fileenum));
+            fileenum->file = file;
+            list_add_tail(&scannedfiles, &fileenum->entry);
+
+            for (i = 0; i < cached_faces; ++i)
+            {
+                if (hr == S_OK)
+                    hr = fontcollection_add_font_data(collection, cached_fonts[i]);
+                else
+                    release_font_data(cached_fonts[i]);
+            }
+            free(cached_fonts);
+            continue;
+        }
+
         if (FAILED(get_filestream_from_file(file, &stream))) {
+            free(path);
             IDWriteFontFile_Release(file);
             continue;
         }
@@ -4704,23 +5304,29 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
         hr = opentype_analyze_font(stream, &supported, &file_type, &face_type, &face_count);
         if (FAILED(hr) || !supported || face_count == 0) {
             TRACE("Unsupported font (%p, 0x%08lx, %d, %u)\n", file, hr, supported, face_count);
+            if (cache_file && fontcache_begin_file(&cache_writer, path, writetime, file_size,
+                    DWRITE_FONT_FACE_TYPE_UNKNOWN))
+            {
+                fontcache_end_file(&cache_writer, 0);
+                cache_writer.dirty = TRUE;
+            }
+            free(path);
             IDWriteFontFileStream_Release(stream);
             IDWriteFontFile_Release(file);
             hr = S_OK;
             continue;
         }
 
-        /* add to scanned list */
-        fileenum = malloc(sizeof(*fileenum));
-        fileenum->file = file;
-        list_add_tail(&scannedfiles, &fileenum->entry);
+        if (cache_file)
+            cache_file = fontcache_begin_file(&cache_writer, path, writetime, file_size, face_type);
+        free(path);
+        cached_faces = 0;
+        added_faces = 0;
 
         for (i = 0; i < face_count; ++i)
         {
             struct dwrite_font_data *font_data;
             struct fontface_desc desc;
-            WCHAR familyW[255];
-            UINT32 index;
 
             desc.factory = factory;
             desc.face_type = face_type;
@@ -4739,41 +5345,37 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
                 continue;
             }
 
-            fontstrings_get_en_string(font_data->family_names, familyW, ARRAY_SIZE(familyW));
-
-            /* ignore dot named faces */
-            if (familyW[0] == '.')
+            if (cache_file)
             {
-                WARN("Ignoring face %s\n", debugstr_w(familyW));
-                release_font_data(font_data);
-                continue;
-            }
-
-            index = collection_find_family(collection, familyW);
-            if (index != ~0u)
-                hr = fontfamily_add_font(collection->family_data[index], font_data);
-            else {
-                struct dwrite_fontfamily_data *family_data;
-
-                /* create and init new family */
-                hr = init_fontfamily_data(font_data->family_names, &family_data);
-                if (hr == S_OK) {
-                    /* add font to family, family - to collection */
-                    hr = fontfamily_add_font(family_data, font_data);
-                    if (hr == S_OK)
-                        hr = fontcollection_add_family(collection, family_data);
-
-                    if (FAILED(hr))
-                        release_fontfamily_data(family_data);
+                if (fontcache_buffer_append_face(&cache_writer.entries[cache_writer.count - 1], font_data))
+                    cached_faces++;
+                else
+                {
+                    fontcache_cancel_file(&cache_writer);
+                    cache_file = FALSE;
                 }
             }
 
-            if (FAILED(hr))
-            {
-                release_font_data(font_data);
+            if (FAILED(hr = fontcollection_add_font_data(collection, font_data)))
                 break;
-            }
+            added_faces++;
+        }
+
+        if (cache_file)
+        {
+            fontcache_end_file(&cache_writer, cached_faces);
+            cache_writer.dirty = TRUE;
+        }
+
+        /* add to scanned list */
+        if (added_faces)
+        {
+            fileenum = malloc(sizeof(*fileenum));
+            fileenum->file = file;
+            list_add_tail(&scannedfiles, &fileenum->entry);
         }
+        else
+            IDWriteFontFile_Release(file);
 
         IDWriteFontFileStream_Release(stream);
     }
@@ -4785,6 +5387,15 @@ HRESULT create_font_collection(IDWriteFactory7 *factory, IDWriteFontFileEnumerat
         free(fileenum);
     }
 
+    if (is_system)
+    {
+        /* rewrite the cache if files were added, modified or removed */
+        if (SUCCEEDED(hr) && (cache_writer.dirty || cache_hits != cache.count))
+            fontcache_write(&cache_writer);
+        fontcache_writer_release(&cache_writer);
+        fontcache_close(&cache);
+    }
+
     for (i = 0; i < collection->count; ++i)
     {
         fontfamily_add_bold_simulated_face(collection->family_data[i]);
@@ -4915,6 +5526,8 @@ struct system_fontfile_enumerator
 
     WCHAR *filename;
     DWORD filename_size;
+    WIN32_FILE_ATTRIBUTE_DATA info; /* attributes of the current file, if has_info is set */
+    BOOL has_info;
 };
 
 static inline struct system_fontfile_enumerator *impl_from_IDWriteFontFileEnumerator(IDWriteFontFileEnumerator* iface)
@@ -4959,25 +5572,26 @@ static ULONG WINAPI systemfontfileenumerator_Release(IDWriteFontFileEnumerator *
     return refcount;
 }
 
-static HRESULT create_local_file_reference(IDWriteFactory7 *factory, const WCHAR *filename, IDWriteFontFile **file)
+/* when 'info' is set, it returns the file attributes used for the write time of the reference */
+static HRESULT create_local_file_reference(IDWriteFactory7 *factory, const WCHAR *filename,
+        WIN32_FILE_ATTRIBUTE_DATA *info, BOOL *has_info, IDWriteFontFile **file)
 {
-    HRESULT hr;
+    WCHAR fullpathW[MAX_PATH];
+    const FILETIME *writetime = NULL;
 
     /* Fonts installed in 'Fonts' system dir don't get full path in registry font files cache */
     if (!wcschr(filename, '\\'))
     {
-        WCHAR fullpathW[MAX_PATH];
-
         GetWindowsDirectoryW(fullpathW, ARRAY_SIZE(fullpathW));
         wcscat(fullpathW, L"\\fonts\\");
         wcscat(fullpathW, filename);
-
-        hr = IDWriteFactory7_CreateFontFileReference(factory, fullpathW, NULL, file);
+        filename = fullpathW;
     }
-    else
-        hr = IDWriteFactory7_CreateFontFileReference(factory, filename, NULL, file);
 
-    return hr;
+    if (info && (*has_info = GetFileAttributesExW(filename, GetFileExInfoStandard, info)))
+        writetime = &info->ftLastWriteTime;
+
+    return IDWriteFactory7_CreateFontFileReference(factory, filename, writetime, file);
 }
 
 static HRESULT WINAPI systemfontfileenumerator_GetCurrentFontFile(IDWriteFontFileEnumerator *iface, IDWriteFontFile **file)
@@ -4989,7 +5603,17 @@ static HRESULT WINAPI systemfontfileenumerator_GetCurrentFontFile(IDWriteFontFil
     if (enumerator->index < 0 || !enumerator->filename || !*enumerator->filename)
         return E_FAIL;
 
-    return create_local_file_reference(enumerator->factory, enumerator->filename, file);
+    return create_local_file_reference(enumerator->factory, enumerator->filename, &enumerator->info,
+            &enumerator->has_info, file);
+}
+
+static BOOL systemfontfileenumerator_get_current_size(IDWriteFontFileEnumerator *iface, UINT64 *size)
+{
+    struct system_fontfile_enumerator *enumerator = impl_from_IDWriteFontFileEnumerator(iface);
+
+    if (!enumerator->has_info) return FALSE;
+    *size = ((UINT64)enumerator->info.nFileSizeHigh << 32) | enumerator->info.nFileSizeLow;
+    return TRUE;
 }
 
 static HRESULT WINAPI systemfontfileenumerator_MoveNext(IDWriteFontFileEnumerator *iface, BOOL *current)
@@ -5141,7 +5765,7 @@ static HRESULT eudc_collection_add_family(IDWriteFactory7 *factory, struct dwrit
     HRESULT hr;
 
     /* create font file from this path */
-    hr = create_local_file_reference(factory, pathW, &file);
+    hr = create_local_file_reference(factory, pathW, NULL, NULL, &file);
     if (FAILED(hr))
         return S_FALSE;
 
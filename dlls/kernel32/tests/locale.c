@@ -2032,6 +2032,24 @@ static void test_CompareStringW(void)
     ok(ret == CSTR_LESS_THAN, "expected CSTR_LESS_THAN, got %d\n", ret);
     ret = CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORENONSPACE, A_NULL_BC, 4, A_ACUTE_BC_DECOMP, 5);
     ok(ret == CSTR_EQUAL, "expected CSTR_EQUAL, got %d\n", ret);
+
+    /* differences after a long common prefix */
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column name", -1, L"Database column name", -1);
+    ok(ret == CSTR_EQUAL, "expected CSTR_EQUAL, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column name", -1, L"Database column Name", -1);
+    ok(ret == CSTR_LESS_THAN, "expected CSTR_LESS_THAN, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column nam\xe9", -1, L"Database column namE", -1);
+    ok(ret == CSTR_GREATER_THAN, "expected CSTR_GREATER_THAN, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column nam\xe9s", -1, L"Database column Names", -1);
+    ok(ret == CSTR_GREATER_THAN, "expected CSTR_GREATER_THAN, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column name", -1, L"Database column names", -1);
+    ok(ret == CSTR_LESS_THAN, "expected CSTR_LESS_THAN, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column nam\xe9", -1, L"Database column name\x301", -1);
+    ok(ret == CSTR_EQUAL, "expected CSTR_EQUAL, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, 0, L"Database column-name", -1, L"Database columnname", -1);
+    ok(ret == CSTR_GREATER_THAN, "expected CSTR_GREATER_THAN, got %d\n", ret);
+    ret = CompareStringW(LOCALE_USER_DEFAULT, NORM_IGNORECASE, L"Database column name", -1, L"DATABASE COLUMN NAME", -1);
+    ok(ret == CSTR_EQUAL, "expected CSTR_EQUAL, got %d\n", ret);
 }
 
 struct comparestringex_test {
@@ -6736,6 +6754,13 @@ static void test_FindNLSStringEx(void)
         { localeW, FIND_ENDSWITH, L"SimpleSimple", L"Simp", -1, 0xdeadbeef},
         { localeW, FIND_FROMSTART, comb_s_accent1W, comb_s_accent2W, 0, 6 },
         { localeW, FIND_FROMSTART, comb_q_accent1W, comb_q_accent2W, 2, 7 },
+        { localeW, FIND_FROMSTART | NORM_IGNORECASE, L"simplE simpLe SIMPLY simple", L"SIMPLY", 14, 6 },
+        { localeW, FIND_FROMEND | NORM_IGNORECASE, L"simplE simpLe SIMPLY", L"simple", 7, 6 },
+        { localeW, FIND_FROMSTART, L"simplE simpLe SIMPLY", L"simple", -1, 0xdeadbeef },
+        { localeW, FIND_FROMSTART, L"aabaabaaab", L"aaab", 6, 4 },
+        { localeW, FIND_FROMEND, L"abababab", L"abab", 4, 4 },
+        { localeW, FIND_FROMSTART, L"AAab aaAb aaab", L"aaab", 10, 4 },
+        { localeW, FIND_ENDSWITH, L"aaab aaab", L"aaab", 5, 4 },
     };
     unsigned int i;
 
@@ -4490,6 +4490,101 @@ todo_wine
     CloseHandle(mapping);
 }
 
+struct query_thread_params
+{
+    char *base;
+    SIZE_T size;
+    void *volatile block;
+    LONG done;
+};
+
+static DWORD WINAPI protect_thread( void *arg )
+{
+    struct query_thread_params *params = arg;
+    DWORD old_prot, i;
+    BOOL ret;
+
+    for (i = 0; i < 2000; i++)
+    {
+        ret = VirtualProtect( params->base + (i % 16) * si.dwPageSize, si.dwPageSize,
+                              (i & 16) ? PAGE_READWRITE : PAGE_READONLY, &old_prot );
+        ok( ret, "VirtualProtect failed %lu\n", GetLastError() );
+
+        /* also add and remove views, to change the views tree under the queries */
+        params->block = VirtualAlloc( NULL, si.dwPageSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+        ok( params->block != NULL, "VirtualAlloc failed %lu\n", GetLastError() );
+        ret = VirtualFree( params->block, 0, MEM_RELEASE );
+        ok( ret, "VirtualFree failed %lu\n", GetLastError() );
+    }
+    InterlockedExchange( &params->done, 1 );
+    return 0;
+}
+
+static void test_VirtualQuery_threads(void)
+{
+    struct query_thread_params params;
+    MEMORY_BASIC_INFORMATION info;
+    DWORD old_prot, count = 0;
+    HANDLE thread;
+    SIZE_T ret;
+    char *page;
+    BOOL bret;
+
+    params.size = 16 * si.dwPageSize;
+    params.base = VirtualAlloc( NULL, params.size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+    ok( params.base != NULL, "VirtualAlloc failed %lu\n", GetLastError() );
+    params.block = NULL;
+    params.done = 0;
+
+    thread = CreateThread( NULL, 0, protect_thread, &params, 0, NULL );
+    ok( thread != NULL, "CreateThread failed %lu\n", GetLastError() );
+
+    /* every query must see a consistent state, whatever the other thread is doing */
+    while (!ReadAcquire( &params.done ))
+    {
+        for (page = params.base; page < params.base + params.size; page += si.dwPageSize)
+        {
+            ret = VirtualQuery( page, &info, sizeof(info) );
+            ok( ret == sizeof(info), "VirtualQuery returned %Iu\n", ret );
+            ok( info.BaseAddress == page, "got BaseAddress %p, expected %p\n", info.BaseAddress, page );
+            ok( info.AllocationBase == params.base, "got AllocationBase %p, expected %p\n",
+                info.AllocationBase, params.base );
+            ok( info.AllocationProtect == PAGE_READWRITE, "got AllocationProtect %#lx\n", info.AllocationProtect );
+            ok( info.State == MEM_COMMIT, "got State %#lx\n", info.State );
+            ok( info.Type == MEM_PRIVATE, "got Type %#lx\n", info.Type );
+            ok( info.Protect == PAGE_READONLY || info.Protect == PAGE_READWRITE,
+                "got Protect %#lx\n", info.Protect );
+            ok( info.RegionSize && !(info.RegionSize % si.dwPageSize) &&
+                page + info.RegionSize <= params.base + params.size,
+                "got RegionSize %#Ix for %p\n", info.RegionSize, page );
+        }
+
+        if ((page = params.block))
+        {
+            ret = VirtualQuery( page, &info, sizeof(info) );
+            ok( ret == sizeof(info), "VirtualQuery returned %Iu\n", ret );
+            ok( info.BaseAddress == page, "got BaseAddress %p, expected %p\n", info.BaseAddress, page );
+            ok( info.RegionSize && !(info.RegionSize % si.dwPageSize), "got RegionSize %#Ix\n", info.RegionSize );
+        }
+        count++;
+    }
+    trace( "%lu query loops\n", count );
+
+    WaitForSingleObject( thread, INFINITE );
+    CloseHandle( thread );
+
+    /* the last round of the thread made all the pages read-only */
+    for (page = params.base; page < params.base + params.size; page += si.dwPageSize)
+    {
+        bret = VirtualProtect( page, si.dwPageSize, PAGE_READWRITE, &old_prot );
+        ok( bret, "VirtualProtect failed %lu\n", GetLastError() );
+        ok( old_prot == PAGE_READONLY, "got old protection %#lx\n", old_prot );
+    }
+
+    bret = VirtualFree( params.base, 0, MEM_RELEASE );
+    ok( bret, "VirtualFree failed %lu\n", GetLastError() );
+}
+
 START_TEST(virtual)
 {
     int argc;
@@ -4557,6 +4652,7 @@ START_TEST(virtual)
     test_shared_memory_ro(FALSE, FILE_MAP_COPY|FILE_MAP_WRITE);
     test_mappings();
     test_NtQuerySection();
+    test_VirtualQuery_threads();
     test_CreateFileMapping_protection();
     test_VirtualAlloc_protection();
     test_VirtualProtect();
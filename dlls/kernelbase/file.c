@@ -43,6 +43,7 @@
 #include "kernelbase.h"
 #include "wine/exception.h"
 #include "wine/debug.h"
+#include "wine/fsctl.h"
 
 #include "wine/heap.h"
 
@@ -494,23 +495,57 @@ BOOL WINAPI DECLSPEC_HOTPATCH AreFileApisANSI(void)
 }
 
 
+/***********************************************************************
+ *           copy_progress
+ *
+ * Call the progress routine of CopyFileEx; returns FALSE if the copy must be aborted.
+ */
+static BOOL copy_progress( LPPROGRESS_ROUTINE *progress, void *param, BOOL *cancel_ptr,
+                           LARGE_INTEGER size, LARGE_INTEGER transferred, DWORD reason, HANDLE h1, HANDLE h2 )
+{
+    DWORD cbret = PROGRESS_CONTINUE;
+
+    if (*progress)
+        cbret = (*progress)( size, transferred, size, transferred, 1, reason, h1, h2, param );
+    if (cancel_ptr && *cancel_ptr) cbret = PROGRESS_CANCEL;
+
+    if (cbret == PROGRESS_QUIET)
+        *progress = NULL;
+    else if (cbret == PROGRESS_STOP)
+    {
+        SetLastError( ERROR_REQUEST_ABORTED );
+        return FALSE;
+    }
+    else if (cbret == PROGRESS_CANCEL)
+    {
+        BOOLEAN disp = TRUE;
+        SetFileInformationByHandle( h2, FileDispositionInfo, &disp, sizeof(disp) );
+        SetLastError( ERROR_REQUEST_ABORTED );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
 /***********************************************************************
  *	CopyFileExW   (kernelbase.@)
  */
 BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUTINE progress,
                          void *param, BOOL *cancel_ptr, DWORD flags )
 {
-    static const int buffer_size = 65536;
+    static const int buffer_size = 1024 * 1024;
+    static const ULONGLONG chunk_size = 16 * 1024 * 1024;
+    struct copy_file_range_params params;
     HANDLE h1, h2;
     FILE_NETWORK_OPEN_INFORMATION info;
     FILE_BASIC_INFORMATION basic_info;
     IO_STATUS_BLOCK io;
+    NTSTATUS status;
     DWORD count;
     BOOL ret = FALSE;
-    char *buffer;
+    char *buffer = NULL;
     LARGE_INTEGER size;
     LARGE_INTEGER transferred;
-    DWORD cbret;
     DWORD source_access = GENERIC_READ;
 
     if (!source || !dest)
@@ -518,11 +553,6 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
         SetLastError( ERROR_INVALID_PARAMETER );
         return FALSE;
     }
-    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, buffer_size )))
-    {
-        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
-        return FALSE;
-    }
 
     TRACE("%s -> %s, %lx\n", debugstr_w(source), debugstr_w(dest), flags);
 
@@ -540,14 +570,12 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
                            NULL, OPEN_EXISTING, 0, 0 )) == INVALID_HANDLE_VALUE)
     {
         WARN("Unable to open source %s\n", debugstr_w(source));
-        HeapFree( GetProcessHeap(), 0, buffer );
         return FALSE;
     }
 
     if (!set_ntstatus( NtQueryInformationFile( h1, &io, &info, sizeof(info), FileNetworkOpenInformation )))
     {
         WARN("GetFileInformationByHandle returned error for %s\n", debugstr_w(source));
-        HeapFree( GetProcessHeap(), 0, buffer );
         CloseHandle( h1 );
         return FALSE;
     }
@@ -563,7 +591,6 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
         }
         if (same_file)
         {
-            HeapFree( GetProcessHeap(), 0, buffer );
             CloseHandle( h1 );
             SetLastError( ERROR_SHARING_VIOLATION );
             return FALSE;
@@ -579,7 +606,6 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
                            info.FileAttributes, h1 )) == INVALID_HANDLE_VALUE)
     {
         WARN("Unable to open dest %s\n", debugstr_w(dest));
-        HeapFree( GetProcessHeap(), 0, buffer );
         CloseHandle( h1 );
         return FALSE;
     }
@@ -587,24 +613,47 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
     size = info.EndOfFile;
     transferred.QuadPart = 0;
 
-    if (progress)
+    if (!copy_progress( &progress, param, cancel_ptr, size, transferred, CALLBACK_STREAM_SWITCH, h1, h2 ))
+        goto done;
+
+    /* Let ntdll copy the data without going through user space; this shares
+     * the data blocks on file systems that support reflinks. */
+    params.source = HandleToULong( h1 );
+    params.padding = 0;
+    params.length = chunk_size;
+    for (;;)
     {
-        cbret = progress( size, transferred, size, transferred, 1,
-                          CALLBACK_STREAM_SWITCH, h1, h2, param );
-        if (cbret == PROGRESS_QUIET)
-            progress = NULL;
-        else if (cbret == PROGRESS_STOP)
-        {
-            SetLastError( ERROR_REQUEST_ABORTED );
-            goto done;
-        }
-        else if (cbret == PROGRESS_CANCEL)
-        {
-            BOOLEAN disp = TRUE;
-            SetFileInformationByHandle( h2, FileDispositionInfo, &disp, sizeof(disp) );
-            SetLastError( ERROR_REQUEST_ABORTED );
+        params.source_offset = transferred;
+        params.target_offset = transferred;
+        status = NtFsControlFile( h2, NULL, NULL, NULL, &io, FSCTL_WINE_COPY_FILE_RANGE,
+                                  &params, sizeof(params), NULL, 0 );
+        if (status || !io.Information) break;
+
+        transferred.QuadPart += io.Information;
+        if (!copy_progress( &progress, param, cancel_ptr, size, transferred, CALLBACK_CHUNK_FINISHED, h1, h2 ))
             goto done;
-        }
+    }
+    if (!status)
+    {
+        ret = TRUE;
+        goto done;
+    }
+    if (status != STATUS_INVALID_DEVICE_REQUEST && status != STATUS_NOT_SAME_DEVICE &&
+        status != STATUS_NOT_SUPPORTED)
+    {
+        set_ntstatus( status );
+        goto done;
+    }
+
+    /* copy the rest of the file ourselves, the range copies don't move the file pointers */
+    if (!SetFilePointerEx( h1, transferred, NULL, FILE_BEGIN ) ||
+        !SetFilePointerEx( h2, transferred, NULL, FILE_BEGIN ))
+        goto done;
+
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, buffer_size )))
+    {
+        SetLastError( ERROR_NOT_ENOUGH_MEMORY );
+        goto done;
     }
 
     while (ReadFile( h1, buffer, buffer_size, &count, NULL ) && count)
@@ -617,26 +666,9 @@ BOOL WINAPI CopyFileExW( const WCHAR *source, const WCHAR *dest, LPPROGRESS_ROUT
             p += res;
             count -= res;
 
-            if (progress)
-            {
-                transferred.QuadPart += res;
-                cbret = progress( size, transferred, size, transferred, 1,
-                                  CALLBACK_CHUNK_FINISHED, h1, h2, param );
-                if (cbret == PROGRESS_QUIET)
-                    progress = NULL;
-                else if (cbret == PROGRESS_STOP)
-                {
-                    SetLastError( ERROR_REQUEST_ABORTED );
-                    goto done;
-                }
-                else if (cbret == PROGRESS_CANCEL)
-                {
-                    BOOLEAN disp = TRUE;
-                    SetFileInformationByHandle( h2, FileDispositionInfo, &disp, sizeof(disp) );
-                    SetLastError( ERROR_REQUEST_ABORTED );
-                    goto done;
-                }
-            }
+            transferred.QuadPart += res;
+            if (!copy_progress( &progress, param, cancel_ptr, size, transferred, CALLBACK_CHUNK_FINISHED, h1, h2 ))
+                goto done;
         }
     }
     ret =  TRUE;
@@ -3817,6 +3817,205 @@ static int get_sortkey( const struct sortguid *sortid, DWORD flags,
 }
 
 
+/* get the weights of a character that only has normal primary, diacritic and case weights */
+/* return FALSE if the character needs the full sort key algorithm */
+static BOOL get_simple_weights( const struct sortguid *sortid, DWORD flags, WCHAR ch,
+                                BYTE case_mask, UINT except, union char_weights *weights )
+{
+    *weights = get_char_weights( ch, except );
+    if (weights->_case & CASE_COMPR_6) return FALSE;
+    weights->_case &= case_mask;
+
+    switch (weights->script)
+    {
+    case SCRIPT_UNSORTABLE:
+        return TRUE;
+
+    case SCRIPT_NONSPACE_MARK:
+    case SCRIPT_EXPANSION:
+    case SCRIPT_EASTASIA_SPECIAL:
+    case SCRIPT_JAMO_SPECIAL:
+    case SCRIPT_EXTENSION_A:
+        return FALSE;
+
+    case SCRIPT_PUNCTUATION:
+        if (!(flags & (NORM_IGNORESYMBOLS | SORT_STRINGSORT))) return FALSE;
+        /* fall through */
+    case SCRIPT_SYMBOL_1:
+    case SCRIPT_SYMBOL_2:
+    case SCRIPT_SYMBOL_3:
+    case SCRIPT_SYMBOL_4:
+    case SCRIPT_SYMBOL_5:
+    case SCRIPT_SYMBOL_6:
+        if (flags & NORM_IGNORESYMBOLS) weights->script = SCRIPT_UNSORTABLE;
+        return TRUE;
+
+    case SCRIPT_DIGIT:
+        if (flags & SORT_DIGITSASNUMBERS) return FALSE;
+        /* fall through */
+    default:
+        if (weights->script >= SCRIPT_PUA_FIRST && weights->script <= SCRIPT_PUA_LAST) return FALSE;
+        if ((sortid->flags & FLAG_HAS_3_BYTE_WEIGHTS) &&
+            weights->script >= SCRIPT_CJK_FIRST && weights->script <= SCRIPT_CJK_LAST) return FALSE;
+        if (weights->script <= SCRIPT_ARABIC && weights->script != SCRIPT_HEBREW)
+        {
+            if (flags & LINGUISTIC_IGNOREDIACRITIC) weights->diacritic = 2;
+            if (flags & LINGUISTIC_IGNORECASE) weights->_case = 2;
+        }
+        return TRUE;
+    }
+}
+
+/* differences between the diacritic or case weights of two strings with identical primary weights */
+struct weight_diff
+{
+    int  first, last;          /* first and last position where the weights differ */
+    BYTE first_val[2];         /* weights at the first difference */
+    BYTE last_val[2];          /* weights at the last difference */
+    int  first_big[2];         /* first position of a weight above 2 */
+    int  last_big[2];          /* last position of a weight above 2 */
+};
+
+static void init_weight_diff( struct weight_diff *diff )
+{
+    diff->first = diff->last = -1;
+    diff->first_val[0] = diff->first_val[1] = 0;
+    diff->last_val[0] = diff->last_val[1] = 0;
+    diff->first_big[0] = diff->first_big[1] = -1;
+    diff->last_big[0] = diff->last_big[1] = -1;
+}
+
+static void update_weight_diff( struct weight_diff *diff, int pos, BYTE val1, BYTE val2 )
+{
+    if (val1 != val2)
+    {
+        if (diff->first == -1)
+        {
+            diff->first = pos;
+            diff->first_val[0] = val1;
+            diff->first_val[1] = val2;
+        }
+        diff->last = pos;
+        diff->last_val[0] = val1;
+        diff->last_val[1] = val2;
+    }
+    if (val1 > 2)
+    {
+        if (diff->first_big[0] == -1) diff->first_big[0] = pos;
+        diff->last_big[0] = pos;
+    }
+    if (val2 > 2)
+    {
+        if (diff->first_big[1] == -1) diff->first_big[1] = pos;
+        diff->last_big[1] = pos;
+    }
+}
+
+/* same result as remove_unneeded_weights() followed by compare_sortkeys() */
+static int compare_weight_diff( const struct weight_diff *diff, int count, BOOL reverse )
+{
+    int len1, len2;
+
+    if (diff->first == -1) return 0;
+
+    if (reverse)
+    {
+        int pos = count - 1 - diff->last;
+
+        len1 = diff->first_big[0] == -1 ? 0 : count - diff->first_big[0];
+        len2 = diff->first_big[1] == -1 ? 0 : count - diff->first_big[1];
+        if (pos < len1 && pos < len2) return diff->last_val[0] - diff->last_val[1];
+    }
+    else
+    {
+        len1 = diff->last_big[0] + 1;
+        len2 = diff->last_big[1] + 1;
+        if (diff->first < len1 && diff->first < len2) return diff->first_val[0] - diff->first_val[1];
+    }
+    return len1 - len2;
+}
+
+/* get the length of the common prefix of two strings */
+static int get_common_prefix( const WCHAR *str1, const WCHAR *str2, int len )
+{
+    int pos = 0;
+
+    /* compare 4 chars at a time when both strings can be aligned; aligned loads
+     * never cross a page boundary, so they can't fault past the first difference */
+    if (((UINT_PTR)str1 & 7) == ((UINT_PTR)str2 & 7))
+    {
+        while (pos < len && ((UINT_PTR)(str1 + pos) & 7) && str1[pos] == str2[pos]) pos++;
+        if (!((UINT_PTR)(str1 + pos) & 7))
+        {
+            while (pos + 4 <= len && *(const UINT64 *)(str1 + pos) == *(const UINT64 *)(str2 + pos))
+                pos += 4;
+        }
+    }
+    while (pos < len && str1[pos] == str2[pos]) pos++;
+    return pos;
+}
+
+/* single pass comparison of strings that only contain simple characters */
+/* return FALSE if compare_string() needs to use the full algorithm */
+static BOOL compare_simple_string( const struct sortguid *sortid, DWORD flags, BYTE case_mask, UINT except,
+                                   const WCHAR *src1, int srclen1, const WCHAR *src2, int srclen2, int *ret )
+{
+    struct weight_diff diacritic, case_diff;
+    union char_weights weights1, weights2;
+    int prefix, pos1, pos2, count = 0;
+
+    prefix = get_common_prefix( src1, src2, min( srclen1, srclen2 ));
+    if (prefix == srclen1 && prefix == srclen2)
+    {
+        *ret = 0;
+        return TRUE;
+    }
+
+    init_weight_diff( &diacritic );
+    init_weight_diff( &case_diff );
+
+    for (pos1 = 0; pos1 < prefix; pos1++)
+    {
+        if (!get_simple_weights( sortid, flags, src1[pos1], case_mask, except, &weights1 )) return FALSE;
+        if (weights1.script == SCRIPT_UNSORTABLE) continue;
+        update_weight_diff( &diacritic, count, weights1.diacritic, weights1.diacritic );
+        update_weight_diff( &case_diff, count, weights1._case, weights1._case );
+        count++;
+    }
+
+    for (pos2 = prefix;; count++)
+    {
+        weights1.script = weights2.script = SCRIPT_UNSORTABLE;
+        while (pos1 < srclen1)
+        {
+            if (!get_simple_weights( sortid, flags, src1[pos1++], case_mask, except, &weights1 )) return FALSE;
+            if (weights1.script != SCRIPT_UNSORTABLE) break;
+        }
+        while (pos2 < srclen2)
+        {
+            if (!get_simple_weights( sortid, flags, src2[pos2++], case_mask, except, &weights2 )) return FALSE;
+            if (weights2.script != SCRIPT_UNSORTABLE) break;
+        }
+
+        if (weights1.script == SCRIPT_UNSORTABLE || weights2.script == SCRIPT_UNSORTABLE)
+        {
+            *ret = (weights1.script != SCRIPT_UNSORTABLE) - (weights2.script != SCRIPT_UNSORTABLE);
+            if (*ret) return TRUE;
+            break;
+        }
+        if ((*ret = weights1.script - weights2.script)) return TRUE;
+        if ((*ret = weights1.primary - weights2.primary)) return TRUE;
+        update_weight_diff( &diacritic, count, weights1.diacritic, weights2.diacritic );
+        update_weight_diff( &case_diff, count, weights1._case, weights2._case );
+    }
+
+    *ret = 0;
+    if (!(flags & NORM_IGNORENONSPACE))
+        *ret = compare_weight_diff( &diacritic, count, sortid->flags & FLAG_REVERSEDIACRITICS );
+    if (!*ret) *ret = compare_weight_diff( &case_diff, count, FALSE );
+    return TRUE;
+}
+
 /* implementation of CompareStringEx */
 static int compare_string( const struct sortguid *sortid, DWORD flags,
                            const WCHAR *src1, int srclen1, const WCHAR *src2, int srclen2 )
@@ -3837,6 +4036,9 @@ static int compare_string( const struct sortguid *sortid, DWORD flags,
     if (flags & NORM_IGNOREKANATYPE) case_mask &= ~CASE_KATAKANA;
     if ((flags & NORM_LINGUISTIC_CASING) && except && sortid->ling_except) except = sortid->ling_except;
 
+    if (compare_simple_string( sortid, flags, case_mask, except, src1, srclen1, src2, srclen2, &ret ))
+        return ret;
+
     init_sortkey_state( &s1, flags, srclen1, primary1, sizeof(primary1) );
     init_sortkey_state( &s2, flags, srclen2, primary2, sizeof(primary2) );
 
@@ -3884,6 +4086,169 @@ done:
 }
 
 
+/* check whether the primary weights of the simple characters at the start of src can match the value */
+/* return FALSE if there can't be a match at this position */
+static BOOL match_simple_primary( const struct sortguid *sortid, DWORD flags, BYTE case_mask, UINT except,
+                                  const WCHAR *src, int srclen, const struct sortkey *val )
+{
+    union char_weights weights;
+    UINT pos;
+
+    for (pos = 0; pos + 1 < val->len && srclen; pos += 2, src++, srclen--)
+    {
+        if (!get_simple_weights( sortid, flags, *src, case_mask, except, &weights )) return TRUE;
+        if (weights.script == SCRIPT_UNSORTABLE) return TRUE;
+        if (weights.script != val->buf[pos] || weights.primary != val->buf[pos + 1]) return FALSE;
+    }
+    return TRUE;
+}
+
+/* check whether the source sortkey at start matches the value sortkey */
+/* return the end of the match, or -1 if there is none; the source state is reset */
+static int match_substring( const struct sortguid *sortid, DWORD flags, BYTE case_mask, UINT except,
+                            const WCHAR *compr_tables[8], const WCHAR *src, int srclen, int start,
+                            struct sortkey_state *s, struct sortkey_state *val, BOOL have_extra_val )
+{
+    int i, pos = start, ret = -1;
+    BOOL have_extra;
+
+    while (pos < srclen && s->primary_pos < val->key_primary.len)
+    {
+        while (pos < srclen && !s->key_primary.len)
+            pos += append_weights( sortid, flags, src, srclen, pos,
+                                   case_mask, except, compr_tables, s, TRUE );
+
+        if (s->primary_pos + s->key_primary.len > val->key_primary.len) goto done;
+        if (memcmp( s->key_primary.buf, val->key_primary.buf + s->primary_pos, s->key_primary.len )) goto done;
+        s->primary_pos += s->key_primary.len;
+        s->key_primary.len = 0;
+    }
+    if (s->primary_pos < val->key_primary.len) goto done;
+
+    have_extra = remove_unneeded_weights( sortid, s );
+    if (compare_sortkeys( &s->key_diacritic, &val->key_diacritic, FALSE )) goto done;
+    if (compare_sortkeys( &s->key_case, &val->key_case, FALSE )) goto done;
+
+    if (have_extra && have_extra_val)
+    {
+        for (i = 0; i < 4; i++)
+            if (compare_sortkeys( &s->key_extra[i], &val->key_extra[i], i != 1 )) goto done;
+    }
+    else if (have_extra || have_extra_val) goto done;
+
+    if (compare_sortkeys( &s->key_special, &val->key_special, FALSE )) goto done;
+    ret = pos;
+
+done:
+    s->key_primary.len = s->key_diacritic.len = s->key_case.len = s->key_special.len = 0;
+    s->key_extra[0].len = s->key_extra[1].len = s->key_extra[2].len = s->key_extra[3].len = 0;
+    s->primary_pos = 0;
+    return ret;
+}
+
+/* get the primary weights of the sortable characters of a string made only of simple characters */
+/* return the number of weights, or -1 if a character needs the full algorithm */
+static int get_simple_primary_weights( const struct sortguid *sortid, DWORD flags, BYTE case_mask, UINT except,
+                                       const WCHAR *str, int len, USHORT *primary, int *positions )
+{
+    union char_weights weights;
+    int i, count = 0;
+
+    for (i = 0; i < len; i++)
+    {
+        if (!get_simple_weights( sortid, flags, str[i], case_mask, except, &weights )) return -1;
+        if (weights.script == SCRIPT_UNSORTABLE) continue;
+        if (positions) positions[count] = i;
+        primary[count++] = (weights.script << 8) | weights.primary;
+    }
+    return count;
+}
+
+/* FindNLSStringEx for strings made only of simple characters */
+/* the primary weights are searched with the Knuth-Morris-Pratt algorithm, and only
+ * the positions where they match are checked with the full sortkeys */
+/* return FALSE if a character needs the full algorithm */
+static BOOL find_simple_substring( const struct sortguid *sortid, DWORD flags, BYTE case_mask, UINT except,
+                                   const WCHAR *compr_tables[8], const WCHAR *src, int srclen,
+                                   const WCHAR *value, int valuelen, struct sortkey_state *s,
+                                   struct sortkey_state *val, BOOL have_extra_val, int *found, int *foundlen )
+{
+    USHORT *primary, *pattern;
+    int *positions, *next, *matches;
+    int i, j, k, count, len, match_count = 0, start, end;
+    BOOL ret = FALSE;
+
+    primary = RtlAllocateHeap( GetProcessHeap(), 0, (srclen + valuelen) * sizeof(*primary) );
+    positions = RtlAllocateHeap( GetProcessHeap(), 0, (2 * srclen + valuelen) * sizeof(*positions) );
+    if (!primary || !positions) goto done;
+    pattern = primary + srclen;
+    next = positions + srclen;
+    matches = next + valuelen;
+
+    if ((len = get_simple_primary_weights( sortid, flags, case_mask, except, value, valuelen, pattern, NULL )) <= 0)
+        goto done;
+    if ((count = get_simple_primary_weights( sortid, flags, case_mask, except, src, srclen, primary, positions )) == -1)
+        goto done;
+    ret = TRUE;
+
+    next[0] = 0;
+    for (i = 1, j = 0; i < len; i++)
+    {
+        while (j && pattern[i] != pattern[j]) j = next[j - 1];
+        if (pattern[i] == pattern[j]) j++;
+        next[i] = j;
+    }
+    for (i = j = 0; i < count; i++)
+    {
+        while (j && primary[i] != pattern[j]) j = next[j - 1];
+        if (primary[i] == pattern[j]) j++;
+        if (j == len)
+        {
+            matches[match_count++] = i - len + 1;
+            j = next[j - 1];
+        }
+    }
+
+    /* unsortable characters have no weights at all, so a match can start at any of them
+     * before its first sortable character; pick the same start as checking all of them would */
+    if (flags & (FIND_FROMSTART | FIND_STARTSWITH))
+    {
+        for (i = 0; i < match_count; i++)
+        {
+            k = matches[i];
+            start = k ? positions[k - 1] + 1 : 0;
+            if ((flags & FIND_STARTSWITH) && start) break;
+            if ((end = match_substring( sortid, flags, case_mask, except, compr_tables,
+                                        src, srclen, start, s, val, have_extra_val )) != -1)
+            {
+                *found = start;
+                *foundlen = end - start;
+                break;
+            }
+            if (flags & FIND_STARTSWITH) break;
+        }
+    }
+    else
+    {
+        for (i = match_count - 1; i >= 0; i--)
+        {
+            start = positions[matches[i]];
+            if ((end = match_substring( sortid, flags, case_mask, except, compr_tables,
+                                        src, srclen, start, s, val, have_extra_val )) != -1)
+            {
+                *found = start;
+                *foundlen = end - start;
+                break;
+            }
+        }
+    }
+
+done:
+    RtlFreeHeap( GetProcessHeap(), 0, primary );
+    RtlFreeHeap( GetProcessHeap(), 0, positions );
+    return ret;
+}
+
 /* implementation of FindNLSStringEx */
 static int find_substring( const struct sortguid *sortid, DWORD flags, const WCHAR *src, int srclen,
                            const WCHAR *value, int valuelen, int *reslen )
@@ -3892,8 +4257,8 @@ static int find_substring( const struct sortguid *sortid, DWORD flags, const WCH
     struct sortkey_state val;
     BYTE primary[32];
     BYTE primary_val[256];
-    int i, start, found = -1, foundlen, pos = 0;
-    BOOL have_extra, have_extra_val;
+    int start, end, found = -1, foundlen, pos = 0;
+    BOOL have_extra_val;
     BYTE case_mask = 0x3f;
     UINT except = sortid->except;
     const WCHAR *compr_tables[8];
@@ -3913,47 +4278,26 @@ static int find_substring( const struct sortguid *sortid, DWORD flags, const WCH
                                case_mask, except, compr_tables, &val, TRUE );
     have_extra_val = remove_unneeded_weights( sortid, &val );
 
+    if (find_simple_substring( sortid, flags, case_mask, except, compr_tables, src, srclen,
+                               value, valuelen, &s, &val, have_extra_val, &found, &foundlen ))
+        goto done;
+
     for (start = 0; start < srclen; start++)
     {
-        pos = start;
-        while (pos < srclen && s.primary_pos < val.key_primary.len)
-        {
-            while (pos < srclen && !s.key_primary.len)
-                pos += append_weights( sortid, flags, src, srclen, pos,
-                                       case_mask, except, compr_tables, &s, TRUE );
-
-            if (s.primary_pos + s.key_primary.len > val.key_primary.len) goto next;
-            if (memcmp( primary, val.key_primary.buf + s.primary_pos, s.key_primary.len )) goto next;
-            s.primary_pos += s.key_primary.len;
-            s.key_primary.len = 0;
-        }
-        if (s.primary_pos < val.key_primary.len) goto next;
-
-        have_extra = remove_unneeded_weights( sortid, &s );
-        if (compare_sortkeys( &s.key_diacritic, &val.key_diacritic, FALSE )) goto next;
-        if (compare_sortkeys( &s.key_case, &val.key_case, FALSE )) goto next;
-
-        if (have_extra && have_extra_val)
+        /* most positions can be rejected without building the source sortkey */
+        if (match_simple_primary( sortid, flags, case_mask, except,
+                                  src + start, srclen - start, &val.key_primary ) &&
+            (end = match_substring( sortid, flags, case_mask, except, compr_tables,
+                                    src, srclen, start, &s, &val, have_extra_val )) != -1)
         {
-            for (i = 0; i < 4; i++)
-                if (compare_sortkeys( &s.key_extra[i], &val.key_extra[i], i != 1 )) goto next;
+            found = start;
+            foundlen = end - start;
+            if (flags & FIND_FROMSTART) break;
         }
-        else if (have_extra || have_extra_val) goto next;
-
-        if (compare_sortkeys( &s.key_special, &val.key_special, FALSE )) goto next;
-
-        found = start;
-        foundlen = pos - start;
-        if (flags & FIND_FROMSTART) break;
-
-    next:
         if (flags & FIND_STARTSWITH) break;
-        /* reset state */
-        s.key_primary.len = s.key_diacritic.len = s.key_case.len = s.key_special.len = 0;
-        s.key_extra[0].len = s.key_extra[1].len = s.key_extra[2].len = s.key_extra[3].len = 0;
-        s.primary_pos = 0;
     }
 
+done:
     if (found != -1)
     {
         if ((flags & FIND_ENDSWITH) && found + foundlen != srclen) found = -1;
@@ -21,6 +21,12 @@
 #include <stdarg.h>
 #include "windef.h"
 
+#include "wine/cpuid.h"
+
+#ifdef WINE_X86_CRYPTO_EXTENSIONS
+#define USE_SHA_NI
+#endif
+
 /* SHA1 algorithm
  *
  * Based on public domain SHA code by Steve Reid <steve@edmweb.com>
@@ -50,12 +56,72 @@ typedef struct {
 #define R3(v,w,x,y,z,i) z+=f3(w,x,y)+blk1(i)+0x8F1BBCDC+rol(v,5);w=rol(w,30);
 #define R4(v,w,x,y,z,i) z+=f4(w,x,y)+blk1(i)+0xCA62C1D6+rol(v,5);w=rol(w,30);
 
+#ifdef USE_SHA_NI
+
+/* Hash a single 512-bit block using the x86 SHA extensions. */
+static void __attribute__((target("sha,sse4.1,ssse3")))
+SHA1Transform_sha_ni(ULONG State[5], const UCHAR Buffer[64])
+{
+   const __m128i mask = _mm_set_epi64x(0x0001020304050607ull, 0x08090a0b0c0d0e0full);
+   __m128i abcd, abcd_save, e0_save, e[2], m[4];
+   int i;
+
+   abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)State), 0x1b);
+   e[0] = _mm_set_epi32(State[4], 0, 0, 0);
+   abcd_save = abcd;
+   e0_save = e[0];
+
+   /* 20 groups of 4 rounds, alternating between the two E registers */
+   for (i = 0; i < 20; i++)
+   {
+      if (i < 4)
+         m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)Buffer + i), mask);
+
+      if (!i)
+         e[0] = _mm_add_epi32(e[0], m[0]);
+      else
+         e[i & 1] = _mm_sha1nexte_epu32(e[i & 1], m[i % 4]);
+      e[(i + 1) & 1] = abcd;
+      if (i >= 3 && i < 19)
+         m[(i + 1) % 4] = _mm_sha1msg2_epu32(m[(i + 1) % 4], m[i % 4]);
+
+      switch (i / 5)
+      {
+      case 0: abcd = _mm_sha1rnds4_epu32(abcd, e[i & 1], 0); break;
+      case 1: abcd = _mm_sha1rnds4_epu32(abcd, e[i & 1], 1); break;
+      case 2: abcd = _mm_sha1rnds4_epu32(abcd, e[i & 1], 2); break;
+      default: abcd = _mm_sha1rnds4_epu32(abcd, e[i & 1], 3); break;
+      }
+
+      if (i >= 1 && i < 17)
+         m[(i + 3) % 4] = _mm_sha1msg1_epu32(m[(i + 3) % 4], m[i % 4]);
+      if (i >= 2 && i < 18)
+         m[(i + 2) % 4] = _mm_xor_si128(m[(i + 2) % 4], m[i % 4]);
+   }
+
+   e[0] = _mm_sha1nexte_epu32(e[0], e0_save);
+   abcd = _mm_add_epi32(abcd, abcd_save);
+
+   _mm_storeu_si128((__m128i *)State, _mm_shuffle_epi32(abcd, 0x1b));
+   State[4] = _mm_extract_epi32(e[0], 3);
+}
+
+#endif /* USE_SHA_NI */
+
 /* Hash a single 512-bit block. This is the core of the algorithm. */
 static void SHA1Transform(ULONG State[5], UCHAR Buffer[64])
 {
    ULONG a, b, c, d, e;
    ULONG *Block;
 
+#ifdef USE_SHA_NI
+   if (wine_x86_crypto_features() & WINE_X86_FEATURE_SHA_NI)
+   {
+      SHA1Transform_sha_ni(State, Buffer);
+      return;
+   }
+#endif
+
    Block = (ULONG*)Buffer;
 
    /* Copy Context->State[] to working variables */
@@ -3809,6 +3809,7 @@ void WINAPI RtlExitUserProcess( DWORD status )
     RtlAcquirePebLock();
     NtTerminateProcess( 0, status );
     LdrShutdownProcess();
+    dump_lock_stats();
     for (;;) NtTerminateProcess( GetCurrentProcess(), status );
 }
 
@@ -65,6 +65,7 @@ extern RUNTIME_FUNCTION *lookup_function_info( ULONG_PTR pc, ULONG_PTR *base, LD
 extern LPCSTR debugstr_us( const UNICODE_STRING *str ) DECLSPEC_HIDDEN;
 extern const char *debugstr_exception_code( DWORD code ) DECLSPEC_HIDDEN;
 extern void set_native_thread_name( DWORD tid, const char *name ) DECLSPEC_HIDDEN;
+extern void dump_lock_stats(void) DECLSPEC_HIDDEN;
 
 /* init routines */
 extern void version_init(void) DECLSPEC_HIDDEN;
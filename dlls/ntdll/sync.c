@@ -39,6 +39,7 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(sync);
 WINE_DECLARE_DEBUG_CHANNEL(relay);
+WINE_DECLARE_DEBUG_CHANNEL(lockprof);
 
 static const char *debugstr_timeout( const LARGE_INTEGER *timeout )
 {
@@ -162,6 +163,212 @@ static const char *crit_section_get_name( const RTL_CRITICAL_SECTION *crit )
     return "?";
 }
 
+/* Lock contention profiling, enabled with WINEDEBUG=+lockprof.
+ *
+ * Statistics are collected per critical section name (or address for unnamed
+ * sections), and per call site for SRW locks. They are reported at process exit. */
+
+enum lock_stats_type
+{
+    LOCK_STATS_CS,
+    LOCK_STATS_SRW_EXCLUSIVE,
+    LOCK_STATS_SRW_SHARED,
+};
+
+struct lock_stats
+{
+    const void *key;         /* critical section name or address, or SRW lock call site */
+    const char *name;        /* critical section name */
+    enum lock_stats_type type;
+    LONG        acquired;    /* number of acquisitions */
+    LONG        contended;   /* number of acquisitions that had to wait */
+    LONGLONG    wait_time;   /* total time spent waiting, in 100ns units */
+    LONGLONG    hold_time;   /* total time the lock was held (critical sections only) */
+};
+
+static struct lock_stats lock_stats[4096];
+static LONG lock_stats_overflow;
+
+/* acquisition time of the critical sections, keyed by address; an entry is
+ * only used by the owner of its section, and entries are never freed */
+struct crit_section_hold
+{
+    const RTL_CRITICAL_SECTION *crit;
+    LONGLONG                    start;
+};
+
+static struct crit_section_hold crit_section_holds[16384];
+
+#ifdef __GNUC__
+#define lock_call_site() __builtin_return_address(0)
+#else
+#define lock_call_site() NULL
+#endif
+
+static inline LONGLONG lock_stats_time(void)
+{
+    LARGE_INTEGER now;
+
+    NtQueryPerformanceCounter( &now, NULL );
+    return now.QuadPart;
+}
+
+static struct lock_stats *get_lock_stats( const void *key, enum lock_stats_type type )
+{
+    ULONG_PTR hash = (ULONG_PTR)key >> 2;
+    unsigned int i, pos;
+
+    hash = (hash ^ (hash >> 16)) * 0x9e3779b1;
+    for (i = 0; i < ARRAY_SIZE(lock_stats); i++)
+    {
+        struct lock_stats *stats;
+        const void *prev;
+
+        pos = ((hash >> 16) + i) % ARRAY_SIZE(lock_stats);
+        stats = &lock_stats[pos];
+        /* names, lock addresses and call sites can't overlap, so the key alone is unique */
+        if (stats->key == key) return stats;
+        if (stats->key) continue;
+        if ((prev = InterlockedCompareExchangePointer( (void **)&stats->key, (void *)key, NULL )))
+        {
+            if (prev == key) return stats;
+            continue;
+        }
+        stats->type = type;
+        return stats;
+    }
+    InterlockedIncrement( &lock_stats_overflow );
+    return NULL;
+}
+
+static struct crit_section_hold *get_crit_section_hold( const RTL_CRITICAL_SECTION *crit )
+{
+    ULONG_PTR hash = (ULONG_PTR)crit >> 2;
+    unsigned int i, pos;
+
+    hash = (hash ^ (hash >> 16)) * 0x9e3779b1;
+    for (i = 0; i < ARRAY_SIZE(crit_section_holds); i++)
+    {
+        struct crit_section_hold *hold;
+        const void *prev;
+
+        pos = ((hash >> 16) + i) % ARRAY_SIZE(crit_section_holds);
+        hold = &crit_section_holds[pos];
+        if (hold->crit == crit) return hold;
+        if (hold->crit) continue;
+        if (!(prev = InterlockedCompareExchangePointer( (void **)&hold->crit, (void *)crit, NULL )) || prev == crit)
+            return hold;
+    }
+    return NULL;
+}
+
+static struct lock_stats *get_crit_section_stats( const RTL_CRITICAL_SECTION *crit )
+{
+    struct lock_stats *stats;
+    const char *name = NULL;
+
+    if (crit->DebugInfo->Spare[0]) name = (const char *)crit->DebugInfo->Spare[0];
+    if (!(stats = get_lock_stats( name ? (const void *)name : crit, LOCK_STATS_CS ))) return NULL;
+    stats->name = name;
+    return stats;
+}
+
+static void crit_section_acquired( RTL_CRITICAL_SECTION *crit )
+{
+    struct lock_stats *stats;
+    struct crit_section_hold *hold;
+
+    if (!crit_section_has_debuginfo( crit )) return;
+    if (!(stats = get_crit_section_stats( crit ))) return;
+    InterlockedIncrement( &stats->acquired );
+    if ((hold = get_crit_section_hold( crit ))) hold->start = lock_stats_time();
+}
+
+static void crit_section_released( RTL_CRITICAL_SECTION *crit )
+{
+    struct crit_section_hold *hold;
+    struct lock_stats *stats;
+    LONGLONG start;
+
+    if (!crit_section_has_debuginfo( crit )) return;
+    if (!(hold = get_crit_section_hold( crit ))) return;
+    if (!(start = hold->start)) return;  /* acquired before profiling started */
+    hold->start = 0;
+    if (!(stats = get_crit_section_stats( crit ))) return;
+    InterlockedExchangeAdd64( &stats->hold_time, lock_stats_time() - start );
+}
+
+static void crit_section_waited( RTL_CRITICAL_SECTION *crit, LONGLONG start )
+{
+    struct lock_stats *stats;
+
+    if (!crit_section_has_debuginfo( crit )) return;
+    if (!(stats = get_crit_section_stats( crit ))) return;
+    InterlockedIncrement( &stats->contended );
+    InterlockedExchangeAdd64( &stats->wait_time, lock_stats_time() - start );
+}
+
+static void srw_lock_acquired( const void *call_site, enum lock_stats_type type, LONGLONG wait_start )
+{
+    struct lock_stats *stats;
+
+    if (!(stats = get_lock_stats( call_site, type ))) return;
+    InterlockedIncrement( &stats->acquired );
+    if (!wait_start) return;
+    InterlockedIncrement( &stats->contended );
+    InterlockedExchangeAdd64( &stats->wait_time, lock_stats_time() - wait_start );
+}
+
+static int __cdecl compare_lock_stats( const void *a, const void *b )
+{
+    const struct lock_stats *stats_a = a, *stats_b = b;
+
+    if (stats_a->wait_time != stats_b->wait_time) return stats_a->wait_time < stats_b->wait_time ? 1 : -1;
+    if (stats_a->contended != stats_b->contended) return stats_a->contended < stats_b->contended ? 1 : -1;
+    return stats_b->acquired - stats_a->acquired;
+}
+
+static const char *debugstr_lock_stats( const struct lock_stats *stats )
+{
+    static const char *types[] = { "cs", "srw-exclusive", "srw-shared" };
+    LDR_DATA_TABLE_ENTRY *mod;
+
+    if (stats->type == LOCK_STATS_CS)
+    {
+        if (stats->name) return wine_dbg_sprintf( "cs %s", debugstr_a(stats->name) );
+        return wine_dbg_sprintf( "cs %p", stats->key );
+    }
+    if (!LdrFindEntryForAddress( stats->key, &mod ))
+        return wine_dbg_sprintf( "%s %s+%#Ix", types[stats->type], debugstr_w(mod->BaseDllName.Buffer),
+                                 (char *)stats->key - (char *)mod->DllBase );
+    return wine_dbg_sprintf( "%s %p", types[stats->type], stats->key );
+}
+
+/***********************************************************************
+ *           dump_lock_stats
+ *
+ * Report the lock contention statistics, sorted by wait time.
+ */
+void dump_lock_stats(void)
+{
+    unsigned int i, count = 0;
+
+    if (!TRACE_ON(lockprof)) return;
+
+    for (i = 0; i < ARRAY_SIZE(lock_stats); i++)
+        if (lock_stats[i].key) lock_stats[count++] = lock_stats[i];
+    qsort( lock_stats, count, sizeof(*lock_stats), compare_lock_stats );
+
+    TRACE_(lockprof)( "%u locks, times in ms\n", count );
+    TRACE_(lockprof)( "%10s %10s %12s %12s  %s\n", "acquired", "contended", "wait", "hold", "lock" );
+    for (i = 0; i < count; i++)
+        TRACE_(lockprof)( "%10ld %10ld %12s %12s  %s\n", lock_stats[i].acquired, lock_stats[i].contended,
+                          wine_dbg_sprintf( "%I64d.%04I64d", lock_stats[i].wait_time / 10000, lock_stats[i].wait_time % 10000 ),
+                          wine_dbg_sprintf( "%I64d.%04I64d", lock_stats[i].hold_time / 10000, lock_stats[i].hold_time % 10000 ),
+                          debugstr_lock_stats( &lock_stats[i] ));
+    if (lock_stats_overflow) TRACE_(lockprof)( "%ld acquisitions not recorded, table full\n", lock_stats_overflow );
+}
+
 static inline HANDLE get_semaphore( RTL_CRITICAL_SECTION *crit )
 {
     HANDLE ret = crit->LockSemaphore;
@@ -301,6 +508,7 @@ NTSTATUS WINAPI RtlDeleteCriticalSection( RTL_CRITICAL_SECTION *crit )
 NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
     LONGLONG timeout = NtCurrentTeb()->Peb->CriticalSectionTimeout.QuadPart / -10000000;
+    LONGLONG wait_start = TRACE_ON(lockprof) ? lock_stats_time() : 0;
 
     /* Don't allow blocking on a critical section during process termination */
     if (RtlDllShutdownInProgress())
@@ -350,6 +558,7 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
         RtlRaiseException( &rec );
     }
     if (crit_section_has_debuginfo( crit )) crit->DebugInfo->ContentionCount++;
+    if (wait_start) crit_section_waited( crit, wait_start );
     return STATUS_SUCCESS;
 }
 
@@ -414,6 +623,7 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 done:
     crit->OwningThread   = ULongToHandle(GetCurrentThreadId());
     crit->RecursionCount = 1;
+    if (TRACE_ON(lockprof)) crit_section_acquired( crit );
     return STATUS_SUCCESS;
 }
 
@@ -428,6 +638,7 @@ BOOL WINAPI RtlTryEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
     {
         crit->OwningThread   = ULongToHandle(GetCurrentThreadId());
         crit->RecursionCount = 1;
+        if (TRACE_ON(lockprof)) crit_section_acquired( crit );
         ret = TRUE;
     }
     else if (crit->OwningThread == ULongToHandle(GetCurrentThreadId()))
@@ -471,6 +682,7 @@ NTSTATUS WINAPI RtlLeaveCriticalSection( RTL_CRITICAL_SECTION *crit )
     }
     else
     {
+        if (TRACE_ON(lockprof)) crit_section_released( crit );
         crit->OwningThread = 0;
         if (InterlockedDecrement( &crit->LockCount ) >= 0)
         {
@@ -545,6 +757,7 @@ void WINAPI RtlInitializeSRWLock( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 {
     union { RTL_SRWLOCK *rtl; struct srw_lock *s; LONG *l; } u = { lock };
+    LONGLONG wait_start = 0;
 
     InterlockedIncrement16( &u.s->exclusive_waiters );
 
@@ -571,9 +784,11 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
             }
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
-        if (!wait) return;
+        if (!wait) break;
+        if (TRACE_ON(lockprof) && !wait_start) wait_start = lock_stats_time();
         RtlWaitOnAddress( &u.s->owners, &new.s.owners, sizeof(short), NULL );
     }
+    if (TRACE_ON(lockprof)) srw_lock_acquired( lock_call_site(), LOCK_STATS_SRW_EXCLUSIVE, wait_start );
 }
 
 /***********************************************************************
@@ -586,6 +801,7 @@ void WINAPI RtlAcquireSRWLockExclusive( RTL_SRWLOCK *lock )
 void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
 {
     union { RTL_SRWLOCK *rtl; struct srw_lock *s; LONG *l; } u = { lock };
+    LONGLONG wait_start = 0;
 
     for (;;)
     {
@@ -610,9 +826,11 @@ void WINAPI RtlAcquireSRWLockShared( RTL_SRWLOCK *lock )
             }
         } while (InterlockedCompareExchange( u.l, new.l, old.l ) != old.l);
 
-        if (!wait) return;
+        if (!wait) break;
+        if (TRACE_ON(lockprof) && !wait_start) wait_start = lock_stats_time();
         RtlWaitOnAddress( u.s, &new.s, sizeof(struct srw_lock), NULL );
     }
+    if (TRACE_ON(lockprof)) srw_lock_acquired( lock_call_site(), LOCK_STATS_SRW_SHARED, wait_start );
 }
 
 /***********************************************************************
@@ -863,24 +1081,45 @@ struct futex_queue
     LONG lock;
 };
 
-static struct futex_queue futex_queues[256];
+static struct futex_queue futex_queues[1024];
 
 static struct futex_queue *get_futex_queue( const void *addr )
 {
-    ULONG_PTR val = (ULONG_PTR)addr;
+    ULONG_PTR val = (ULONG_PTR)addr >> 2;
 
-    return &futex_queues[(val >> 4) % ARRAY_SIZE(futex_queues)];
+    /* Fibonacci hashing, so that addresses at a common stride (e.g. one per
+     * page in per-thread structures) don't all end up in the same queue. */
+    val = (val ^ (val >> 16)) * 0x9e3779b1;
+    return &futex_queues[(val >> 16) % ARRAY_SIZE(futex_queues)];
 }
 
+/* The queue locks are 0 when free, 1 when held, and 2 when held with threads
+ * blocked on them. Spin for a short while, as they are only held for a few
+ * list operations, then block in a futex wait if the owner is taking long,
+ * as it may have been preempted. */
 static void spin_lock( LONG *lock )
 {
-    while (InterlockedCompareExchange( lock, -1, 0 ))
+    unsigned int spins = 0;
+    LONG val;
+
+    if (!(val = InterlockedCompareExchange( lock, 1, 0 ))) return;
+
+    while (val != 2 && spins++ < 100)
+    {
         YieldProcessor();
+        if (!(val = ReadNoFence( lock )) && !(val = InterlockedCompareExchange( lock, 1, 0 ))) return;
+    }
+
+    /* we can't know whether other threads are still blocked, so keep it marked as contended */
+    while (InterlockedExchange( lock, 2 ))
+    {
+        if (NTDLL_UNIX_CALL( spin_lock_wait, lock )) NtYieldExecution();
+    }
 }
 
 static void spin_unlock( LONG *lock )
 {
-    InterlockedExchange( lock, 0 );
+    if (InterlockedExchange( lock, 0 ) == 2) NTDLL_UNIX_CALL( spin_lock_wake, lock );
 }
 
 static BOOL compare_addr( const void *addr, const void *cmp, SIZE_T size )
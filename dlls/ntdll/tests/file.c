@@ -5352,6 +5352,58 @@ static void test_flush_buffers_file(void)
     DeleteFileA(buffer);
 }
 
+static void test_duplicate_extents(void)
+{
+    char path[MAX_PATH], source_name[MAX_PATH], target_name[MAX_PATH];
+    DUPLICATE_EXTENTS_DATA data;
+    HANDLE source, target;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    char *buffer;
+    DWORD size, i;
+    BOOL ret;
+
+    buffer = malloc(65536);
+    for (i = 0; i < 65536; i++) buffer[i] = i * 7;
+
+    GetTempPathA(MAX_PATH, path);
+    GetTempFileNameA(path, "foo", 0, source_name);
+    GetTempFileNameA(path, "foo", 0, target_name);
+    source = CreateFileA(source_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+    ok(source != INVALID_HANDLE_VALUE, "failed to create file, error %lu\n", GetLastError());
+    target = CreateFileA(target_name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0);
+    ok(target != INVALID_HANDLE_VALUE, "failed to create file, error %lu\n", GetLastError());
+
+    ret = WriteFile(source, buffer, 65536, &size, NULL);
+    ok(ret && size == 65536, "WriteFile failed, error %lu\n", GetLastError());
+    SetFilePointer(target, 65536, NULL, FILE_BEGIN);
+    ret = SetEndOfFile(target);
+    ok(ret, "SetEndOfFile failed, error %lu\n", GetLastError());
+
+    memset(&data, 0, sizeof(data));
+    data.FileHandle = source;
+    data.ByteCount.QuadPart = 65536;
+    status = pNtFsControlFile(target, NULL, NULL, NULL, &io, FSCTL_DUPLICATE_EXTENTS_TO_FILE,
+                              &data, sizeof(data), NULL, 0);
+    ok(status == STATUS_SUCCESS || status == STATUS_INVALID_DEVICE_REQUEST /* NTFS */,
+       "got %#lx\n", status);
+    if (!status)
+    {
+        memset(buffer, 0, 65536);
+        SetFilePointer(target, 0, NULL, FILE_BEGIN);
+        ret = ReadFile(target, buffer, 65536, &size, NULL);
+        ok(ret && size == 65536, "ReadFile failed, error %lu\n", GetLastError());
+        for (i = 0; i < 65536; i++) if (buffer[i] != (char)(i * 7)) break;
+        ok(i == 65536, "data differs at %lu\n", i);
+    }
+
+    CloseHandle(source);
+    CloseHandle(target);
+    DeleteFileA(source_name);
+    DeleteFileA(target_name);
+    free(buffer);
+}
+
 static void test_query_ea(void)
 {
 #define EA_BUFFER_SIZE 4097
@@ -6192,6 +6244,7 @@ START_TEST(file)
     test_ioctl();
     test_query_ea();
     test_flush_buffers_file();
+    test_duplicate_extents();
     test_reparse_points();
     test_mailslot_name();
 }
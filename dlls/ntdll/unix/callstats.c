@@ -0,0 +1,299 @@
+/*
+ * Syscall, unix call and server request statistics
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#if 0
+#pragma makedep unix
+#endif
+
+#include "config.h"
+
+#include <dlfcn.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ntstatus.h"
+#define WIN32_NO_STATUS
+#include "windef.h"
+#include "winternl.h"
+#include "unix_private.h"
+#include "wine/server.h"
+#include "wine/debug.h"
+
+WINE_DEFAULT_DEBUG_CHANNEL(server);
+
+/* Statistics are enabled by setting WINE_CALL_STATS to a directory. Each
+ * process writes a <pid>.callstats file there when it exits, with one line per
+ * call: type, name, count, total and maximum time in nanoseconds.
+ * tools/callstats merges and sorts these files.
+ * Only the native syscall tables are instrumented; in wow64 processes the time
+ * spent in the 32-bit thunks of dlls/wow64/syscall.c is not measured separately,
+ * it is included in the time of the 64-bit syscalls they make. */
+
+struct call_stats
+{
+    LONG64 count;
+    LONG64 total;
+    LONG64 max;
+};
+
+struct unix_call_stats
+{
+    const unixlib_entry_t *entry;  /* address of the function in its library table */
+    struct call_stats      stats;
+};
+
+BOOL call_stats_enabled = FALSE;
+static char *call_stats_dir;
+
+static SYSTEM_SERVICE_TABLE orig_syscall_tables[4];
+static struct call_stats *syscall_stats[4];
+static struct call_stats server_call_stats[REQ_NB_REQUESTS];
+static struct unix_call_stats unix_call_stats[4096];
+
+static inline LONG64 call_stats_time(void)
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return ts.tv_sec * (LONG64)1000000000 + ts.tv_nsec;
+}
+
+static void add_call_stats( struct call_stats *stats, LONG64 start )
+{
+    LONG64 max, time = call_stats_time() - start;
+
+    InterlockedIncrement64( &stats->count );
+    InterlockedExchangeAdd64( &stats->total, time );
+    while (time > (max = stats->max))
+        if (InterlockedCompareExchange64( &stats->max, time, max ) == max) break;
+}
+
+
+#ifdef __x86_64__
+
+#define MAX_SYSCALL_ARGS 17
+
+typedef NTSTATUS (WINAPI *syscall_func)( ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR,
+                                         ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR,
+                                         ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR, ULONG_PTR );
+
+/***********************************************************************
+ *           call_stats_syscall
+ *
+ * Wrapper for all the syscalls, the syscall number is retrieved from the syscall frame.
+ * The dispatcher copies the arguments of the actual syscall, the remaining ones are ignored.
+ */
+static NTSTATUS WINAPI call_stats_syscall( ULONG_PTR a1, ULONG_PTR a2, ULONG_PTR a3, ULONG_PTR a4,
+                                           ULONG_PTR a5, ULONG_PTR a6, ULONG_PTR a7, ULONG_PTR a8,
+                                           ULONG_PTR a9, ULONG_PTR a10, ULONG_PTR a11, ULONG_PTR a12,
+                                           ULONG_PTR a13, ULONG_PTR a14, ULONG_PTR a15, ULONG_PTR a16,
+                                           ULONG_PTR a17 )
+{
+    unsigned int id = get_syscall_id();
+    unsigned int table = (id >> 12) & 3, index = id & 0xfff;
+    syscall_func func = (syscall_func)orig_syscall_tables[table].ServiceTable[index];
+    LONG64 start = call_stats_time();
+    NTSTATUS status;
+
+    status = func( a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17 );
+    add_call_stats( &syscall_stats[table][index], start );
+    return status;
+}
+
+/***********************************************************************
+ *           call_stats_init_syscalls
+ *
+ * Replace the functions of a syscall table by the statistics wrapper.
+ */
+void call_stats_init_syscalls( ULONG id )
+{
+    SYSTEM_SERVICE_TABLE *table = &KeServiceDescriptorTable[id];
+    ULONG_PTR *funcs;
+    ULONG i;
+
+    if (!call_stats_enabled) return;
+    if (!(funcs = malloc( table->ServiceLimit * sizeof(*funcs) ))) return;
+    if (!(syscall_stats[id] = calloc( table->ServiceLimit, sizeof(*syscall_stats[id]) )))
+    {
+        free( funcs );
+        return;
+    }
+    for (i = 0; i < table->ServiceLimit; i++)
+    {
+        if (table->ArgumentTable[i] > MAX_SYSCALL_ARGS * sizeof(ULONG_PTR)) funcs[i] = table->ServiceTable[i];
+        else funcs[i] = (ULONG_PTR)call_stats_syscall;
+    }
+    orig_syscall_tables[id] = *table;
+    table->ServiceTable = funcs;
+}
+
+#else  /* __x86_64__ */
+
+void call_stats_init_syscalls( ULONG id )
+{
+}
+
+#endif  /* __x86_64__ */
+
+
+/***********************************************************************
+ *           call_stats_unix_call
+ *
+ * Called by the unix call dispatcher instead of the function when statistics are enabled.
+ */
+NTSTATUS call_stats_unix_call( void *args, unsigned int code, const unixlib_entry_t *funcs )
+{
+    const unixlib_entry_t *entry = &funcs[code];
+    LONG64 start = call_stats_time();
+    unsigned int i, pos;
+    NTSTATUS status;
+
+    status = (*entry)( args );
+
+    for (i = 0; i < ARRAY_SIZE(unix_call_stats); i++)
+    {
+        struct unix_call_stats *stats;
+        const void *prev;
+
+        pos = ((((ULONG_PTR)entry >> 3) * 0x9e3779b1) + i) % ARRAY_SIZE(unix_call_stats);
+        stats = &unix_call_stats[pos];
+        if (stats->entry != entry)
+        {
+            if (stats->entry) continue;
+            prev = InterlockedCompareExchangePointer( (void **)&stats->entry, (void *)entry, NULL );
+            if (prev && prev != entry) continue;
+        }
+        add_call_stats( &stats->stats, start );
+        break;
+    }
+    return status;
+}
+
+
+/***********************************************************************
+ *           call_stats_server_start
+ */
+LONG64 call_stats_server_start(void)
+{
+    return call_stats_time();
+}
+
+
+/***********************************************************************
+ *           call_stats_server_end
+ */
+void call_stats_server_end( enum request req, LONG64 start )
+{
+    if (req < REQ_NB_REQUESTS) add_call_stats( &server_call_stats[req], start );
+}
+
+
+static void dump_call_stats( FILE *file, const char *type, const char *name, const struct call_stats *stats )
+{
+    if (!stats->count) return;
+    fprintf( file, "%s\t%s\t%s", type, name, wine_dbgstr_longlong( stats->count ));
+    fprintf( file, "\t%s", wine_dbgstr_longlong( stats->total ));
+    fprintf( file, "\t%s\n", wine_dbgstr_longlong( stats->max ));
+}
+
+static const char *get_func_name( const void *func, char *buffer, size_t size )
+{
+    Dl_info info;
+
+    if (dladdr( func, &info ) && info.dli_sname && info.dli_saddr == func) return info.dli_sname;
+    snprintf( buffer, size, "%p", func );
+    return buffer;
+}
+
+/***********************************************************************
+ *           call_stats_write
+ *
+ * Write the statistics file of the process at exit. Also called when the
+ * process is terminated without running the atexit handlers.
+ */
+void call_stats_write(void)
+{
+    static LONG written;
+    char name[256], buffer[64], *path;
+    unsigned int i, j;
+    FILE *file;
+
+    if (!call_stats_enabled || InterlockedExchange( &written, 1 )) return;
+    if (asprintf( &path, "%s/%u.callstats", call_stats_dir, (int)getpid() ) == -1) return;
+    if (!(file = fopen( path, "w" )))
+    {
+        ERR( "failed to create %s\n", debugstr_a(path) );
+        free( path );
+        return;
+    }
+
+    for (i = 0; i < ARRAY_SIZE(syscall_stats); i++)
+    {
+        if (!syscall_stats[i]) continue;
+        for (j = 0; j < orig_syscall_tables[i].ServiceLimit; j++)
+        {
+            const char *func = get_func_name( (void *)orig_syscall_tables[i].ServiceTable[j], buffer, sizeof(buffer) );
+            dump_call_stats( file, "syscall", func, &syscall_stats[i][j] );
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(unix_call_stats); i++)
+    {
+        const unixlib_entry_t *entry = unix_call_stats[i].entry;
+        const char *lib = "?";
+        unsigned int code = 0;
+        Dl_info info;
+
+        if (!entry) continue;
+        /* the entry is in the __wine_unix_call_funcs table of its library */
+        if (dladdr( entry, &info ) && info.dli_saddr)
+        {
+            if (info.dli_fname) lib = strrchr( info.dli_fname, '/' ) ? strrchr( info.dli_fname, '/' ) + 1 : info.dli_fname;
+            code = (entry - (const unixlib_entry_t *)info.dli_saddr);
+        }
+        snprintf( name, sizeof(name), "%s:%u:%s", lib, code, get_func_name( *entry, buffer, sizeof(buffer) ));
+        dump_call_stats( file, "unixcall", name, &unix_call_stats[i].stats );
+    }
+
+    for (i = 0; i < ARRAY_SIZE(server_call_stats); i++)
+    {
+        snprintf( name, sizeof(name), "%u", i );
+        dump_call_stats( file, "server", name, &server_call_stats[i] );
+    }
+
+    fclose( file );
+    free( path );
+}
+
+
+/***********************************************************************
+ *           call_stats_init
+ */
+void call_stats_init(void)
+{
+    const char *dir = getenv( "WINE_CALL_STATS" );
+
+    if (!dir || !*dir) return;
+    if (!(call_stats_dir = strdup( dir ))) return;
+    call_stats_enabled = TRUE;
+    atexit( call_stats_write );
+}
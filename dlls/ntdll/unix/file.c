@@ -86,6 +86,9 @@
 #ifdef HAVE_LINUX_IOCTL_H
 #include <linux/ioctl.h>
 #endif
+#ifdef HAVE_LINUX_FS_H
+# include <linux/fs.h>
+#endif
 #ifdef HAVE_LINUX_MAJOR_H
 # include <linux/major.h>
 #endif
@@ -126,6 +129,7 @@
 #include "wine/server.h"
 #include "wine/list.h"
 #include "wine/debug.h"
+#include "wine/fsctl.h"
 #include "unix_private.h"
 #include "ntifs.h"
 
@@ -7288,6 +7292,190 @@ static void ignore_server_ioctl_struct_holes( ULONG code, const void *in_buffer,
 }
 
 
+static NTSTATUS get_copy_fds( HANDLE target, HANDLE source, int *target_fd, int *target_needs_close,
+                              int *source_fd, int *source_needs_close )
+{
+    enum server_fd_type type;
+    NTSTATUS status;
+
+    if ((status = server_get_unix_fd( target, FILE_WRITE_DATA, target_fd, target_needs_close, &type, NULL )))
+        return status;
+    if (type != FD_TYPE_FILE)
+    {
+        status = STATUS_INVALID_DEVICE_REQUEST;
+        goto error;
+    }
+    if ((status = server_get_unix_fd( source, FILE_READ_DATA, source_fd, source_needs_close, &type, NULL )))
+        goto error;
+    if (type != FD_TYPE_FILE)
+    {
+        if (*source_needs_close) close( *source_fd );
+        status = STATUS_INVALID_DEVICE_REQUEST;
+        goto error;
+    }
+    return STATUS_SUCCESS;
+
+error:
+    if (*target_needs_close) close( *target_fd );
+    return status;
+}
+
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONERANGE)
+static NTSTATUS clone_errno_to_status( int err )
+{
+    switch (err)
+    {
+    case EOPNOTSUPP:
+    case ENOTTY:
+    case ENOSYS: return STATUS_INVALID_DEVICE_REQUEST;
+    case EXDEV:  return STATUS_NOT_SAME_DEVICE;
+    case EINVAL: return STATUS_INVALID_PARAMETER;
+    default:     return errno_to_status( err );
+    }
+}
+#endif
+
+/* FSCTL_DUPLICATE_EXTENTS_TO_FILE; only supported on file systems with reflinks */
+static NTSTATUS duplicate_extents( HANDLE handle, const void *in_buffer, ULONG in_size )
+{
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONERANGE)
+    const DUPLICATE_EXTENTS_DATA *data = in_buffer;
+    int fd, source_fd, needs_close, source_needs_close;
+    struct file_clone_range range;
+    HANDLE source;
+    NTSTATUS status;
+
+    if (in_size < sizeof(*data)) return STATUS_INVALID_PARAMETER;
+    if (data->SourceFileOffset.QuadPart < 0 || data->TargetFileOffset.QuadPart < 0 ||
+        data->ByteCount.QuadPart < 0)
+        return STATUS_INVALID_PARAMETER;
+    /* a length of 0 would clone up to the end of the file */
+    if (!data->ByteCount.QuadPart) return STATUS_SUCCESS;
+
+    source = in_wow64_call() ? ULongToHandle( *(const ULONG *)in_buffer ) : data->FileHandle;
+    if ((status = get_copy_fds( handle, source, &fd, &needs_close, &source_fd, &source_needs_close )))
+        return status;
+
+    range.src_fd = source_fd;
+    range.src_offset = data->SourceFileOffset.QuadPart;
+    range.src_length = data->ByteCount.QuadPart;
+    range.dest_offset = data->TargetFileOffset.QuadPart;
+    if (ioctl( fd, FICLONERANGE, &range ) == -1)
+    {
+        TRACE( "FICLONERANGE failed: %s\n", strerror( errno ) );
+        status = clone_errno_to_status( errno );
+    }
+
+    if (needs_close) close( fd );
+    if (source_needs_close) close( source_fd );
+    return status;
+#else
+    return STATUS_INVALID_DEVICE_REQUEST;
+#endif
+}
+
+/* FSCTL_WINE_COPY_FILE_RANGE; reflinks the data if possible, and copies it
+ * inside the kernel or through a bounce buffer otherwise */
+static NTSTATUS copy_file_data( HANDLE handle, const struct copy_file_range_params *params, ULONG_PTR *copied )
+{
+    int fd, source_fd, needs_close, source_needs_close;
+    off_t source_offset, target_offset;
+    size_t length, buffer_size;
+    NTSTATUS status;
+    struct stat st;
+    ssize_t ret = 0;
+    char *buffer;
+
+    *copied = 0;
+    if (params->source_offset.QuadPart < 0 || params->target_offset.QuadPart < 0)
+        return STATUS_INVALID_PARAMETER;
+
+    if ((status = get_copy_fds( handle, ULongToHandle( params->source ), &fd, &needs_close,
+                                &source_fd, &source_needs_close )))
+        return status;
+
+    if (fstat( source_fd, &st ) == -1)
+    {
+        status = errno_to_status( errno );
+        goto done;
+    }
+    source_offset = params->source_offset.QuadPart;
+    target_offset = params->target_offset.QuadPart;
+    if (source_offset >= st.st_size) goto done;
+    /* the amount copied has to fit in the I/O status block */
+    length = min( min( params->length, st.st_size - source_offset ), 0x40000000 );
+
+#if defined(HAVE_LINUX_FS_H) && defined(FICLONERANGE)
+    {
+        struct file_clone_range range;
+
+        range.src_fd = source_fd;
+        range.src_offset = source_offset;
+        range.src_length = length;
+        range.dest_offset = target_offset;
+        if (!ioctl( fd, FICLONERANGE, &range ))
+        {
+            TRACE( "cloned %#zx bytes\n", length );
+            *copied = length;
+            goto done;
+        }
+    }
+#endif
+
+#ifdef HAVE_COPY_FILE_RANGE
+    while (*copied < length)
+    {
+        ret = copy_file_range( source_fd, &source_offset, fd, &target_offset, length - *copied, 0 );
+        if (ret == -1 && errno == EINTR) continue;
+        if (ret <= 0) break;
+        *copied += ret;
+    }
+    /* errors meaning that the kernel can't copy between these files, possibly only
+     * for part of the range, are handled by copying the rest through a buffer */
+    if (*copied == length || (ret == -1 && errno != EXDEV && errno != EINVAL &&
+                              errno != ENOSYS && errno != EOPNOTSUPP))
+    {
+        TRACE( "copied %#lx bytes in the kernel\n", (unsigned long)*copied );
+        if (!*copied && ret == -1) status = errno_to_status( errno );
+        goto done;
+    }
+#endif
+
+    buffer_size = min( length - *copied, 1024 * 1024 );
+    if (!(buffer = malloc( buffer_size )))
+    {
+        status = STATUS_NO_MEMORY;
+        goto done;
+    }
+    while (*copied < length)
+    {
+        size_t size = min( length - *copied, buffer_size ), written = 0;
+
+        while ((ret = pread( source_fd, buffer, size, source_offset )) == -1 && errno == EINTR);
+        if (ret <= 0) break;
+        size = ret;
+        while (written < size)
+        {
+            while ((ret = pwrite( fd, buffer + written, size - written, target_offset + written )) == -1 &&
+                   errno == EINTR);
+            if (ret <= 0) break;
+            written += ret;
+        }
+        *copied += written;
+        source_offset += written;
+        target_offset += written;
+        if (written < size) break;
+    }
+    if (ret == -1 && !*copied) status = errno_to_status( errno );
+    free( buffer );
+
+done:
+    if (needs_close) close( fd );
+    if (source_needs_close) close( source_fd );
+    return status;
+}
+
+
 /******************************************************************************
  *              NtFsControlFile   (NTDLL.@)
  */
@@ -7397,6 +7585,21 @@ NTSTATUS WINAPI NtFsControlFile( HANDLE handle, HANDLE event, PIO_APC_ROUTINE ap
         io->Information = 0;
         status = STATUS_SUCCESS;
         break;
+
+    case FSCTL_DUPLICATE_EXTENTS_TO_FILE:
+        io->Information = 0;
+        status = duplicate_extents( handle, in_buffer, in_size );
+        break;
+
+    case FSCTL_WINE_COPY_FILE_RANGE:
+    {
+        ULONG_PTR copied = 0;
+
+        if (in_size < sizeof(struct copy_file_range_params)) status = STATUS_INVALID_PARAMETER;
+        else status = copy_file_data( handle, in_buffer, &copied );
+        io->Information = copied;
+        break;
+    }
     default:
         return server_ioctl_file( handle, event, apc, apc_context, io, code,
                                   in_buffer, in_size, out_buffer, out_size );
@@ -1387,6 +1387,7 @@ NTSTATUS ntdll_init_syscalls( ULONG id, SYSTEM_SERVICE_TABLE *table, void **disp
     info->dispatcher = __wine_syscall_dispatcher;
     memcpy( table->ArgumentTable, info->args, table->ServiceLimit );
     KeServiceDescriptorTable[id] = *table;
+    call_stats_init_syscalls( id );
     return STATUS_SUCCESS;
 }
 
@@ -2095,6 +2096,8 @@ const unixlib_entry_t __wine_unix_call_funcs[] =
     load_so_dll,
     unwind_builtin_dll,
     system_time_precise,
+    spin_lock_wait,
+    spin_lock_wake,
 };
 
 BOOL ac_odyssey;
@@ -2138,6 +2141,8 @@ const unixlib_entry_t __wine_unix_call_wow64_funcs[] =
     wow64_load_so_dll,
     wow64_unwind_builtin_dll,
     system_time_precise,
+    spin_lock_wait,
+    spin_lock_wake,
 };
 
 #endif  /* _WIN64 */
@@ -2172,6 +2177,7 @@ static void start_main_thread(void)
     load_ntdll();
     if (main_image_info.Machine != current_machine) load_wow64_ntdll( main_image_info.Machine );
     load_apiset_dll();
+    call_stats_init();
     ntdll_init_syscalls( 0, &syscall_table, p__wine_syscall_dispatcher );
     *p__wine_unix_call_dispatcher = __wine_unix_call_dispatcher;
     server_init_process_done();
@@ -439,7 +439,13 @@ static NTSTATUS spawn_process( const RTL_USER_PROCESS_PARAMETERS *params, int so
 
     if (!(pid = fork()))  /* child */
     {
+        /* the child is single-threaded and exits right away, so the grandchild can share its
+         * address space until exec instead of copying the whole address space a second time */
+#ifdef __linux__
+        if (!(pid = vfork()))  /* grandchild */
+#else
         if (!(pid = fork()))  /* grandchild */
+#endif
         {
             if (params->ConsoleFlags ||
                 params->ConsoleHandle == CONSOLE_HANDLE_ALLOC ||
@@ -286,6 +286,16 @@ unsigned int server_call_unlocked( void *req_ptr )
     struct __server_request_info * const req = req_ptr;
     unsigned int ret;
 
+    if (call_stats_enabled)
+    {
+        enum request type = req->u.req.request_header.req;  /* overwritten by the reply */
+        LONG64 start = call_stats_server_start();
+
+        if (!(ret = send_request( req ))) ret = wait_reply( req );
+        call_stats_server_end( type, start );
+        return ret;
+    }
+
     if ((ret = send_request( req ))) return ret;
     return wait_reply( req );
 }
@@ -945,6 +955,7 @@ C_ASSERT( sizeof(union fd_cache_entry) == sizeof(LONG64) );
 
 static union fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
 static union fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+static unsigned int *sock_slot_cache[FD_CACHE_ENTRIES];  /* socket state slots, indexed like fd_cache */
 
 static inline unsigned int handle_to_index( HANDLE handle, unsigned int *entry )
 {
@@ -1033,6 +1044,7 @@ static int remove_fd_from_cache( HANDLE handle )
         cache.data = interlocked_xchg64( &fd_cache[entry][idx].data, 0 );
         if (cache.s.type != FD_TYPE_INVALID) fd = cache.s.fd - 1;
     }
+    if (entry < FD_CACHE_ENTRIES && sock_slot_cache[entry]) sock_slot_cache[entry][idx] = 0;
 
     return fd;
 }
@@ -1099,6 +1111,56 @@ done:
 }
 
 
+/***********************************************************************
+ *           server_get_cached_unix_fd
+ *
+ * Same as server_get_unix_fd(), but only succeeds if the fd is already
+ * cached, so it never needs a server round trip. The fd must not be closed.
+ */
+int server_get_cached_unix_fd( HANDLE handle, int *unix_fd, enum server_fd_type *type )
+{
+    *unix_fd = -1;
+    return get_cached_fd( handle, unix_fd, type, NULL, NULL );
+}
+
+
+/***********************************************************************
+ *           server_set_sock_state_slot
+ *
+ * Remember the index of a socket in the shared socket state mapping.
+ * The entry is cleared together with the fd cache when the handle is closed.
+ */
+void server_set_sock_state_slot( HANDLE handle, unsigned int slot )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FD_CACHE_ENTRIES) return;
+
+    if (!sock_slot_cache[entry])
+    {
+        void *ptr = anon_mmap_alloc( FD_CACHE_BLOCK_SIZE * sizeof(unsigned int), PROT_READ | PROT_WRITE );
+        if (ptr == MAP_FAILED) return;
+        if (InterlockedCompareExchangePointer( (void **)&sock_slot_cache[entry], ptr, NULL ))
+            munmap( ptr, FD_CACHE_BLOCK_SIZE * sizeof(unsigned int) );
+    }
+    sock_slot_cache[entry][idx] = slot;
+}
+
+
+/***********************************************************************
+ *           server_get_sock_state_slot
+ *
+ * Return the cached socket state slot of a handle, or 0 if unknown.
+ */
+unsigned int server_get_sock_state_slot( HANDLE handle )
+{
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+
+    if (entry >= FD_CACHE_ENTRIES || !sock_slot_cache[entry]) return 0;
+    return sock_slot_cache[entry][idx];
+}
+
+
 /***********************************************************************
  *           wine_server_fd_to_handle
  */
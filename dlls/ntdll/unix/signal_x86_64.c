@@ -2494,6 +2494,17 @@ NTSTATUS WINAPI NtSetLdtEntries( ULONG sel1, LDT_ENTRY entry1, ULONG sel2, LDT_E
 }
 
 
+/**********************************************************************
+ *             get_syscall_id
+ *
+ * Return the number of the syscall being executed by the current thread.
+ */
+unsigned int get_syscall_id(void)
+{
+    return amd64_thread_data()->syscall_frame->rax;
+}
+
+
 /**********************************************************************
  *             signal_init_threading
  */
@@ -3147,8 +3158,14 @@ __ASM_GLOBAL_FUNC( __wine_unix_call_dispatcher,
 #endif
                    "movq %rcx,%rsp\n"
                    "movq %r8,%rdi\n\t"             /* args */
+                   "cmpl $0," __ASM_NAME("call_stats_enabled") "(%rip)\n\t"
+                   "jnz 3f\n\t"
                    "callq *(%r10,%rdx,8)\n\t"
-                   "movq %rsp,%rcx\n"
+                   "jmp 4f\n"
+                   "3:\tmovl %edx,%esi\n\t"         /* code */
+                   "movq %r10,%rdx\n\t"            /* funcs */
+                   "callq " __ASM_NAME("call_stats_unix_call") "\n"
+                   "4:\tmovq %rsp,%rcx\n"
                    "testl $0xffff,0x94(%rcx)\n\t"  /* frame->restore_flags */
                    "jnz .L__wine_syscall_dispatcher_return\n\t"
 #ifdef __linux__
@@ -28,7 +28,12 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <unistd.h>
+#include <poll.h>
+#ifdef HAVE_SYS_SENDFILE_H
+# include <sys/sendfile.h>
+#endif
 #ifdef HAVE_IFADDRS_H
 # include <ifaddrs.h>
 #endif
@@ -132,24 +137,31 @@ struct async_send_ioctl
     struct iovec iov[1];
 };
 
+struct transmit_element
+{
+    const char *buffer;         /* memory data to send, if file is NULL */
+    HANDLE file;
+    LARGE_INTEGER offset;       /* file offset, or FILE_USE_FILE_POINTER_POSITION */
+    unsigned int len;           /* amount of data to send; 0 sends file data up to EOF */
+    BOOL more;                  /* more data of the same packet follows */
+};
+
 struct async_transmit_ioctl
 {
     struct async_fileio io;
-    HANDLE file;
-    char *buffer;
+    char *buffer;               /* bounce buffer for file data, if sendfile() can't be used */
     unsigned int buffer_size;   /* allocated size of buffer */
     unsigned int read_len;      /* amount of valid data currently in the buffer */
-    unsigned int head_cursor;   /* amount of header data already sent */
-    unsigned int file_cursor;   /* amount of file data already sent */
     unsigned int buffer_cursor; /* amount of data currently in the buffer already sent */
-    unsigned int tail_cursor;   /* amount of tail data already sent */
-    unsigned int file_len;      /* total file length to send */
-    unsigned int flags;
-    const char *head;
-    const char *tail;
-    unsigned int head_len;
-    unsigned int tail_len;
-    LARGE_INTEGER offset;
+    unsigned int cursor;        /* amount of data of the current element already sent */
+    unsigned int sent_len;      /* total amount of data already sent */
+    unsigned int current;       /* index of the element currently being sent */
+    unsigned int count;
+    DWORD flags;                /* TF_* flags */
+    BOOL eof;                   /* end of file reached for the current element */
+    BOOL corked;                /* the last send was done with MSG_MORE */
+    BOOL use_sendfile;
+    struct transmit_element elements[1];
 };
 
 static NTSTATUS sock_errno_to_status( int err )
@@ -849,12 +861,66 @@ static BOOL is_icmp_over_dgram( int fd )
 #endif
 }
 
+static const volatile unsigned int *sock_shared_state;
+
+/* map the socket state published by the server */
+static const volatile unsigned int *get_sock_shared_state(void)
+{
+    static const WCHAR nameW[] = {'\\','K','e','r','n','e','l','O','b','j','e','c','t','s',
+                                  '\\','_','_','w','i','n','e','_','s','o','c','k','_','s','t','a','t','e',0};
+    static BOOL failed;
+    UNICODE_STRING name_str = { sizeof(nameW) - sizeof(WCHAR), sizeof(nameW), (WCHAR *)nameW };
+    OBJECT_ATTRIBUTES attr = { sizeof(attr), 0, &name_str };
+    size_t size = SOCK_STATE_SLOTS * sizeof(*sock_shared_state);
+    int unix_fd, needs_close;
+    HANDLE section;
+    void *ptr;
+
+    if (sock_shared_state || failed) return sock_shared_state;
+
+    if (!NtOpenSection( &section, SECTION_MAP_READ, &attr ))
+    {
+        if (!server_get_unix_fd( section, 0, &unix_fd, &needs_close, NULL, NULL ))
+        {
+            ptr = mmap( NULL, size, PROT_READ, MAP_SHARED, unix_fd, 0 );
+            if (ptr != MAP_FAILED && InterlockedCompareExchangePointer( (void **)&sock_shared_state, ptr, NULL ))
+                munmap( ptr, size );
+            if (needs_close) close( unix_fd );
+        }
+        NtClose( section );
+    }
+    if (!sock_shared_state)
+    {
+        WARN( "socket state not available, always going through the server\n" );
+        failed = TRUE;
+    }
+    return sock_shared_state;
+}
+
+/* get the SOCK_STATE_* flags published by the server, or 0 if they aren't known yet */
+static unsigned int get_sock_state( HANDLE handle )
+{
+    unsigned int slot = server_get_sock_state_slot( handle );
+    const volatile unsigned int *state;
+
+    if (!slot || slot >= SOCK_STATE_SLOTS || !(state = get_sock_shared_state())) return 0;
+    return state[slot];
+}
+
+/* check whether the server lets us call recv() or send() without queuing the request first,
+ * i.e. the socket isn't shut down and no asyncs that should get the data first are queued */
+static BOOL sock_can_try_directly( HANDLE handle, unsigned int flag )
+{
+    return !!(get_sock_state( handle ) & flag);
+}
+
 static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user, IO_STATUS_BLOCK *io,
                            int fd, struct async_recv_ioctl *async, int force_async )
 {
+    unsigned int i, status, try_status = STATUS_PENDING;
+    ULONG_PTR information = 0;
     HANDLE wait_handle;
     BOOL nonblocking;
-    unsigned int i, status;
     ULONG options;
 
     for (i = 0; i < async->count; ++i)
@@ -866,25 +932,43 @@ static NTSTATUS sock_recv( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, voi
         }
     }
 
+    /* Unless the caller wants the request to be asynchronous, try to receive
+     * right away. If that completes the request, the server only needs to be
+     * told about the result, which saves a round trip. This is only allowed
+     * when the server says that no queued receive should get the data first.
+     * The server always accepts a result we completed ourselves, and it may
+     * signal the event while handling the request, so the IOSB is filled in
+     * before, as with set_async_direct_result(). */
+    if (!force_async && sock_can_try_directly( handle, SOCK_STATE_RECV ))
+    {
+        try_status = try_recv( fd, async, &information );
+        if (!NT_ERROR(try_status))
+        {
+            io->Status = try_status;
+            io->Information = information;
+        }
+    }
+
     SERVER_START_REQ( recv_socket )
     {
         req->force_async = force_async;
         req->async  = server_async( handle, &async->io, event, apc, apc_user, iosb_client_ptr(io) );
         req->oob    = !!(async->unix_flags & MSG_OOB);
+        req->status = try_status;
+        req->total  = information;
         status = wine_server_call( req );
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        if (reply->state_slot) server_set_sock_state_slot( handle, reply->state_slot );
     }
     SERVER_END_REQ;
 
-    /* the server currently will never succeed immediately */
-    assert(status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
+    /* the server never succeeds immediately unless we already did */
+    assert(status == try_status || status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
 
     if (status == STATUS_ALERTED)
     {
-        ULONG_PTR information;
-
         status = try_recv( fd, async, &information );
         if (status == STATUS_DEVICE_NOT_READY && (force_async || !nonblocking))
             status = STATUS_PENDING;
@@ -1098,26 +1182,50 @@ static void sock_save_icmp_id( struct async_send_ioctl *async )
 static NTSTATUS sock_send( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
                            IO_STATUS_BLOCK *io, int fd, struct async_send_ioctl *async, int force_async )
 {
+    unsigned int status, try_status = STATUS_PENDING;
+    BOOL icmp_over_dgram = is_icmp_over_dgram( fd );
     HANDLE wait_handle;
     BOOL nonblocking;
-    unsigned int status;
     ULONG options;
 
+    /* Unless the caller wants the request to be asynchronous, try to send
+     * right away. If that completes the request, the server only needs to be
+     * told about the result, which saves a round trip. This is only allowed
+     * when the server says that no queued send should go out first. ICMP
+     * sockets need the server to record the echo id first. As for receives,
+     * the server always accepts the result, so the IOSB is filled in first. */
+    if (!force_async && !icmp_over_dgram && sock_can_try_directly( handle, SOCK_STATE_SEND ))
+    {
+        try_status = try_send( fd, async );
+        /* A short write may still need to be completed asynchronously,
+         * depending on the socket mode; let the server decide. */
+        if (try_status == STATUS_DEVICE_NOT_READY && async->sent_len)
+            try_status = STATUS_PENDING;
+        if (!NT_ERROR(try_status) && try_status != STATUS_PENDING)
+        {
+            io->Status = try_status;
+            io->Information = async->sent_len;
+        }
+    }
+
     SERVER_START_REQ( send_socket )
     {
         req->force_async = force_async;
         req->async  = server_async( handle, &async->io, event, apc, apc_user, iosb_client_ptr(io) );
+        req->status = try_status;
+        req->total  = async->sent_len;
         status = wine_server_call( req );
         wait_handle = wine_server_ptr_handle( reply->wait );
         options     = reply->options;
         nonblocking = reply->nonblocking;
+        if (reply->state_slot) server_set_sock_state_slot( handle, reply->state_slot );
     }
     SERVER_END_REQ;
 
-    /* the server currently will never succeed immediately */
-    assert(status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
+    /* the server never succeeds immediately unless we already did */
+    assert(status == try_status || status == STATUS_ALERTED || status == STATUS_PENDING || NT_ERROR(status));
 
-    if (!NT_ERROR(status) && is_icmp_over_dgram( fd ))
+    if (!NT_ERROR(status) && icmp_over_dgram)
         sock_save_icmp_id( async );
 
     if (status == STATUS_ALERTED)
@@ -1226,75 +1334,221 @@ static ssize_t do_send( int fd, const void *buffer, size_t len, int flags )
     return ret;
 }
 
-static NTSTATUS try_transmit( int sock_fd, int file_fd, struct async_transmit_ioctl *async )
+static NTSTATUS transmit_data( int sock_fd, struct async_transmit_ioctl *async, const char *data,
+                               unsigned int len, BOOL more )
 {
+    int flags = 0;
     ssize_t ret;
 
-    while (async->head_cursor < async->head_len)
+#ifdef MSG_MORE
+    if (more) flags |= MSG_MORE;
+#endif
+
+    while (len)
     {
-        TRACE( "sending %u bytes of header data\n", async->head_len - async->head_cursor );
-        ret = do_send( sock_fd, async->head + async->head_cursor,
-                       async->head_len - async->head_cursor, 0 );
+        TRACE( "sending %u bytes of data\n", len );
+        ret = do_send( sock_fd, data, len, flags );
         if (ret < 0) return sock_errno_to_status( errno );
         TRACE( "send returned %zd\n", ret );
-        async->head_cursor += ret;
+        async->cursor += ret;
+        async->sent_len += ret;
+        async->corked = !!flags;
+        data += ret;
+        len -= ret;
     }
+    return STATUS_SUCCESS;
+}
 
-    while (async->buffer_cursor < async->read_len)
+#ifdef HAVE_SYS_SENDFILE_H
+/* Send file data directly from the page cache. Returns STATUS_NOT_SUPPORTED
+ * if the file or socket can't be used with sendfile(). */
+static NTSTATUS transmit_sendfile( int sock_fd, int file_fd, struct async_transmit_ioctl *async,
+                                   struct transmit_element *element )
+{
+    size_t size;
+    ssize_t ret;
+
+    while (!element->len || async->cursor < element->len)
     {
-        TRACE( "sending %u bytes of file data\n", async->read_len - async->buffer_cursor );
-        ret = do_send( sock_fd, async->buffer + async->buffer_cursor,
-                       async->read_len - async->buffer_cursor, 0 );
-        if (ret < 0) return sock_errno_to_status( errno );
-        TRACE( "send returned %zd\n", ret );
-        async->buffer_cursor += ret;
-        async->file_cursor += ret;
+        size = element->len ? element->len - async->cursor : 0x7ffff000;
+
+        TRACE( "sending %zu bytes of file data\n", size );
+        if (element->offset.QuadPart == FILE_USE_FILE_POINTER_POSITION)
+        {
+            while ((ret = sendfile( sock_fd, file_fd, NULL, size )) < 0 && errno == EINTR);
+        }
+        else
+        {
+            off_t offset = element->offset.QuadPart;
+            while ((ret = sendfile( sock_fd, file_fd, &offset, size )) < 0 && errno == EINTR);
+        }
+        if (ret < 0)
+        {
+            if (errno == EINVAL || errno == ENOSYS) return STATUS_NOT_SUPPORTED;
+            if (errno != EWOULDBLOCK) WARN( "sendfile: %s\n", strerror( errno ) );
+            return sock_errno_to_status( errno );
+        }
+        TRACE( "sendfile returned %zd\n", ret );
+
+        if (!ret)
+        {
+            async->eof = TRUE;
+            break;
+        }
+        async->cursor += ret;
+        async->sent_len += ret;
+        async->corked = FALSE;
+        if (element->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
+            element->offset.QuadPart += ret;
     }
+    return STATUS_SUCCESS;
+}
+#endif
+
+static NTSTATUS transmit_file( int sock_fd, struct async_transmit_ioctl *async, struct transmit_element *element )
+{
+    int file_fd, needs_close = FALSE;
+    unsigned int read_size;
+    NTSTATUS status;
+    ssize_t ret;
 
-    if (async->file && async->buffer_cursor == async->read_len)
+    if (async->buffer_cursor < async->read_len)
     {
-        unsigned int read_size = async->buffer_size;
+        unsigned int cursor = async->cursor, len = async->read_len - async->buffer_cursor;
+        BOOL last = async->eof || (element->len && cursor + len == element->len);
 
-        if (async->file_len)
-            read_size = min( read_size, async->file_len - async->file_cursor );
+        status = transmit_data( sock_fd, async, async->buffer + async->buffer_cursor, len,
+                                last && element->more );
+        async->buffer_cursor += async->cursor - cursor;
+        if (status) return status;
+    }
 
-        TRACE( "reading %u bytes of file data\n", read_size );
-        do
-        {
-            if (async->offset.QuadPart == FILE_USE_FILE_POINTER_POSITION)
-                ret = read( file_fd, async->buffer, read_size );
-            else
-                ret = pread( file_fd, async->buffer, read_size, async->offset.QuadPart );
-        } while (ret < 0 && errno == EINTR);
-        if (ret < 0) return errno_to_status( errno );
-        TRACE( "read returned %zd\n", ret );
+    if (async->eof || (element->len && async->cursor == element->len))
+        return STATUS_SUCCESS;
 
-        async->read_len = ret;
-        async->buffer_cursor = 0;
-        if (async->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
-            async->offset.QuadPart += ret;
+    if ((status = server_get_unix_fd( element->file, 0, &file_fd, &needs_close, NULL, NULL )))
+        return status;
 
-        if (ret < read_size || (async->file_len && async->file_cursor == async->file_len))
-            async->file = NULL;
-        return STATUS_DEVICE_NOT_READY; /* still more data to send */
+#ifdef HAVE_SYS_SENDFILE_H
+    if (async->use_sendfile)
+    {
+        status = transmit_sendfile( sock_fd, file_fd, async, element );
+        if (status != STATUS_NOT_SUPPORTED) goto done;
+        TRACE( "sendfile not supported, falling back to read\n" );
+        async->use_sendfile = FALSE;
     }
+#endif
 
-    while (async->tail_cursor < async->tail_len)
+    if (!async->buffer && !(async->buffer = malloc( async->buffer_size )))
     {
-        TRACE( "sending %u bytes of tail data\n", async->tail_len - async->tail_cursor );
-        ret = do_send( sock_fd, async->tail + async->tail_cursor,
-                       async->tail_len - async->tail_cursor, 0 );
-        if (ret < 0) return sock_errno_to_status( errno );
-        TRACE( "send returned %zd\n", ret );
-        async->tail_cursor += ret;
+        status = STATUS_NO_MEMORY;
+        goto done;
     }
 
+    read_size = async->buffer_size;
+    if (element->len)
+        read_size = min( read_size, element->len - async->cursor );
+
+    TRACE( "reading %u bytes of file data\n", read_size );
+    do
+    {
+        if (element->offset.QuadPart == FILE_USE_FILE_POINTER_POSITION)
+            ret = read( file_fd, async->buffer, read_size );
+        else
+            ret = pread( file_fd, async->buffer, read_size, element->offset.QuadPart );
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+    {
+        status = errno_to_status( errno );
+        goto done;
+    }
+    TRACE( "read returned %zd\n", ret );
+
+    async->read_len = ret;
+    async->buffer_cursor = 0;
+    if (element->offset.QuadPart != FILE_USE_FILE_POINTER_POSITION)
+        element->offset.QuadPart += ret;
+    if (ret < read_size) async->eof = TRUE;
+    status = STATUS_DEVICE_NOT_READY; /* still more data to send */
+
+done:
+    if (needs_close) close( file_fd );
+    return status;
+}
+
+/* An empty send() doesn't flush TCP data queued with MSG_MORE, but clearing
+ * TCP_CORK does. Datagram sockets send the pending datagram on an empty send(). */
+static void transmit_uncork( int sock_fd )
+{
+#ifdef TCP_CORK
+    int value = 1;
+
+    if (!setsockopt( sock_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value) ))
+    {
+        value = 0;
+        setsockopt( sock_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value) );
+        return;
+    }
+#endif
+    do_send( sock_fd, NULL, 0, 0 );
+}
+
+static NTSTATUS try_transmit( int sock_fd, struct async_transmit_ioctl *async )
+{
+    NTSTATUS status;
+
+    while (async->current < async->count)
+    {
+        struct transmit_element *element = &async->elements[async->current];
+
+        if (element->file)
+            status = transmit_file( sock_fd, async, element );
+        else
+            status = transmit_data( sock_fd, async, element->buffer + async->cursor,
+                                    element->len - async->cursor, element->more );
+        if (status) return status;
+
+        async->current++;
+        async->cursor = 0;
+        async->read_len = 0;
+        async->buffer_cursor = 0;
+        async->eof = FALSE;
+    }
+
+    /* push out anything held back by MSG_MORE, e.g. when the last element was an empty file */
+    if (async->corked)
+    {
+        transmit_uncork( sock_fd );
+        async->corked = FALSE;
+    }
     return STATUS_SUCCESS;
 }
 
+/* TF_DISCONNECT and TF_REUSE_SOCKET shut down the sending side once everything
+ * has been sent. If the transmit is still queued, the server delays the
+ * shutdown until it's done. TF_WRITE_BEHIND needs nothing, since sends always
+ * complete as soon as the data is queued in the kernel buffers. */
+static void transmit_disconnect( struct async_transmit_ioctl *async )
+{
+    IO_STATUS_BLOCK io;
+    int how = SD_SEND;
+
+    if (!(async->flags & (TF_DISCONNECT | TF_REUSE_SOCKET))) return;
+    if (async->flags & TF_REUSE_SOCKET) FIXME( "Reusing socket not supported yet\n" );
+
+    NtDeviceIoControlFile( async->io.handle, NULL, NULL, NULL, &io, IOCTL_AFD_WINE_SHUTDOWN,
+                           &how, sizeof(how), NULL, 0 );
+}
+
+static void release_transmit_async( struct async_transmit_ioctl *async )
+{
+    free( async->buffer );
+    release_fileio( &async->io );
+}
+
 static BOOL async_transmit_proc( void *user, ULONG_PTR *info, unsigned int *status )
 {
-    int sock_fd, file_fd = -1, sock_needs_close = FALSE, file_needs_close = FALSE;
+    int sock_fd, sock_needs_close = FALSE;
     struct async_transmit_ioctl *async = user;
 
     TRACE( "%#x\n", *status );
@@ -1304,81 +1558,102 @@ static BOOL async_transmit_proc( void *user, ULONG_PTR *info, unsigned int *stat
         if ((*status = server_get_unix_fd( async->io.handle, 0, &sock_fd, &sock_needs_close, NULL, NULL )))
             return TRUE;
 
-        if (async->file && (*status = server_get_unix_fd( async->file, 0, &file_fd, &file_needs_close, NULL, NULL )))
-        {
-            if (sock_needs_close) close( sock_fd );
-            return TRUE;
-        }
-
-        *status = try_transmit( sock_fd, file_fd, async );
+        *status = try_transmit( sock_fd, async );
         TRACE( "got status %#x\n", *status );
 
         if (sock_needs_close) close( sock_fd );
-        if (file_needs_close) close( file_fd );
 
         if (*status == STATUS_DEVICE_NOT_READY)
             return FALSE;
+        if (!*status) transmit_disconnect( async );
     }
-    *info = async->head_cursor + async->file_cursor + async->tail_cursor;
-    release_fileio( &async->io );
+    *info = async->sent_len;
+    release_transmit_async( async );
     return TRUE;
 }
 
-static NTSTATUS sock_transmit( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
-                               IO_STATUS_BLOCK *io, int fd, const struct afd_transmit_params *params )
+static NTSTATUS check_transmit_file( HANDLE file )
 {
     int file_fd, file_needs_close = FALSE;
-    struct async_transmit_ioctl *async;
     enum server_fd_type file_type;
+    NTSTATUS status;
+
+    if ((status = server_get_unix_fd( file, 0, &file_fd, &file_needs_close, &file_type, NULL )))
+        return status;
+    if (file_needs_close) close( file_fd );
+
+    if (file_type != FD_TYPE_FILE)
+    {
+        FIXME( "unsupported file type %#x\n", file_type );
+        return STATUS_NOT_IMPLEMENTED;
+    }
+    return STATUS_SUCCESS;
+}
+
+static struct async_transmit_ioctl *alloc_transmit_async( HANDLE handle, unsigned int count,
+                                                          unsigned int buffer_size, DWORD flags )
+{
+    struct async_transmit_ioctl *async;
+
+    if (!(async = (struct async_transmit_ioctl *)alloc_fileio( offsetof( struct async_transmit_ioctl, elements[count] ),
+                                                                async_transmit_proc, handle )))
+        return NULL;
+
+    async->buffer = NULL;
+    async->buffer_size = buffer_size ? buffer_size : 65536;
+    async->read_len = 0;
+    async->buffer_cursor = 0;
+    async->cursor = 0;
+    async->sent_len = 0;
+    async->current = 0;
+    async->count = 0;
+    async->flags = flags;
+    async->eof = FALSE;
+    async->corked = FALSE;
+    async->use_sendfile = FALSE;
+    return async;
+}
+
+static void add_transmit_element( struct async_transmit_ioctl *async, const char *buffer, HANDLE file,
+                                  LARGE_INTEGER offset, unsigned int len, BOOL more )
+{
+    struct transmit_element *element = &async->elements[async->count++];
+
+    element->buffer = buffer;
+    element->file = file;
+    element->offset = offset;
+    element->len = len;
+    element->more = more;
+}
+
+static NTSTATUS sock_transmit( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                               IO_STATUS_BLOCK *io, int fd, struct async_transmit_ioctl *async )
+{
     union unix_sockaddr addr;
     socklen_t addr_len;
     HANDLE wait_handle;
     unsigned int status;
     ULONG options;
+    int type;
 
     addr_len = sizeof(addr);
     if (getpeername( fd, &addr.addr, &addr_len ) != 0)
-        return STATUS_INVALID_CONNECTION;
-
-    if (params->file)
     {
-        if ((status = server_get_unix_fd( ULongToHandle( params->file ), 0, &file_fd, &file_needs_close, &file_type, NULL )))
-            return status;
-        if (file_needs_close) close( file_fd );
-
-        if (file_type != FD_TYPE_FILE)
-        {
-            FIXME( "unsupported file type %#x\n", file_type );
-            return STATUS_NOT_IMPLEMENTED;
-        }
+        release_transmit_async( async );
+        return STATUS_INVALID_CONNECTION;
     }
 
-    if (!(async = (struct async_transmit_ioctl *)alloc_fileio( sizeof(*async), async_transmit_proc, handle )))
-        return STATUS_NO_MEMORY;
-
-    async->file = ULongToHandle( params->file );
-    async->buffer_size = params->buffer_size ? params->buffer_size : 65536;
-    if (!(async->buffer = malloc( async->buffer_size )))
-    {
-        release_fileio( &async->io );
-        return STATUS_NO_MEMORY;
-    }
-    async->read_len = 0;
-    async->head_cursor = 0;
-    async->file_cursor = 0;
-    async->buffer_cursor = 0;
-    async->tail_cursor = 0;
-    async->file_len = params->file_len;
-    async->flags = params->flags;
-    async->head = u64_to_user_ptr(params->head_ptr);
-    async->head_len = params->head_len;
-    async->tail = u64_to_user_ptr(params->tail_ptr);
-    async->tail_len = params->tail_len;
-    async->offset = params->offset;
+#ifdef HAVE_SYS_SENDFILE_H
+    /* sendfile() doesn't preserve packet boundaries */
+    addr_len = sizeof(type);
+    if (!getsockopt( fd, SOL_SOCKET, SO_TYPE, &type, &addr_len ) && type == SOCK_STREAM)
+        async->use_sendfile = TRUE;
+#endif
 
     SERVER_START_REQ( send_socket )
     {
         req->force_async = 1;
+        req->status = STATUS_PENDING;
         req->async  = server_async( handle, &async->io, event, apc, apc_user, iosb_client_ptr(io) );
         status = wine_server_call( req );
         wait_handle = wine_server_ptr_handle( reply->wait );
@@ -1393,22 +1668,23 @@ static NTSTATUS sock_transmit( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc,
     {
         ULONG_PTR information;
 
-        status = try_transmit( fd, file_fd, async );
+        status = try_transmit( fd, async );
         if (status == STATUS_DEVICE_NOT_READY)
             status = STATUS_PENDING;
 
-        information = async->head_cursor + async->file_cursor + async->tail_cursor;
+        information = async->sent_len;
         if (!NT_ERROR(status) && status != STATUS_PENDING)
         {
             io->Status = status;
             io->Information = information;
         }
 
+        if (!status) transmit_disconnect( async );
         set_async_direct_result( &wait_handle, status, information, TRUE );
     }
 
     if (status != STATUS_PENDING)
-        release_fileio( &async->io );
+        release_transmit_async( async );
 
     if (!status && !(options & (FILE_SYNCHRONOUS_IO_ALERT | FILE_SYNCHRONOUS_IO_NONALERT)))
     {
@@ -1422,6 +1698,77 @@ static NTSTATUS sock_transmit( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc,
     return status;
 }
 
+static NTSTATUS sock_transmit_file( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                                    IO_STATUS_BLOCK *io, int fd, const struct afd_transmit_params *params )
+{
+    struct async_transmit_ioctl *async;
+    HANDLE file = ULongToHandle( params->file );
+    NTSTATUS status;
+
+    if (file && (status = check_transmit_file( file )))
+        return status;
+
+    if (!(async = alloc_transmit_async( handle, 3, params->buffer_size, params->flags )))
+        return STATUS_NO_MEMORY;
+
+    if (params->head_len)
+        add_transmit_element( async, u64_to_user_ptr(params->head_ptr), NULL, params->offset,
+                              params->head_len, file || params->tail_len );
+    if (file)
+        add_transmit_element( async, NULL, file, params->offset, params->file_len, params->tail_len != 0 );
+    if (params->tail_len)
+        add_transmit_element( async, u64_to_user_ptr(params->tail_ptr), NULL, params->offset,
+                              params->tail_len, FALSE );
+
+    return sock_transmit( handle, event, apc, apc_user, io, fd, async );
+}
+
+static NTSTATUS sock_transmit_packets( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                                       IO_STATUS_BLOCK *io, int fd, const struct afd_transmit_packets_params *params )
+{
+    struct async_transmit_ioctl *async;
+    unsigned int i;
+    NTSTATUS status;
+
+    for (i = 0; i < params->count; ++i)
+    {
+        const struct afd_transmit_packets_element *element = &params->elements[i];
+
+        switch (element->flags & (TP_ELEMENT_MEMORY | TP_ELEMENT_FILE))
+        {
+            case TP_ELEMENT_MEMORY:
+                break;
+
+            case TP_ELEMENT_FILE:
+                if ((status = check_transmit_file( ULongToHandle( element->file ) )))
+                    return status;
+                break;
+
+            default:
+                return STATUS_INVALID_PARAMETER;
+        }
+    }
+
+    if (!(async = alloc_transmit_async( handle, params->count, params->send_size, params->flags )))
+        return STATUS_NO_MEMORY;
+
+    for (i = 0; i < params->count; ++i)
+    {
+        const struct afd_transmit_packets_element *element = &params->elements[i];
+        BOOL more = i + 1 < params->count && !(element->flags & TP_ELEMENT_EOP);
+
+        if (element->flags & TP_ELEMENT_FILE)
+            add_transmit_element( async, NULL, ULongToHandle( element->file ), element->offset, element->len, more );
+        else if (element->len)
+            add_transmit_element( async, u64_to_user_ptr(element->buffer_ptr), NULL, element->offset,
+                                  element->len, more );
+    }
+    /* trailing empty elements are skipped, make sure the last send isn't corked */
+    if (async->count) async->elements[async->count - 1].more = FALSE;
+
+    return sock_transmit( handle, event, apc, apc_user, io, fd, async );
+}
+
 static void complete_async( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
                             IO_STATUS_BLOCK *io, NTSTATUS status, ULONG_PTR information )
 {
@@ -1435,6 +1782,156 @@ static void complete_async( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, vo
 }
 
 
+/* Return the AFD_POLL_* flags for a socket, given the events returned by poll()
+ * and the state published by the server, or -1 if they depend on state transitions
+ * that only the server knows about. */
+static int get_client_poll_flags( int fd, unsigned int state, int event )
+{
+    int value, flags = 0;
+    socklen_t len;
+
+    /* errors and hangups change the socket state; let the server track them */
+    if (event & (POLLERR | POLLHUP | POLLNVAL)) return -1;
+
+    if (event & POLLIN)
+    {
+        if (state & SOCK_STATE_CONNECTED)
+        {
+            char dummy;
+
+            /* end of stream is reported as AFD_POLL_HUP by the server */
+            if (recv( fd, &dummy, 1, MSG_PEEK ) <= 0) return -1;
+        }
+        flags |= AFD_POLL_READ;
+    }
+    if (event & POLLPRI)
+    {
+        len = sizeof(value);
+        if (getsockopt( fd, SOL_SOCKET, SO_OOBINLINE, &value, &len )) return -1;
+        flags |= value ? AFD_POLL_READ : AFD_POLL_OOB;
+    }
+    if (event & POLLOUT)
+        flags |= AFD_POLL_WRITE;
+    if (state & SOCK_STATE_CONNECTED)
+        flags |= AFD_POLL_CONNECT;
+
+    return flags;
+}
+
+/* Try to complete a poll request without the server. This is only possible
+ * if all the sockets have cached fds, the server reports them as connected or
+ * connectionless with no errors or queued I/O, the result can be derived from
+ * the fds alone, and the request doesn't need to wait; otherwise
+ * STATUS_BAD_DEVICE_TYPE is returned and the server handles the request. */
+static NTSTATUS try_poll_client( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc_user,
+                                 IO_STATUS_BLOCK *io, const void *in_buffer, UINT in_size,
+                                 void *out_buffer, UINT out_size )
+{
+    const struct afd_poll_params_32 *params32 = in_buffer;
+    const struct afd_poll_params *params = in_buffer;
+    unsigned int i, count, signaled = 0;
+    BOOL wow64 = in_wow64_call();
+    NTSTATUS status = STATUS_BAD_DEVICE_TYPE;
+    struct pollfd *pollfds;
+    LONGLONG timeout;
+    size_t size;
+    unsigned int *states;
+    int *flags;
+
+    if (in_size < (wow64 ? sizeof(*params32) : sizeof(*params))) return status;
+    count = wow64 ? params32->count : params->count;
+    timeout = wow64 ? params32->timeout : params->timeout;
+    size = wow64 ? offsetof( struct afd_poll_params_32, sockets[count] )
+                 : offsetof( struct afd_poll_params, sockets[count] );
+    if (!count || in_size < size || out_size < size) return status;
+    /* exclusive polls interact with the polls of other threads */
+    if (wow64 ? params32->exclusive : params->exclusive) return status;
+
+    if (!(pollfds = malloc( count * (sizeof(*pollfds) + sizeof(*flags) + sizeof(*states)) ))) return status;
+    flags = (int *)(pollfds + count);
+    states = (unsigned int *)(flags + count);
+
+    for (i = 0; i < count; ++i)
+    {
+        HANDLE socket = wow64 ? ULongToHandle( params32->sockets[i].socket ) : (HANDLE)params->sockets[i].socket;
+        int mask = wow64 ? params32->sockets[i].flags : params->sockets[i].flags;
+        enum server_fd_type type;
+
+        if (server_get_cached_unix_fd( socket, &pollfds[i].fd, &type ) || type != FD_TYPE_SOCKET)
+            goto done;
+        if (!((states[i] = get_sock_state( socket )) & SOCK_STATE_POLL))
+            goto done;
+
+        pollfds[i].events = 0;
+        if (mask & (AFD_POLL_READ | AFD_POLL_ACCEPT | AFD_POLL_HUP))
+            pollfds[i].events |= POLLIN;
+        if (mask & AFD_POLL_OOB)
+            pollfds[i].events |= POLLIN | POLLPRI;
+        if (mask & AFD_POLL_WRITE)
+            pollfds[i].events |= POLLOUT;
+        pollfds[i].revents = 0;
+    }
+
+    if (poll( pollfds, count, 0 ) < 0) goto done;
+
+    for (i = 0; i < count; ++i)
+    {
+        int mask = wow64 ? params32->sockets[i].flags : params->sockets[i].flags;
+
+        if ((flags[i] = get_client_poll_flags( pollfds[i].fd, states[i], pollfds[i].revents )) == -1)
+            goto done;
+        if ((flags[i] &= mask)) ++signaled;
+    }
+
+    if (!signaled && timeout) goto done;
+
+    TRACE( "completing poll for %u sockets, %u signaled\n", count, signaled );
+
+    /* the output may alias the input; entries only ever move down */
+    if (wow64)
+    {
+        struct afd_poll_params_32 *output = out_buffer;
+
+        output->timeout = timeout;
+        output->exclusive = FALSE;
+        for (i = 0, signaled = 0; i < count; ++i)
+        {
+            if (!flags[i]) continue;
+            output->sockets[signaled].socket = params32->sockets[i].socket;
+            output->sockets[signaled].flags = flags[i];
+            output->sockets[signaled].status = STATUS_SUCCESS;
+            ++signaled;
+        }
+        output->count = signaled;
+        size = offsetof( struct afd_poll_params_32, sockets[signaled] );
+    }
+    else
+    {
+        struct afd_poll_params *output = out_buffer;
+
+        output->timeout = timeout;
+        output->exclusive = FALSE;
+        for (i = 0, signaled = 0; i < count; ++i)
+        {
+            if (!flags[i]) continue;
+            output->sockets[signaled].socket = params->sockets[i].socket;
+            output->sockets[signaled].flags = flags[i];
+            output->sockets[signaled].status = STATUS_SUCCESS;
+            ++signaled;
+        }
+        output->count = signaled;
+        size = offsetof( struct afd_poll_params, sockets[signaled] );
+    }
+
+    complete_async( handle, event, apc, apc_user, io, STATUS_SUCCESS, size );
+    status = STATUS_SUCCESS;
+
+done:
+    free( pollfds );
+    return status;
+}
+
+
 static NTSTATUS do_getsockopt( HANDLE handle, IO_STATUS_BLOCK *io, int level,
                                int option, void *out_buffer, ULONG out_size )
 {
@@ -1543,7 +2040,7 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
             break;
 
         case IOCTL_AFD_POLL:
-            status = STATUS_BAD_DEVICE_TYPE;
+            status = try_poll_client( handle, event, apc, apc_user, io, in_buffer, in_size, out_buffer, out_size );
             break;
 
         case IOCTL_AFD_RECV:
@@ -1674,7 +2171,26 @@ NTSTATUS sock_ioctl( HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc, void *apc
                 status = STATUS_BUFFER_TOO_SMALL;
                 break;
             }
-            status = sock_transmit( handle, event, apc, apc_user, io, fd, params );
+            status = sock_transmit_file( handle, event, apc, apc_user, io, fd, params );
+            if (needs_close) close( fd );
+            return status;
+        }
+
+        case IOCTL_AFD_WINE_TRANSMIT_PACKETS:
+        {
+            const struct afd_transmit_packets_params *params = in_buffer;
+
+            if ((status = server_get_unix_fd( handle, 0, &fd, &needs_close, NULL, NULL )))
+                return status;
+
+            if (in_size < offsetof( struct afd_transmit_packets_params, elements[0] )
+                || params->count > (in_size - offsetof( struct afd_transmit_packets_params, elements[0] ))
+                                   / sizeof(params->elements[0]))
+            {
+                status = STATUS_BUFFER_TOO_SMALL;
+                break;
+            }
+            status = sock_transmit_packets( handle, event, apc, apc_user, io, fd, params );
             if (needs_close) close( fd );
             return status;
         }
@@ -1829,6 +1829,46 @@ NTSTATUS system_time_precise( void *args )
 }
 
 
+/***********************************************************************
+ *              spin_lock_wait
+ *
+ * Block on a contended PE side spin lock while it is held with waiters (value 2).
+ */
+NTSTATUS spin_lock_wait( void *args )
+{
+#ifdef __linux__
+    LONG *lock = args;
+
+    if (use_futexes())
+    {
+        futex_wait( lock, 2, NULL );
+        return STATUS_SUCCESS;
+    }
+#endif
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+
+/***********************************************************************
+ *              spin_lock_wake
+ *
+ * Wake a thread blocked in spin_lock_wait().
+ */
+NTSTATUS spin_lock_wake( void *args )
+{
+#ifdef __linux__
+    LONG *lock = args;
+
+    if (use_futexes())
+    {
+        futex_wake( lock, 1 );
+        return STATUS_SUCCESS;
+    }
+#endif
+    return STATUS_NOT_IMPLEMENTED;
+}
+
+
 /******************************************************************************
  *              NtCreateKeyedEvent (NTDLL.@)
  */
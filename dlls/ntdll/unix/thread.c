@@ -1393,6 +1393,7 @@ void abort_thread( int status )
  */
 void abort_process( int status )
 {
+    call_stats_write();
     _exit( get_unix_exit_code( status ));
 }
 
@@ -178,6 +178,9 @@ extern unsigned int server_queue_process_apc( HANDLE process, const apc_call_t *
                                               apc_result_t *result ) DECLSPEC_HIDDEN;
 extern int server_get_unix_fd( HANDLE handle, unsigned int wanted_access, int *unix_fd,
                                int *needs_close, enum server_fd_type *type, unsigned int *options ) DECLSPEC_HIDDEN;
+extern int server_get_cached_unix_fd( HANDLE handle, int *unix_fd, enum server_fd_type *type ) DECLSPEC_HIDDEN;
+extern void server_set_sock_state_slot( HANDLE handle, unsigned int slot ) DECLSPEC_HIDDEN;
+extern unsigned int server_get_sock_state_slot( HANDLE handle ) DECLSPEC_HIDDEN;
 extern void wine_server_send_fd( int fd ) DECLSPEC_HIDDEN;
 extern void process_exit_wrapper( int status ) DECLSPEC_HIDDEN;
 extern size_t server_init_process(void) DECLSPEC_HIDDEN;
@@ -185,6 +188,14 @@ extern void server_init_process_done(void) DECLSPEC_HIDDEN;
 extern void server_init_thread( void *entry_point, BOOL *suspend ) DECLSPEC_HIDDEN;
 extern int server_pipe( int fd[2] ) DECLSPEC_HIDDEN;
 
+extern BOOL call_stats_enabled DECLSPEC_HIDDEN;
+extern void call_stats_init(void) DECLSPEC_HIDDEN;
+extern void call_stats_init_syscalls( ULONG id ) DECLSPEC_HIDDEN;
+extern void call_stats_write(void) DECLSPEC_HIDDEN;
+extern NTSTATUS call_stats_unix_call( void *args, unsigned int code, const unixlib_entry_t *funcs ) DECLSPEC_HIDDEN;
+extern LONG64 call_stats_server_start(void) DECLSPEC_HIDDEN;
+extern void call_stats_server_end( enum request req, LONG64 start ) DECLSPEC_HIDDEN;
+
 extern void fpux_to_fpu( I386_FLOATING_SAVE_AREA *fpu, const XSAVE_FORMAT *fpux ) DECLSPEC_HIDDEN;
 extern void fpu_to_fpux( XSAVE_FORMAT *fpux, const I386_FLOATING_SAVE_AREA *fpu ) DECLSPEC_HIDDEN;
 extern void *get_cpu_area( USHORT machine ) DECLSPEC_HIDDEN;
@@ -200,6 +211,8 @@ extern NTSTATUS get_thread_context( HANDLE handle, void *context, BOOL *self, US
 extern unsigned int alloc_object_attributes( const OBJECT_ATTRIBUTES *attr, struct object_attributes **ret,
                                              data_size_t *ret_len ) DECLSPEC_HIDDEN;
 extern NTSTATUS system_time_precise( void *args ) DECLSPEC_HIDDEN;
+extern NTSTATUS spin_lock_wait( void *args ) DECLSPEC_HIDDEN;
+extern NTSTATUS spin_lock_wake( void *args ) DECLSPEC_HIDDEN;
 
 extern void *anon_mmap_fixed( void *start, size_t size, int prot, int flags ) DECLSPEC_HIDDEN;
 extern void *anon_mmap_alloc( size_t size, int prot ) DECLSPEC_HIDDEN;
@@ -253,6 +266,7 @@ extern SYSTEM_SERVICE_TABLE KeServiceDescriptorTable[4] DECLSPEC_HIDDEN;
 extern void __wine_syscall_dispatcher(void) DECLSPEC_HIDDEN;
 extern void WINAPI DECLSPEC_NORETURN __wine_syscall_dispatcher_return( void *frame, ULONG_PTR retval ) DECLSPEC_HIDDEN;
 extern void __wine_unix_call_dispatcher(void) DECLSPEC_HIDDEN;
+extern unsigned int get_syscall_id(void) DECLSPEC_HIDDEN;
 extern NTSTATUS signal_set_full_context( CONTEXT *context ) DECLSPEC_HIDDEN;
 extern NTSTATUS get_thread_wow64_context( HANDLE handle, void *ctx, ULONG size ) DECLSPEC_HIDDEN;
 extern NTSTATUS set_thread_wow64_context( HANDLE handle, const void *ctx, ULONG size ) DECLSPEC_HIDDEN;
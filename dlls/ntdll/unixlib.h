@@ -43,6 +43,8 @@ enum ntdll_unix_funcs
     unix_load_so_dll,
     unix_unwind_builtin_dll,
     unix_system_time_precise,
+    unix_spin_lock_wait,
+    unix_spin_lock_wake,
 };
 
 extern unixlib_handle_t ntdll_unix_handle;
@@ -844,11 +844,13 @@ static void test_TypeInfo(void)
     static WCHAR wszBogus[] = { 'b','o','g','u','s',0 };
     static WCHAR wszGetTypeInfo[] = { 'G','e','t','T','y','p','e','I','n','f','o',0 };
     static WCHAR wszClone[] = {'C','l','o','n','e',0};
+    static WCHAR wszCloneUpper[] = {'C','L','O','N','E',0};
     static WCHAR wszTestDll[] = {'t','e','s','t','.','d','l','l',0};
     OLECHAR* bogus = wszBogus;
     OLECHAR* pwszGetTypeInfo = wszGetTypeInfo;
     OLECHAR* pwszClone = wszClone;
-    DISPID dispidMember;
+    OLECHAR* pwszCloneUpper = wszCloneUpper;
+    DISPID dispidMember, dispid;
     DISPPARAMS dispparams;
     GUID bogusguid = {0x806afb4f,0x13f7,0x42d2,{0x89,0x2c,0x6c,0x97,0xc3,0x6a,0x36,0xc1}};
     static const GUID moduleTestGetDllEntryGuid = {0xf073cd92,0xa199,0x11ea,{0xbb,0x37,0x02,0x42,0xac,0x13,0x00,0x02}};
@@ -921,6 +923,11 @@ static void test_TypeInfo(void)
     hr = ITypeInfo_GetIDsOfNames(pTypeInfo, &pwszClone, 1, &dispidMember);
     ok_ole_success(hr, ITypeInfo_GetIDsOfNames);
 
+    /* names are case insensitive */
+    hr = ITypeInfo_GetIDsOfNames(pTypeInfo, &pwszCloneUpper, 1, &dispid);
+    ok_ole_success(hr, ITypeInfo_GetIDsOfNames);
+    ok(dispid == dispidMember, "got %ld, expected %ld\n", dispid, dispidMember);
+
     /* correct member id -- wrong flags -- cNamedArgs not bigger than cArgs */
     dispparams.cNamedArgs = 0;
     hr = ITypeInfo_Invoke(pTypeInfo, (void *)0xdeadbeef, dispidMember, DISPATCH_PROPERTYGET, &dispparams, NULL, NULL, NULL);
@@ -1186,6 +1193,73 @@ static void test_TypeInfo(void)
     DeleteFileW(filename);
 }
 
+static void test_TypeInfo_names(void)
+{
+    static OLECHAR nameW[] = {'n','a','m','e',0};
+    static OLECHAR funcW[] = {'f','u','n','c',0};
+    static OLECHAR applesW[] = {0xc4,'p','f','e','l',0};
+    static OLECHAR applesUpperW[] = {0xe4,'P','F','E','L',0};
+    OLECHAR *names[1];
+    CHAR filenameA[MAX_PATH];
+    WCHAR filenameW[MAX_PATH];
+    ICreateTypeLib2 *ctl;
+    ICreateTypeInfo *cti;
+    ITypeInfo *ti;
+    FUNCDESC funcdesc;
+    MEMBERID memid;
+    HRESULT hr;
+
+    GetTempFileNameA(".", "tlb", 0, filenameA);
+    MultiByteToWideChar(CP_ACP, 0, filenameA, -1, filenameW, MAX_PATH);
+
+    hr = CreateTypeLib2(SYS_WIN32, filenameW, &ctl);
+    ok(hr == S_OK, "got %08lx\n", hr);
+
+    hr = ICreateTypeLib2_CreateTypeInfo(ctl, nameW, TKIND_DISPATCH, &cti);
+    ok(hr == S_OK, "got %08lx\n", hr);
+
+    memset(&funcdesc, 0, sizeof(FUNCDESC));
+    funcdesc.funckind = FUNC_DISPATCH;
+    funcdesc.invkind = INVOKE_FUNC;
+    funcdesc.callconv = CC_STDCALL;
+    funcdesc.elemdescFunc.tdesc.vt = VT_VOID;
+
+    funcdesc.memid = 0x10;
+    hr = ICreateTypeInfo_AddFuncDesc(cti, 0, &funcdesc);
+    ok(hr == S_OK, "got 0x%08lx\n", hr);
+    names[0] = funcW;
+    hr = ICreateTypeInfo_SetFuncAndParamNames(cti, 0, names, 1);
+    ok(hr == S_OK, "got 0x%08lx\n", hr);
+
+    funcdesc.memid = 0x20;
+    hr = ICreateTypeInfo_AddFuncDesc(cti, 1, &funcdesc);
+    ok(hr == S_OK, "got 0x%08lx\n", hr);
+    names[0] = applesW;
+    hr = ICreateTypeInfo_SetFuncAndParamNames(cti, 1, names, 1);
+    ok(hr == S_OK, "got 0x%08lx\n", hr);
+
+    hr = ICreateTypeInfo_QueryInterface(cti, &IID_ITypeInfo, (void **)&ti);
+    ok(hr == S_OK, "got %08lx\n", hr);
+
+    /* names are case insensitive beyond ASCII too */
+    memid = 0xdeadbeef;
+    names[0] = applesUpperW;
+    hr = ITypeInfo_GetIDsOfNames(ti, names, 1, &memid);
+    ok(hr == S_OK, "got %08lx\n", hr);
+    ok(memid == 0x20, "got %#lx\n", memid);
+
+    memid = 0xdeadbeef;
+    names[0] = applesW;
+    hr = ITypeInfo_GetIDsOfNames(ti, names, 1, &memid);
+    ok(hr == S_OK, "got %08lx\n", hr);
+    ok(memid == 0x20, "got %#lx\n", memid);
+
+    ITypeInfo_Release(ti);
+    ICreateTypeInfo_Release(cti);
+    ICreateTypeLib2_Release(ctl);
+    DeleteFileA(filenameA);
+}
+
 static int WINAPI int_func( int a0, int a1, int a2, int a3, int a4 )
 {
     ok( a0 == 1, "wrong arg0 %x\n", a0 );
@@ -8553,6 +8627,7 @@ START_TEST(typelib)
     test_TypeComp();
     test_CreateDispTypeInfo();
     test_TypeInfo();
+    test_TypeInfo_names();
     test_DispCallFunc();
     test_QueryPathOfRegTypeLib(32);
     if(sizeof(void*) == 8){
@@ -1215,6 +1215,19 @@ typedef struct tagTLBImplType
     struct list custdata_list;
 } TLBImplType;
 
+/* hash index of the functions and variables by name and member id, entries
+ * 0 to cFuncs - 1 are the functions followed by the variables; built on the
+ * first lookup and discarded when the type info is modified */
+typedef struct tagTLBMemberIndex
+{
+    unsigned int mask;          /* number of buckets - 1 */
+    int *name_buckets;          /* first entry of each name hash chain */
+    int *name_next;             /* next entry with the same name hash */
+    int *memid_buckets;         /* first entry of each member id hash chain */
+    int *memid_next;            /* next entry with the same member id hash */
+    VARTYPE **param_vts;        /* variant types of the function parameters, for Invoke */
+} TLBMemberIndex;
+
 /* internal TypeInfo data */
 typedef struct tagITypeInfoImpl
 {
@@ -1251,6 +1264,8 @@ typedef struct tagITypeInfoImpl
     /* Implemented Interfaces  */
     TLBImplType *impltypes;
 
+    TLBMemberIndex *member_index;
+
     struct list *pcustdata_list;
     struct list custdata_list;
 } ITypeInfoImpl;
@@ -1666,13 +1681,159 @@ static BSTR TLB_MultiByteToBSTR(const char *ptr)
     return ret;
 }
 
+/* member names are hashed and compared with the same locale independent
+ * case folding, so that names which compare equal always share a hash chain */
+#define TLB_NAME_CHUNK 64
+
+static int TLB_fold_name(const OLECHAR *name, WCHAR *buffer)
+{
+    int len;
+
+    for (len = 0; len < TLB_NAME_CHUNK && name[len]; len++);
+    if (len) LCMapStringW(LOCALE_INVARIANT, LCMAP_LOWERCASE, name, len, buffer, len);
+    return len;
+}
+
+static unsigned int TLB_hash_name(const OLECHAR *name)
+{
+    unsigned int hash = 0;
+    WCHAR buffer[TLB_NAME_CHUNK];
+    int i, len;
+
+    if (!name) return 0;
+    while ((len = TLB_fold_name(name, buffer)))
+    {
+        for (i = 0; i < len; i++) hash = hash * 31 + buffer[i];
+        name += len;
+    }
+    return hash;
+}
+
+static BOOL TLB_name_equal(const OLECHAR *name1, const OLECHAR *name2)
+{
+    WCHAR buffer1[TLB_NAME_CHUNK], buffer2[TLB_NAME_CHUNK];
+    int len;
+
+    if (!name1 || !name2) return name1 == name2;
+    for (;;)
+    {
+        len = TLB_fold_name(name1, buffer1);
+        if (TLB_fold_name(name2, buffer2) != len) return FALSE;
+        if (!len) return TRUE;
+        if (memcmp(buffer1, buffer2, len * sizeof(WCHAR))) return FALSE;
+        name1 += len;
+        name2 += len;
+    }
+}
+
+static inline unsigned int TLB_hash_memid(MEMBERID memid)
+{
+    return memid ^ ((unsigned int)memid >> 16);
+}
+
+static TLBMemberIndex *TLB_get_member_index(ITypeInfoImpl *typeinfo)
+{
+    unsigned int i, size = 1, funcs = typeinfo->typeattr.cFuncs, count = funcs + typeinfo->typeattr.cVars;
+    TLBMemberIndex *index, *prev;
+
+    if ((index = typeinfo->member_index)) return index;
+
+    while (size < count) size <<= 1;
+    if (!(index = heap_alloc(sizeof(*index) + funcs * sizeof(VARTYPE *) + (2 * size + 2 * count) * sizeof(int))))
+        return NULL;
+
+    index->mask = size - 1;
+    index->param_vts = (VARTYPE **)(index + 1);
+    index->name_buckets = (int *)(index->param_vts + funcs);
+    index->name_next = index->name_buckets + size;
+    index->memid_buckets = index->name_next + count;
+    index->memid_next = index->memid_buckets + size;
+
+    memset(index->param_vts, 0, funcs * sizeof(VARTYPE *));
+    for (i = 0; i < size; i++) index->name_buckets[i] = index->memid_buckets[i] = -1;
+
+    /* insert backwards so that the chains are sorted by entry, like a linear scan */
+    for (i = count; i-- > 0;)
+    {
+        const TLBString *name;
+        MEMBERID memid;
+        unsigned int hash;
+
+        if (i < funcs)
+        {
+            name = typeinfo->funcdescs[i].Name;
+            memid = typeinfo->funcdescs[i].funcdesc.memid;
+        }
+        else
+        {
+            name = typeinfo->vardescs[i - funcs].Name;
+            memid = typeinfo->vardescs[i - funcs].vardesc.memid;
+        }
+        hash = TLB_hash_name(TLB_get_bstr(name)) & index->mask;
+        index->name_next[i] = index->name_buckets[hash];
+        index->name_buckets[hash] = i;
+        hash = TLB_hash_memid(memid) & index->mask;
+        index->memid_next[i] = index->memid_buckets[hash];
+        index->memid_buckets[hash] = i;
+    }
+
+    if ((prev = InterlockedCompareExchangePointer((void **)&typeinfo->member_index, index, NULL)))
+    {
+        heap_free(index);
+        return prev;
+    }
+    return index;
+}
+
+static void TLB_free_member_index(ITypeInfoImpl *typeinfo)
+{
+    TLBMemberIndex *index = typeinfo->member_index;
+    UINT i;
+
+    if (!index) return;
+    for (i = 0; i < typeinfo->typeattr.cFuncs; i++) heap_free(index->param_vts[i]);
+    heap_free(index);
+    typeinfo->member_index = NULL;
+}
+
+/* Iterate over the entries that may have the given member id or name. Without
+ * an index, which only happens on allocation failure, all entries are returned. */
+
+static int TLB_first_memid_entry(ITypeInfoImpl *typeinfo, MEMBERID memid)
+{
+    TLBMemberIndex *index = TLB_get_member_index(typeinfo);
+
+    if (index) return index->memid_buckets[TLB_hash_memid(memid) & index->mask];
+    return typeinfo->typeattr.cFuncs + typeinfo->typeattr.cVars ? 0 : -1;
+}
+
+static int TLB_next_memid_entry(ITypeInfoImpl *typeinfo, int entry)
+{
+    if (typeinfo->member_index) return typeinfo->member_index->memid_next[entry];
+    return entry + 1 < typeinfo->typeattr.cFuncs + typeinfo->typeattr.cVars ? entry + 1 : -1;
+}
+
+static int TLB_first_name_entry(ITypeInfoImpl *typeinfo, const OLECHAR *name)
+{
+    TLBMemberIndex *index = TLB_get_member_index(typeinfo);
+
+    if (index) return index->name_buckets[TLB_hash_name(name) & index->mask];
+    return typeinfo->typeattr.cFuncs + typeinfo->typeattr.cVars ? 0 : -1;
+}
+
+static int TLB_next_name_entry(ITypeInfoImpl *typeinfo, int entry)
+{
+    if (typeinfo->member_index) return typeinfo->member_index->name_next[entry];
+    return entry + 1 < typeinfo->typeattr.cFuncs + typeinfo->typeattr.cVars ? entry + 1 : -1;
+}
+
 static inline TLBFuncDesc *TLB_get_funcdesc_by_memberid(ITypeInfoImpl *typeinfo, MEMBERID memid)
 {
     int i;
 
-    for (i = 0; i < typeinfo->typeattr.cFuncs; ++i)
+    for (i = TLB_first_memid_entry(typeinfo, memid); i != -1; i = TLB_next_memid_entry(typeinfo, i))
     {
-        if (typeinfo->funcdescs[i].funcdesc.memid == memid)
+        if (i < typeinfo->typeattr.cFuncs && typeinfo->funcdescs[i].funcdesc.memid == memid)
             return &typeinfo->funcdescs[i];
     }
 
@@ -1683,9 +1844,10 @@ static inline TLBFuncDesc *TLB_get_funcdesc_by_memberid_invkind(ITypeInfoImpl *t
 {
     int i;
 
-    for (i = 0; i < typeinfo->typeattr.cFuncs; ++i)
+    for (i = TLB_first_memid_entry(typeinfo, memid); i != -1; i = TLB_next_memid_entry(typeinfo, i))
     {
-        if (typeinfo->funcdescs[i].funcdesc.memid == memid && typeinfo->funcdescs[i].funcdesc.invkind == invkind)
+        if (i < typeinfo->typeattr.cFuncs && typeinfo->funcdescs[i].funcdesc.memid == memid &&
+            typeinfo->funcdescs[i].funcdesc.invkind == invkind)
             return &typeinfo->funcdescs[i];
     }
 
@@ -1694,25 +1856,38 @@ static inline TLBFuncDesc *TLB_get_funcdesc_by_memberid_invkind(ITypeInfoImpl *t
 
 static inline TLBVarDesc *TLB_get_vardesc_by_memberid(ITypeInfoImpl *typeinfo, MEMBERID memid)
 {
-    int i;
+    int i, funcs = typeinfo->typeattr.cFuncs;
 
-    for (i = 0; i < typeinfo->typeattr.cVars; ++i)
+    for (i = TLB_first_memid_entry(typeinfo, memid); i != -1; i = TLB_next_memid_entry(typeinfo, i))
     {
-        if (typeinfo->vardescs[i].vardesc.memid == memid)
-            return &typeinfo->vardescs[i];
+        if (i >= funcs && typeinfo->vardescs[i - funcs].vardesc.memid == memid)
+            return &typeinfo->vardescs[i - funcs];
     }
 
     return NULL;
 }
 
 static inline TLBVarDesc *TLB_get_vardesc_by_name(ITypeInfoImpl *typeinfo, const OLECHAR *name)
+{
+    int i, funcs = typeinfo->typeattr.cFuncs;
+
+    for (i = TLB_first_name_entry(typeinfo, name); i != -1; i = TLB_next_name_entry(typeinfo, i))
+    {
+        if (i >= funcs && TLB_name_equal(TLB_get_bstr(typeinfo->vardescs[i - funcs].Name), name))
+            return &typeinfo->vardescs[i - funcs];
+    }
+
+    return NULL;
+}
+
+static inline TLBFuncDesc *TLB_get_funcdesc_by_name(ITypeInfoImpl *typeinfo, const OLECHAR *name)
 {
     int i;
 
-    for (i = 0; i < typeinfo->typeattr.cVars; ++i)
+    for (i = TLB_first_name_entry(typeinfo, name); i != -1; i = TLB_next_name_entry(typeinfo, i))
     {
-        if (!lstrcmpiW(TLB_get_bstr(typeinfo->vardescs[i].Name), name))
-            return &typeinfo->vardescs[i];
+        if (i < typeinfo->typeattr.cFuncs && TLB_name_equal(TLB_get_bstr(typeinfo->funcdescs[i].Name), name))
+            return &typeinfo->funcdescs[i];
     }
 
     return NULL;
@@ -5704,6 +5879,8 @@ static void ITypeInfoImpl_Destroy(ITypeInfoImpl *This)
 
     TRACE("destroying ITypeInfo(%p)\n",This);
 
+    TLB_free_member_index(This);
+
     for (i = 0; i < This->typeattr.cFuncs; ++i)
     {
         typeinfo_release_funcdesc(&This->funcdescs[i]);
@@ -5748,7 +5925,10 @@ static ULONG WINAPI ITypeInfo_fnRelease(ITypeInfo2 *iface)
         BOOL not_attached_to_typelib = This->not_attached_to_typelib;
         ITypeLib2_Release(&This->pTypeLib->ITypeLib2_iface);
         if (not_attached_to_typelib)
+        {
+            TLB_free_member_index(This);
             heap_free(This);
+        }
         /* otherwise This will be freed when typelib is freed */
     }
 
@@ -6373,9 +6553,10 @@ static HRESULT WINAPI ITypeInfo_fnGetIDsOfNames( ITypeInfo2 *iface,
         LPOLESTR  *rgszNames, UINT cNames, MEMBERID  *pMemId)
 {
     ITypeInfoImpl *This = impl_from_ITypeInfo2(iface);
+    const TLBFuncDesc *pFDesc;
     const TLBVarDesc *pVDesc;
     HRESULT ret=S_OK;
-    UINT i, fdc;
+    UINT i;
 
     TRACE("%p, %s, %d.\n", iface, debugstr_w(*rgszNames), cNames);
 
@@ -6383,23 +6564,21 @@ static HRESULT WINAPI ITypeInfo_fnGetIDsOfNames( ITypeInfo2 *iface,
     for (i = 0; i < cNames; i++)
         pMemId[i] = MEMBERID_NIL;
 
-    for (fdc = 0; fdc < This->typeattr.cFuncs; ++fdc) {
+    pFDesc = TLB_get_funcdesc_by_name(This, *rgszNames);
+    if (pFDesc) {
         int j;
-        const TLBFuncDesc *pFDesc = &This->funcdescs[fdc];
-        if(!lstrcmpiW(*rgszNames, TLB_get_bstr(pFDesc->Name))) {
-            if(cNames) *pMemId=pFDesc->funcdesc.memid;
-            for(i=1; i < cNames; i++){
-                for(j=0; j<pFDesc->funcdesc.cParams; j++)
-                    if(!lstrcmpiW(rgszNames[i],TLB_get_bstr(pFDesc->pParamDesc[j].Name)))
-                            break;
-                if( j<pFDesc->funcdesc.cParams)
-                    pMemId[i]=j;
-                else
-                   ret=DISP_E_UNKNOWNNAME;
-            };
-            TRACE("-- %#lx.\n", ret);
-            return ret;
-        }
+        if(cNames) *pMemId=pFDesc->funcdesc.memid;
+        for(i=1; i < cNames; i++){
+            for(j=0; j<pFDesc->funcdesc.cParams; j++)
+                if(!lstrcmpiW(rgszNames[i],TLB_get_bstr(pFDesc->pParamDesc[j].Name)))
+                        break;
+            if( j<pFDesc->funcdesc.cParams)
+                pMemId[i]=j;
+            else
+               ret=DISP_E_UNKNOWNNAME;
+        };
+        TRACE("-- %#lx.\n", ret);
+        return ret;
     }
     pVDesc = TLB_get_vardesc_by_name(This, *rgszNames);
     if(pVDesc){
@@ -7289,6 +7468,38 @@ static inline BOOL func_restricted( const FUNCDESC *desc )
 #define INVBUF_GET_ARG_TYPE_ARRAY(buffer, params) \
     ((VARTYPE *)((char *)(buffer) + (sizeof(VARIANTARG) + sizeof(VARIANTARG) + sizeof(VARIANTARG *)) * (params)))
 
+/* get the variant types of the parameters of a function, which need the
+ * referenced type infos to be resolved, and cache them in the member index */
+static HRESULT get_invoke_param_vts(ITypeInfoImpl *typeinfo, ITypeInfo *tinfo, int entry, VARTYPE *vts)
+{
+    const FUNCDESC *func_desc = &typeinfo->funcdescs[entry].funcdesc;
+    TLBMemberIndex *index = typeinfo->member_index;
+    VARTYPE *cached;
+    HRESULT hres;
+    int i;
+
+    if (index && (cached = index->param_vts[entry]))
+    {
+        memcpy(vts, cached, func_desc->cParams * sizeof(*vts));
+        return S_OK;
+    }
+
+    for (i = 0; i < func_desc->cParams; i++)
+    {
+        hres = typedescvt_to_variantvt(tinfo, &func_desc->lprgelemdescParam[i].tdesc, &vts[i]);
+        if (FAILED(hres))
+            return hres;
+    }
+
+    if (index && func_desc->cParams && (cached = heap_alloc(func_desc->cParams * sizeof(*vts))))
+    {
+        memcpy(cached, vts, func_desc->cParams * sizeof(*vts));
+        if (InterlockedCompareExchangePointer((void **)&index->param_vts[entry], cached, NULL))
+            heap_free(cached);
+    }
+    return S_OK;
+}
+
 static HRESULT WINAPI ITypeInfo_fnInvoke(
     ITypeInfo2 *iface,
     VOID  *pIUnk,
@@ -7305,7 +7516,7 @@ static HRESULT WINAPI ITypeInfo_fnInvoke(
     TYPEKIND type_kind;
     HRESULT hres;
     const TLBFuncDesc *pFuncInfo;
-    UINT fdc;
+    int entry;
 
     TRACE("%p, %p, %ld, %#x, %p, %p, %p, %p.\n", iface, pIUnk, memid, wFlags, pDispParams,
             pVarResult, pExcepInfo, pArgErr);
@@ -7330,15 +7541,16 @@ static HRESULT WINAPI ITypeInfo_fnInvoke(
 
     /* we do this instead of using GetFuncDesc since it will return a fake
      * FUNCDESC for dispinterfaces and we want the real function description */
-    for (fdc = 0; fdc < This->typeattr.cFuncs; ++fdc){
-        pFuncInfo = &This->funcdescs[fdc];
+    for (entry = TLB_first_memid_entry(This, memid); entry != -1; entry = TLB_next_memid_entry(This, entry)){
+        if (entry >= This->typeattr.cFuncs) continue;
+        pFuncInfo = &This->funcdescs[entry];
         if ((memid == pFuncInfo->funcdesc.memid) &&
             (wFlags & pFuncInfo->funcdesc.invkind) &&
             !func_restricted( &pFuncInfo->funcdesc ))
             break;
     }
 
-    if (fdc < This->typeattr.cFuncs) {
+    if (entry != -1) {
         const FUNCDESC *func_desc = &pFuncInfo->funcdesc;
 
         if (TRACE_ON(ole))
@@ -7381,13 +7593,9 @@ static HRESULT WINAPI ITypeInfo_fnInvoke(
                 goto func_fail;
             }
 
-            for (i = 0; i < func_desc->cParams; i++)
-            {
-                TYPEDESC *tdesc = &func_desc->lprgelemdescParam[i].tdesc;
-                hres = typedescvt_to_variantvt((ITypeInfo *)iface, tdesc, &rgvt[i]);
-                if (FAILED(hres))
-                    goto func_fail;
-            }
+            hres = get_invoke_param_vts(This, (ITypeInfo *)iface, entry, rgvt);
+            if (FAILED(hres))
+                goto func_fail;
 
             TRACE("changing args\n");
             for (i = 0; i < func_desc->cParams; i++)
@@ -7993,6 +8201,7 @@ static HRESULT WINAPI ITypeInfo_fnGetRefTypeInfo(
 
         *pTypeInfoImpl = *This;
         pTypeInfoImpl->ref = 0;
+        pTypeInfoImpl->member_index = NULL;
         list_init(&pTypeInfoImpl->custdata_list);
 
         if (This->typeattr.typekind == TKIND_INTERFACE)
@@ -10802,6 +11011,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnAddFuncDesc(ICreateTypeInfo2 *iface,
 
     TRACE("%p %u %p\n", This, index, funcDesc);
 
+    TLB_free_member_index(This);
+
     if (!funcDesc || funcDesc->oVft & 3)
         return E_INVALIDARG;
 
@@ -11039,6 +11250,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnAddVarDesc(ICreateTypeInfo2 *iface,
 
     TRACE("%p %u %p\n", This, index, varDesc);
 
+    TLB_free_member_index(This);
+
     if (This->vardescs){
         UINT i;
 
@@ -11082,6 +11295,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnSetFuncAndParamNames(ICreateTypeInfo2 *
 
     TRACE("%p %u %p %u\n", This, index, names, numNames);
 
+    TLB_free_member_index(This);
+
     if (!names)
         return E_INVALIDARG;
 
@@ -11123,6 +11338,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnSetVarName(ICreateTypeInfo2 *iface,
 
     TRACE("%p %u %s\n", This, index, wine_dbgstr_w(name));
 
+    TLB_free_member_index(This);
+
     if(!name)
         return E_INVALIDARG;
 
@@ -11270,6 +11487,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnLayOut(ICreateTypeInfo2 *iface)
 
     TRACE("%p\n", This);
 
+    TLB_free_member_index(This);
+
     This->needs_layout = FALSE;
 
     if (This->typeattr.typekind == TKIND_INTERFACE) {
@@ -11401,6 +11620,8 @@ static HRESULT WINAPI ICreateTypeInfo2_fnDeleteFuncDesc(ICreateTypeInfo2 *iface,
 
     TRACE("%p %u\n", This, index);
 
+    TLB_free_member_index(This);
+
     if (index >= This->typeattr.cFuncs)
         return TYPE_E_ELEMENTNOTFOUND;
 
@@ -468,6 +468,74 @@ static int rpcrt4_conn_np_wait_for_incoming_data(RpcConnection *conn)
     return rpcrt4_conn_np_read(conn, NULL, 0);
 }
 
+/* Each fragment is written to the ncalrpc pipe as a single message, so read
+ * the whole message at once instead of doing a pipe read for the common
+ * header, the rest of the header and the payload. */
+static RPC_STATUS rpcrt4_ncalrpc_receive_fragment(RpcConnection *conn, RpcPktHdr **Header, void **Payload)
+{
+    unsigned char buffer[RPC_MAX_PACKET_SIZE];
+    RpcPktCommonHdr *common_hdr = (RpcPktCommonHdr *)buffer;
+    DWORD hdr_length, data_length;
+    RPC_STATUS status;
+    LONG dwRead;
+
+    *Header = NULL;
+    *Payload = NULL;
+
+    TRACE("(%p, %p, %p)\n", conn, Header, Payload);
+
+    dwRead = rpcrt4_conn_np_read(conn, buffer, sizeof(buffer));
+    if (dwRead < (LONG)sizeof(*common_hdr))
+    {
+        WARN("Short read of header, %ld bytes\n", dwRead);
+        return RPC_S_CALL_FAILED;
+    }
+
+    status = RPCRT4_ValidateCommonHeader(common_hdr);
+    if (status != RPC_S_OK) return status;
+
+    hdr_length = RPCRT4_GetHeaderSize((RpcPktHdr *)common_hdr);
+    if (hdr_length == 0 || dwRead < hdr_length || dwRead > common_hdr->frag_len)
+    {
+        WARN("bad fragment, %ld bytes, hdr_length %ld, frag_len %u\n", dwRead, hdr_length, common_hdr->frag_len);
+        return RPC_S_PROTOCOL_ERROR;
+    }
+
+    if (!(*Header = malloc(hdr_length))) return RPC_S_OUT_OF_RESOURCES;
+    memcpy(*Header, buffer, hdr_length);
+
+    data_length = common_hdr->frag_len - hdr_length;
+    if (!data_length) return RPC_S_OK;
+
+    if (!(*Payload = malloc(data_length)))
+    {
+        status = RPC_S_OUT_OF_RESOURCES;
+        goto fail;
+    }
+    memcpy(*Payload, buffer + hdr_length, dwRead - hdr_length);
+
+    /* the message didn't fit in the buffer, read the rest of it */
+    if (dwRead < common_hdr->frag_len)
+    {
+        DWORD remaining = common_hdr->frag_len - dwRead;
+        LONG count = rpcrt4_conn_np_read(conn, (unsigned char *)*Payload + dwRead - hdr_length, remaining);
+        if (count != remaining)
+        {
+            WARN("bad data length, %ld/%ld\n", count, remaining);
+            status = RPC_S_CALL_FAILED;
+            goto fail;
+        }
+    }
+    return RPC_S_OK;
+
+fail:
+    free(*Header);
+    *Header = NULL;
+    free(*Payload);
+    *Payload = NULL;
+    return status;
+}
+
 static size_t rpcrt4_ncacn_np_get_top_of_tower(unsigned char *tower_data,
                                                const char *networkaddr,
                                                const char *endpoint)
@@ -3154,7 +3222,7 @@ static const struct connection_ops conn_protseq_list[] = {
     rpcrt4_conn_np_wait_for_incoming_data,
     rpcrt4_ncalrpc_get_top_of_tower,
     rpcrt4_ncalrpc_parse_top_of_tower,
-    NULL,
+    rpcrt4_ncalrpc_receive_fragment,
     rpcrt4_ncalrpc_is_authorized,
     rpcrt4_ncalrpc_authorize,
     rpcrt4_ncalrpc_secure_packet,
@@ -30,6 +30,12 @@
 
 #include "tomcrypt.h"
 
+#include "wine/cpuid.h"
+
+#ifdef WINE_X86_CRYPTO_EXTENSIONS
+#define USE_AES_NI
+#endif
+
 static const ulong32 TE0[256] = {
     0xc66363a5UL, 0xf87c7c84UL, 0xee777799UL, 0xf67b7b8dUL,
     0xfff2f20dUL, 0xd66b6bbdUL, 0xde6f6fb1UL, 0x91c5c554UL,
@@ -926,6 +932,38 @@ static const ulong32 rcon[] = {
     0x1B000000UL, 0x36000000UL
 };
 
+#ifdef USE_AES_NI
+
+static void __attribute__((target("aes,sse2")))
+aes_ni_encrypt(const unsigned char *pt, unsigned char *ct, const aes_key *skey)
+{
+   const __m128i *rk = (const __m128i *)skey->ni_eK;
+   __m128i s;
+   int r;
+
+   s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pt), _mm_loadu_si128(rk));
+   for (r = 1; r < skey->Nr; r++)
+      s = _mm_aesenc_si128(s, _mm_loadu_si128(rk + r));
+   s = _mm_aesenclast_si128(s, _mm_loadu_si128(rk + r));
+   _mm_storeu_si128((__m128i *)ct, s);
+}
+
+static void __attribute__((target("aes,sse2")))
+aes_ni_decrypt(const unsigned char *ct, unsigned char *pt, const aes_key *skey)
+{
+   const __m128i *rk = (const __m128i *)skey->ni_dK;
+   __m128i s;
+   int r;
+
+   s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)ct), _mm_loadu_si128(rk));
+   for (r = 1; r < skey->Nr; r++)
+      s = _mm_aesdec_si128(s, _mm_loadu_si128(rk + r));
+   s = _mm_aesdeclast_si128(s, _mm_loadu_si128(rk + r));
+   _mm_storeu_si128((__m128i *)pt, s);
+}
+
+#endif /* USE_AES_NI */
+
 static ulong32 setup_mix(ulong32 temp)
 {
    return (Te4_3[byte(temp, 2)]) ^
@@ -1058,6 +1096,13 @@ int aes_setup(const unsigned char *key, int keylen, int rounds, aes_key *skey)
     *rk++ = *rrk++;
     *rk   = *rrk;
 
+    /* dK already holds the equivalent inverse cipher schedule that aesdec
+     * expects, so both schedules only need converting to byte order. */
+    for (i = 0; i < (skey->Nr + 1) * 4; i++) {
+        STORE32H(skey->eK[i], skey->ni_eK + 4 * i);
+        STORE32H(skey->dK[i], skey->ni_dK + 4 * i);
+    }
+
     return CRYPT_OK;
 }
 
@@ -1066,6 +1111,13 @@ void aes_ecb_encrypt(const unsigned char *pt, unsigned char *ct, aes_key *skey)
     ulong32 s0, s1, s2, s3, t0, t1, t2, t3, *rk;
     int Nr, r;
 
+#ifdef USE_AES_NI
+    if (wine_x86_crypto_features() & WINE_X86_FEATURE_AES_NI) {
+        aes_ni_encrypt(pt, ct, skey);
+        return;
+    }
+#endif
+
     Nr = skey->Nr;
     rk = skey->eK;
 
@@ -1167,6 +1219,13 @@ void aes_ecb_decrypt(const unsigned char *ct, unsigned char *pt, aes_key *skey)
     ulong32 s0, s1, s2, s3, t0, t1, t2, t3, *rk;
     int Nr, r;
 
+#ifdef USE_AES_NI
+    if (wine_x86_crypto_features() & WINE_X86_FEATURE_AES_NI) {
+        aes_ni_decrypt(ct, pt, skey);
+        return;
+    }
+#endif
+
     Nr = skey->Nr;
     rk = skey->dK;
 
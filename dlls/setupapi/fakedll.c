@@ -33,7 +33,9 @@
 #include "winuser.h"
 #include "winnt.h"
 #include "winternl.h"
+#include "winioctl.h"
 #include "wine/debug.h"
+#include "wine/fsctl.h"
 #include "wine/list.h"
 #include "ole2.h"
 #include "atliface.h"
@@ -205,6 +207,12 @@ static void extract_16bit_image( IMAGE_NT_HEADERS *nt, void **data, SIZE_T *size
     }
 }
 
+/* 16-bit builtins are stored inside a 32-bit dll, with a "16" suffix */
+static inline BOOL is_16bit_source( const WCHAR *name )
+{
+    return lstrlenW(name) > 2 && !wcscmp( name + lstrlenW(name) - 2, L"16" );
+}
+
 /* read in the contents of a file into the global file buffer */
 /* return 1 on success, 0 on nonexistent file, -1 on other error */
 static int read_file( const WCHAR *name, void **data, SIZE_T *size )
@@ -253,8 +261,7 @@ static int read_file( const WCHAR *name, void **data, SIZE_T *size )
               st.st_size - header_size ) == st.st_size - header_size)
     {
         *data = file_buffer;
-        if (lstrlenW(name) > 2 && !wcscmp( name + lstrlenW(name) - 2, L"16" ))
-            extract_16bit_image( nt, data, size );
+        if (is_16bit_source( name )) extract_16bit_image( nt, data, size );
         ret = 1;
     }
 done:
@@ -429,8 +436,8 @@ static const WCHAR *enum_load_path( unsigned int idx )
     return _wgetenv( buffer );
 }
 
-/* try to load a pre-compiled fake dll */
-static void *load_fake_dll( const WCHAR *name, SIZE_T *size )
+/* try to load a pre-compiled fake dll, returning the file it was found in */
+static void *load_fake_dll( const WCHAR *name, SIZE_T *size, WCHAR **source )
 {
     const WCHAR *build_dir = _wgetenv( L"WINEBUILDDIR" );
     const WCHAR *path;
@@ -478,8 +485,13 @@ static void *load_fake_dll( const WCHAR *name, SIZE_T *size )
     }
 
 done:
+    if (res == 1)
+    {
+        memmove( file, ptr, (lstrlenW(ptr) + 1) * sizeof(WCHAR) );
+        *source = file;
+        return data;
+    }
     HeapFree( GetProcessHeap(), 0, file );
-    if (res == 1) return data;
     return NULL;
 }
 
@@ -517,6 +529,48 @@ static HANDLE create_dest_file( const WCHAR *name, BOOL delete )
     return h;
 }
 
+/* copy the contents of the source file inside the kernel; this shares the
+ * data blocks with the source when the file system supports reflinks */
+static BOOL copy_source_file( HANDLE dest, const WCHAR *source, SIZE_T size )
+{
+    struct copy_file_range_params params;
+    IO_STATUS_BLOCK io;
+    HANDLE h;
+    SIZE_T copied = 0;
+
+    h = CreateFileW( source, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL );
+    if (h == INVALID_HANDLE_VALUE) return FALSE;
+
+    params.source = HandleToULong( h );
+    params.padding = 0;
+    while (copied < size)
+    {
+        params.source_offset.QuadPart = params.target_offset.QuadPart = copied;
+        params.length = size - copied;
+        if (NtFsControlFile( dest, NULL, NULL, NULL, &io, FSCTL_WINE_COPY_FILE_RANGE,
+                             &params, sizeof(params), NULL, 0 ) || !io.Information)
+            break;
+        copied += io.Information;
+    }
+    CloseHandle( h );
+    if (copied == size) return TRUE;
+    TRACE( "failed to copy %s, falling back to writing the file\n", debugstr_w(source) );
+    SetFilePointer( dest, 0, NULL, FILE_BEGIN );
+    SetEndOfFile( dest );
+    return FALSE;
+}
+
+/* write the fake dll data, copied from source if it's the whole source file */
+static BOOL write_fake_dll( HANDLE h, const WCHAR *name, const WCHAR *source, const void *data, SIZE_T size )
+{
+    DWORD written;
+
+    if (source && !is_16bit_source( source ) && copy_source_file( h, source, size )) return TRUE;
+    if (WriteFile( h, data, size, &written, NULL ) && written == size) return TRUE;
+    ERR( "failed to write to %s (error=%lu)\n", debugstr_w(name), GetLastError() );
+    return FALSE;
+}
+
 /* XML parsing code copied from ntdll */
 
 typedef struct
@@ -893,7 +947,6 @@ static int install_fake_dll( WCHAR *dest, WCHAR *file, BOOL delete, struct list
     int ret;
     SIZE_T size;
     void *data;
-    DWORD written;
     WCHAR *destname = dest + lstrlenW(dest);
     WCHAR *name = wcsrchr( file, '\\' ) + 1;
     WCHAR *end = name + lstrlenW(name);
@@ -918,8 +971,7 @@ static int install_fake_dll( WCHAR *dest, WCHAR *file, BOOL delete, struct list
         {
             TRACE( "%s -> %s\n", debugstr_w(file), debugstr_w(dest) );
 
-            ret = (WriteFile( h, data, size, &written, NULL ) && written == size);
-            if (!ret) ERR( "failed to write to %s (error=%lu)\n", debugstr_w(dest), GetLastError() );
+            ret = write_fake_dll( h, dest, file, data, size );
             CloseHandle( h );
             if (ret) register_fake_dll( dest, data, size, delay_copy );
             else DeleteFileW( dest );
@@ -933,7 +985,6 @@ static int install_fake_dll( WCHAR *dest, WCHAR *file, BOOL delete, struct list
 static void delay_copy_files( struct list *delay_copy )
 {
     struct delay_copy *copy, *next;
-    DWORD written;
     SIZE_T size;
     void *data;
     HANDLE h;
@@ -952,8 +1003,7 @@ static void delay_copy_files( struct list *delay_copy )
         h = create_dest_file( copy->dest, FALSE );
         if (h && h != INVALID_HANDLE_VALUE)
         {
-            ret = (WriteFile( h, data, size, &written, NULL ) && written == size);
-            if (!ret) ERR( "failed to write to %s (error=%lu)\n", debugstr_w(copy->dest), GetLastError() );
+            ret = write_fake_dll( h, copy->dest, copy->src, data, size );
             CloseHandle( h );
             if (!ret) DeleteFileW( copy->dest );
         }
@@ -1053,6 +1103,7 @@ BOOL create_fake_dll( const WCHAR *name, const WCHAR *source )
     BOOL ret;
     SIZE_T size;
     const WCHAR *filename;
+    WCHAR *file;
     void *buffer;
     BOOL delete = !wcscmp( source, L"-" );  /* '-' source means delete the file */
 
@@ -1072,13 +1123,11 @@ BOOL create_fake_dll( const WCHAR *name, const WCHAR *source )
     if (!(h = create_dest_file( name, delete ))) return TRUE;  /* not a fake dll */
     if (h == INVALID_HANDLE_VALUE) return FALSE;
 
-    if ((buffer = load_fake_dll( source, &size )))
+    if ((buffer = load_fake_dll( source, &size, &file )))
     {
-        DWORD written;
-
-        ret = (WriteFile( h, buffer, size, &written, NULL ) && written == size);
+        ret = write_fake_dll( h, name, file, buffer, size );
         if (ret) register_fake_dll( name, buffer, size, &delay_copy );
-        else ERR( "failed to write to %s (error=%lu)\n", debugstr_w(name), GetLastError() );
+        HeapFree( GetProcessHeap(), 0, file );
     }
     else
     {
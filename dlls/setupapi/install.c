@@ -57,6 +57,15 @@ struct registry_callback_info
     BOOL delete;
 };
 
+/* a RegisterDlls entry queued for registration on worker threads */
+struct register_dll_entry
+{
+    WCHAR              *path;
+    INT                 flags;
+    INT                 timeout;
+    HMODULE             module;
+};
+
 /* info passed to callback functions dealing with registering dlls */
 struct register_dll_info
 {
@@ -66,8 +75,15 @@ struct register_dll_info
     int                 modules_size;
     int                 modules_count;
     HMODULE            *modules;
+    BOOL                parallel;
+    int                 batch_size;
+    int                 batch_count;
+    LONG                batch_next;
+    struct register_dll_entry *batch;
 };
 
+#define MAX_REGISTER_THREADS 8
+
 typedef BOOL (*iterate_fields_func)( HINF hinf, PCWSTR field, void *arg );
 
 
@@ -505,44 +521,24 @@ static BOOL registry_callback( HINF hinf, PCWSTR field, void *arg )
 
 
 /***********************************************************************
- *            do_register_dll
+ *            register_dll
  *
- * Register or unregister a dll.
+ * Load a dll and call its registration entry points, or run an executable
+ * with its registration command line. Returns the loaded module, if any.
  */
-static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
-                             INT flags, INT timeout, const WCHAR *args )
+static HMODULE register_dll( BOOL unregister, const WCHAR *path, INT flags, INT timeout,
+                             const WCHAR *args, SP_REGISTER_CONTROL_STATUSW *status )
 {
     HMODULE module;
     HRESULT res;
-    SP_REGISTER_CONTROL_STATUSW status;
     IMAGE_NT_HEADERS *nt;
 
-    status.cbSize = sizeof(status);
-    status.FileName = path;
-    status.FailureCode = SPREG_SUCCESS;
-    status.Win32Error = ERROR_SUCCESS;
-
-    if (info->callback)
-    {
-        switch(info->callback( info->callback_context, SPFILENOTIFY_STARTREGISTRATION,
-                               (UINT_PTR)&status, !info->unregister ))
-        {
-        case FILEOP_ABORT:
-            SetLastError( ERROR_OPERATION_ABORTED );
-            return FALSE;
-        case FILEOP_SKIP:
-            return TRUE;
-        case FILEOP_DOIT:
-            break;
-        }
-    }
-
     if (!(module = LoadLibraryExW( path, 0, LOAD_WITH_ALTERED_SEARCH_PATH )))
     {
         WARN( "could not load %s\n", debugstr_w(path) );
-        status.FailureCode = SPREG_LOADLIBRARY;
-        status.Win32Error = GetLastError();
-        goto done;
+        status->FailureCode = SPREG_LOADLIBRARY;
+        status->Win32Error = GetLastError();
+        return NULL;
     }
 
     if ((nt = RtlImageNtHeader( module )) && !(nt->FileHeader.Characteristics & IMAGE_FILE_DLL))
@@ -555,7 +551,6 @@ static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
         DWORD len;
 
         FreeLibrary( module );
-        module = NULL;
         if (!args) args = L"/RegServer";
         len = lstrlenW(path) + lstrlenW(args) + 4;
         cmd_line = HeapAlloc( GetProcessHeap(), 0, len * sizeof(WCHAR) );
@@ -567,9 +562,9 @@ static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
         HeapFree( GetProcessHeap(), 0, cmd_line );
         if (!res)
         {
-            status.FailureCode = SPREG_LOADLIBRARY;
-            status.Win32Error = GetLastError();
-            goto done;
+            status->FailureCode = SPREG_LOADLIBRARY;
+            status->Win32Error = GetLastError();
+            return NULL;
         }
         CloseHandle( process_info.hThread );
 
@@ -577,23 +572,23 @@ static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
         {
             /* timed out, kill the process */
             TerminateProcess( process_info.hProcess, 1 );
-            status.FailureCode = SPREG_TIMEOUT;
-            status.Win32Error = ERROR_TIMEOUT;
+            status->FailureCode = SPREG_TIMEOUT;
+            status->Win32Error = ERROR_TIMEOUT;
         }
         CloseHandle( process_info.hProcess );
-        goto done;
+        return NULL;
     }
 
     if (flags & FLG_REGSVR_DLLREGISTER)
     {
-        const char *entry_point = info->unregister ? "DllUnregisterServer" : "DllRegisterServer";
+        const char *entry_point = unregister ? "DllUnregisterServer" : "DllRegisterServer";
         HRESULT (WINAPI *func)(void) = (void *)GetProcAddress( module, entry_point );
 
         if (!func)
         {
-            status.FailureCode = SPREG_GETPROCADDR;
-            status.Win32Error = GetLastError();
-            goto done;
+            status->FailureCode = SPREG_GETPROCADDR;
+            status->Win32Error = GetLastError();
+            return module;
         }
 
         TRACE( "calling %s in %s\n", entry_point, debugstr_w(path) );
@@ -602,9 +597,9 @@ static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
         if (FAILED(res))
         {
             WARN( "calling %s in %s returned error %lx\n", entry_point, debugstr_w(path), res );
-            status.FailureCode = SPREG_REGSVR;
-            status.Win32Error = res;
-            goto done;
+            status->FailureCode = SPREG_REGSVR;
+            status->Win32Error = res;
+            return module;
         }
     }
 
@@ -614,48 +609,179 @@ static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
 
         if (!func)
         {
-            status.FailureCode = SPREG_GETPROCADDR;
-            status.Win32Error = GetLastError();
-            goto done;
+            status->FailureCode = SPREG_GETPROCADDR;
+            status->Win32Error = GetLastError();
+            return module;
         }
 
         TRACE( "calling DllInstall(%d,%s) in %s\n",
-               !info->unregister, debugstr_w(args), debugstr_w(path) );
-        res = func( !info->unregister, args );
+               !unregister, debugstr_w(args), debugstr_w(path) );
+        res = func( !unregister, args );
 
         if (FAILED(res))
         {
             WARN( "calling DllInstall in %s returned error %lx\n", debugstr_w(path), res );
-            status.FailureCode = SPREG_REGSVR;
-            status.Win32Error = res;
-            goto done;
+            status->FailureCode = SPREG_REGSVR;
+            status->Win32Error = res;
+            return module;
         }
     }
+    return module;
+}
 
-done:
-    if (module)
+
+/***********************************************************************
+ *            add_registered_module
+ *
+ * Keep a registered module loaded until the whole section is processed.
+ */
+static void add_registered_module( struct register_dll_info *info, HMODULE module )
+{
+    if (!module) return;
+    if (info->modules_count >= info->modules_size)
+    {
+        int new_size = max( 32, info->modules_size * 2 );
+        HMODULE *new = info->modules ?
+            HeapReAlloc( GetProcessHeap(), 0, info->modules, new_size * sizeof(*new) ) :
+            HeapAlloc( GetProcessHeap(), 0, new_size * sizeof(*new) );
+        if (new)
+        {
+            info->modules_size = new_size;
+            info->modules = new;
+        }
+    }
+    if (info->modules_count < info->modules_size) info->modules[info->modules_count++] = module;
+    else FreeLibrary( module );
+}
+
+
+/***********************************************************************
+ *            do_register_dll
+ *
+ * Register or unregister a dll.
+ */
+static BOOL do_register_dll( struct register_dll_info *info, const WCHAR *path,
+                             INT flags, INT timeout, const WCHAR *args )
+{
+    SP_REGISTER_CONTROL_STATUSW status;
+
+    status.cbSize = sizeof(status);
+    status.FileName = path;
+    status.FailureCode = SPREG_SUCCESS;
+    status.Win32Error = ERROR_SUCCESS;
+
+    if (info->callback)
     {
-        if (info->modules_count >= info->modules_size)
+        switch(info->callback( info->callback_context, SPFILENOTIFY_STARTREGISTRATION,
+                               (UINT_PTR)&status, !info->unregister ))
         {
-            int new_size = max( 32, info->modules_size * 2 );
-            HMODULE *new = info->modules ?
-                HeapReAlloc( GetProcessHeap(), 0, info->modules, new_size * sizeof(*new) ) :
-                HeapAlloc( GetProcessHeap(), 0, new_size * sizeof(*new) );
-            if (new)
-            {
-                info->modules_size = new_size;
-                info->modules = new;
-            }
+        case FILEOP_ABORT:
+            SetLastError( ERROR_OPERATION_ABORTED );
+            return FALSE;
+        case FILEOP_SKIP:
+            return TRUE;
+        case FILEOP_DOIT:
+            break;
         }
-        if (info->modules_count < info->modules_size) info->modules[info->modules_count++] = module;
-        else FreeLibrary( module );
     }
+
+    add_registered_module( info, register_dll( info->unregister, path, flags, timeout, args, &status ));
+
     if (info->callback) info->callback( info->callback_context, SPFILENOTIFY_ENDREGISTRATION,
                                         (UINT_PTR)&status, !info->unregister );
     return TRUE;
 }
 
 
+/***********************************************************************
+ *            register_dll_thread
+ *
+ * Worker thread registering the queued dlls.
+ */
+static DWORD WINAPI register_dll_thread( void *arg )
+{
+    struct register_dll_info *info = arg;
+    SP_REGISTER_CONTROL_STATUSW status;
+    struct register_dll_entry *entry;
+    HRESULT hr = CoInitialize( NULL );
+    LONG i;
+
+    while ((i = InterlockedIncrement( &info->batch_next ) - 1) < info->batch_count)
+    {
+        entry = &info->batch[i];
+        entry->module = register_dll( info->unregister, entry->path, entry->flags, entry->timeout,
+                                      NULL, &status );
+    }
+    if (SUCCEEDED(hr)) CoUninitialize();
+    return 0;
+}
+
+
+/***********************************************************************
+ *            flush_register_dll_batch
+ *
+ * Register the queued dlls on a few worker threads, and wait for them.
+ */
+static void flush_register_dll_batch( struct register_dll_info *info )
+{
+    HANDLE threads[MAX_REGISTER_THREADS - 1];
+    SYSTEM_INFO si;
+    unsigned int i, count = 0, max_threads;
+
+    if (!info->batch_count) return;
+
+    GetSystemInfo( &si );
+    max_threads = min( min( si.dwNumberOfProcessors, MAX_REGISTER_THREADS ), info->batch_count );
+    info->batch_next = 0;
+    TRACE( "registering %u dlls on %u threads\n", info->batch_count, max_threads );
+
+    /* the current thread takes its share of the work too */
+    while (count < max_threads - 1)
+    {
+        if (!(threads[count] = CreateThread( NULL, 0, register_dll_thread, info, 0, NULL ))) break;
+        count++;
+    }
+    register_dll_thread( info );
+    WaitForMultipleObjects( count, threads, TRUE, INFINITE );
+    for (i = 0; i < count; i++) CloseHandle( threads[i] );
+
+    for (i = 0; i < info->batch_count; i++)
+    {
+        add_registered_module( info, info->batch[i].module );
+        HeapFree( GetProcessHeap(), 0, info->batch[i].path );
+    }
+    info->batch_count = 0;
+}
+
+
+/***********************************************************************
+ *            queue_register_dll
+ *
+ * Queue a dll for registration on worker threads. The path is taken over.
+ */
+static BOOL queue_register_dll( struct register_dll_info *info, WCHAR *path, INT flags, INT timeout )
+{
+    struct register_dll_entry *entry;
+
+    if (info->batch_count >= info->batch_size)
+    {
+        int new_size = max( 32, info->batch_size * 2 );
+        struct register_dll_entry *new = info->batch ?
+            HeapReAlloc( GetProcessHeap(), 0, info->batch, new_size * sizeof(*new) ) :
+            HeapAlloc( GetProcessHeap(), 0, new_size * sizeof(*new) );
+        if (!new) return FALSE;
+        info->batch_size = new_size;
+        info->batch = new;
+    }
+    entry = &info->batch[info->batch_count++];
+    entry->path = path;
+    entry->flags = flags;
+    entry->timeout = timeout;
+    entry->module = NULL;
+    return TRUE;
+}
+
+
 /***********************************************************************
  *            register_dlls_callback
  *
@@ -698,12 +824,23 @@ static BOOL register_dlls_callback( HINF hinf, PCWSTR field, void *arg )
         if (SetupGetStringFieldW( &context, 6, buffer, ARRAY_SIZE( buffer ), NULL ))
             args = buffer;
 
+        /* if the section allows it, plain DllRegisterServer calls are done in parallel,
+         * unless the caller wants to be notified; DllInstall and custom command lines
+         * wait for them and are called in order
+         */
+        if (info->parallel && !info->callback && flags == FLG_REGSVR_DLLREGISTER && !args &&
+            queue_register_dll( info, path, flags, timeout ))
+            continue;
+
+        flush_register_dll_batch( info );
         ret = do_register_dll( info, path, flags, timeout, args );
 
     done:
         HeapFree( GetProcessHeap(), 0, path );
         if (!ret) break;
     }
+    /* the dlls of a section are done before moving on to the next one */
+    flush_register_dll_batch( info );
     return ret;
 }
 
@@ -1116,6 +1253,8 @@ BOOL WINAPI SetupInstallFromInfSectionW( HWND owner, HINF hinf, PCWSTR section,
     if (flags & SPINST_REGSVR)
     {
         struct register_dll_info info = { .unregister = FALSE };
+        INFCONTEXT parallel_context;
+        INT parallel;
         HRESULT hr;
 
         if (flags & SPINST_REGISTERCALLBACKAWARE)
@@ -1124,6 +1263,11 @@ BOOL WINAPI SetupInstallFromInfSectionW( HWND owner, HINF hinf, PCWSTR section,
             info.callback_context = context;
         }
 
+        /* Wine extension: register the dlls of each RegisterDlls section in parallel */
+        if (SetupFindFirstLineW( hinf, section, L"WineRegisterDllsParallel", &parallel_context ) &&
+            SetupGetIntField( &parallel_context, 1, &parallel ))
+            info.parallel = !!parallel;
+
         hr = CoInitialize(NULL);
 
         ret = iterate_section_fields( hinf, section, L"RegisterDlls", register_dlls_callback, &info );
@@ -1133,6 +1277,7 @@ BOOL WINAPI SetupInstallFromInfSectionW( HWND owner, HINF hinf, PCWSTR section,
             CoUninitialize();
 
         HeapFree( GetProcessHeap(), 0, info.modules );
+        HeapFree( GetProcessHeap(), 0, info.batch );
         if (!ret) return FALSE;
     }
     if (flags & SPINST_UNREGSVR)
@@ -1155,6 +1300,7 @@ BOOL WINAPI SetupInstallFromInfSectionW( HWND owner, HINF hinf, PCWSTR section,
             CoUninitialize();
 
         HeapFree( GetProcessHeap(), 0, info.modules );
+        HeapFree( GetProcessHeap(), 0, info.batch );
         if (!ret) return FALSE;
     }
     if (flags & SPINST_REGISTRY)
@@ -26,10 +26,15 @@
 
 #include <limits.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "ntstatus.h"
 #define WIN32_NO_STATUS
@@ -49,6 +54,7 @@ WINE_DEFAULT_DEBUG_CHANNEL(font);
 
 static HKEY wine_fonts_key;
 static HKEY wine_fonts_cache_key;
+static BOOL font_index_deferred;
 HKEY hkcu_key;
 
 struct font_physdev
@@ -198,6 +204,7 @@ static struct font_gamma_ramp font_gamma_ramp;
 
 static void add_face_to_cache( struct gdi_font_face *face );
 static void remove_face_from_cache( struct gdi_font_face *face );
+static void invalidate_font_index(void);
 
 static CPTABLEINFO utf8_cp;
 static CPTABLEINFO oem_cp;
@@ -1384,6 +1391,7 @@ static void add_face_to_cache( struct gdi_font_face *face )
 
     if (hkey_face != hkey_family) NtClose( hkey_face );
     NtClose( hkey_family );
+    invalidate_font_index();
 }
 
 static void remove_face_from_cache( struct gdi_font_face *face )
@@ -1409,6 +1417,322 @@ static void remove_face_from_cache( struct gdi_font_face *face )
     else reg_delete_value( hkey_family, face->style_name );
 
     NtClose( hkey_family );
+    invalidate_font_index();
+}
+
+/* font index file
+ *
+ * Binary snapshot of the registry font cache, shared read-only by all the processes of the
+ * prefix so that they don't need to enumerate the cache keys through the server at startup.
+ * It is tagged with a serial that is also stored in the volatile cache key, and that changes
+ * every time the cache is modified, so a stale index is never used.
+ */
+
+#define FONT_INDEX_MAGIC    0x58444946  /* "FIDX" */
+#define FONT_INDEX_VERSION  1
+
+static const WCHAR font_index_serialW[] = {'I','n','d','e','x','S','e','r','i','a','l',0};
+
+struct font_index_header
+{
+    DWORD magic;
+    DWORD version;
+    DWORD size;           /* total size of the file */
+    DWORD families;       /* number of family records */
+    DWORD serial[4];      /* must match the cache key serial */
+};
+
+struct font_index_family
+{
+    DWORD size;           /* size of the record, not including the face records */
+    DWORD faces;          /* number of face records that follow */
+    WCHAR names[1];       /* family name, second name */
+};
+
+struct font_index_face
+{
+    DWORD                   size;
+    DWORD                   index;
+    DWORD                   flags;
+    DWORD                   ntmflags;
+    DWORD                   version;
+    DWORD                   scalable;
+    struct bitmap_font_size bitmap_size;
+    FONTSIGNATURE           fs;
+    WCHAR                   names[1];  /* style name, full name, file name */
+};
+
+struct font_index_buffer
+{
+    char  *data;
+    DWORD  size;
+    DWORD  alloc;
+};
+
+static char *get_font_index_path(void)
+{
+    static const char name[] = "/fontindex.dat";
+    const char *dir = ntdll_get_config_dir();
+    char *path;
+
+    if (!dir || !(path = malloc( strlen( dir ) + sizeof(name) ))) return NULL;
+    strcpy( path, dir );
+    strcat( path, name );
+    return path;
+}
+
+static BOOL get_font_index_serial( DWORD serial[4] )
+{
+    char buffer[FIELD_OFFSET(KEY_VALUE_PARTIAL_INFORMATION, Data[4 * sizeof(DWORD)])];
+    KEY_VALUE_PARTIAL_INFORMATION *info = (void *)buffer;
+
+    if (query_reg_value( wine_fonts_cache_key, font_index_serialW, info, sizeof(buffer) ) != 4 * sizeof(DWORD) ||
+        info->Type != REG_BINARY)
+        return FALSE;
+    memcpy( serial, info->Data, 4 * sizeof(DWORD) );
+    return TRUE;
+}
+
+static void set_font_index_serial( DWORD serial[4] )
+{
+    static LONG counter;
+    LARGE_INTEGER now;
+
+    NtQuerySystemTime( &now );
+    serial[0] = now.u.LowPart;
+    serial[1] = now.u.HighPart;
+    serial[2] = GetCurrentProcessId();
+    serial[3] = InterlockedIncrement( &counter );
+    set_reg_value( wine_fonts_cache_key, font_index_serialW, REG_BINARY, serial, 4 * sizeof(DWORD) );
+}
+
+/* the cache has been modified, the index needs to be rebuilt */
+static void invalidate_font_index(void)
+{
+    DWORD serial[4];
+
+    if (!wine_fonts_cache_key || font_index_deferred) return;
+    set_font_index_serial( serial );
+}
+
+static void *append_font_index_record( struct font_index_buffer *buffer, DWORD size )
+{
+    void *ret;
+
+    size = (size + 3) & ~3;
+    if (buffer->size + size > buffer->alloc)
+    {
+        DWORD new_alloc = max( buffer->alloc * 2, buffer->size + size );
+        char *new_data;
+
+        if (!(new_data = realloc( buffer->data, new_alloc ))) return NULL;
+        buffer->data = new_data;
+        buffer->alloc = new_alloc;
+    }
+    ret = buffer->data + buffer->size;
+    memset( ret, 0, size );
+    buffer->size += size;
+    return ret;
+}
+
+static WCHAR *append_index_string( WCHAR *ptr, const WCHAR *str )
+{
+    DWORD len = lstrlenW( str ) + 1;
+    memcpy( ptr, str, len * sizeof(WCHAR) );
+    return ptr + len;
+}
+
+static BOOL add_family_to_font_index( struct font_index_buffer *buffer, const struct gdi_font_family *family,
+                                      DWORD *families )
+{
+    const struct gdi_font_face *face;
+    struct font_index_family *rec;
+    struct font_index_face *face_rec;
+    DWORD size, offset, count = 0;
+    WCHAR *ptr;
+
+    LIST_FOR_EACH_ENTRY( face, &family->faces, struct gdi_font_face, entry )
+        if (face->flags & ADDFONT_ADD_TO_CACHE) count++;
+    if (!count) return TRUE;
+
+    size = offsetof( struct font_index_family, names[lstrlenW( family->family_name ) +
+                                                     lstrlenW( family->second_name ) + 2] );
+    offset = buffer->size;
+    if (!(rec = append_font_index_record( buffer, size ))) return FALSE;
+    rec->size = buffer->size - offset;
+    rec->faces = count;
+    (*families)++;
+    ptr = append_index_string( rec->names, family->family_name );
+    append_index_string( ptr, family->second_name );
+
+    LIST_FOR_EACH_ENTRY( face, &family->faces, struct gdi_font_face, entry )
+    {
+        if (!(face->flags & ADDFONT_ADD_TO_CACHE)) continue;
+        size = offsetof( struct font_index_face, names[lstrlenW( face->style_name ) +
+                                                       lstrlenW( face->full_name ) +
+                                                       lstrlenW( face->file ) + 3] );
+        offset = buffer->size;
+        if (!(face_rec = append_font_index_record( buffer, size ))) return FALSE;
+        face_rec->size = buffer->size - offset;
+        face_rec->index = face->face_index;
+        face_rec->flags = face->flags;
+        face_rec->ntmflags = face->ntmFlags;
+        face_rec->version = face->version;
+        face_rec->scalable = face->scalable;
+        face_rec->bitmap_size = face->size;
+        face_rec->fs = face->fs;
+        ptr = append_index_string( face_rec->names, face->style_name );
+        ptr = append_index_string( ptr, face->full_name );
+        append_index_string( ptr, face->file );
+    }
+    return TRUE;
+}
+
+/* write the index to a temporary file and atomically replace the current one */
+static void write_font_index( const DWORD serial[4] )
+{
+    struct font_index_buffer buffer = { NULL };
+    struct font_index_header *header;
+    struct gdi_font_family *family;
+    char *path, *tmp = NULL;
+    DWORD pos, families = 0;
+    ssize_t ret;
+    int fd;
+
+    if (!(path = get_font_index_path())) return;
+    if (!append_font_index_record( &buffer, sizeof(*header) )) goto done;
+
+    WINE_RB_FOR_EACH_ENTRY( family, &family_name_tree, struct gdi_font_family, name_entry )
+        if (!add_family_to_font_index( &buffer, family, &families )) goto done;
+
+    header = (struct font_index_header *)buffer.data;
+    header->magic = FONT_INDEX_MAGIC;
+    header->version = FONT_INDEX_VERSION;
+    header->size = buffer.size;
+    header->families = families;
+    memcpy( header->serial, serial, sizeof(header->serial) );
+
+    if (!(tmp = malloc( strlen( path ) + sizeof(".XXXXXX") ))) goto done;
+    strcpy( tmp, path );
+    strcat( tmp, ".XXXXXX" );
+    if ((fd = mkstemp( tmp )) == -1) goto done;
+
+    for (pos = 0; pos < buffer.size; pos += ret)
+        if ((ret = write( fd, buffer.data + pos, buffer.size - pos )) <= 0) break;
+
+    if (!close( fd ) && pos == buffer.size && !rename( tmp, path ))
+        TRACE( "wrote %u bytes to %s\n", (int)buffer.size, debugstr_a(path) );
+    else
+    {
+        WARN( "failed to write font index %s\n", debugstr_a(path) );
+        unlink( tmp );
+    }
+
+done:
+    free( tmp );
+    free( buffer.data );
+    free( path );
+}
+
+static const WCHAR *get_index_string( const WCHAR *ptr, const WCHAR *end )
+{
+    while (ptr < end) if (!*ptr++) return ptr;
+    return NULL;
+}
+
+static BOOL validate_font_index( const char *data, DWORD size )
+{
+    const struct font_index_header *header = (const struct font_index_header *)data;
+    DWORD i, j, pos = sizeof(*header);
+
+    for (i = 0; i < header->families; i++)
+    {
+        const struct font_index_family *family = (const struct font_index_family *)(data + pos);
+        const WCHAR *str;
+
+        if (size - pos < sizeof(*family) || family->size < sizeof(*family) ||
+            family->size > size - pos || family->size % 4) return FALSE;
+        if (!(str = get_index_string( family->names, (const WCHAR *)(data + pos + family->size) ))) return FALSE;
+        if (!get_index_string( str, (const WCHAR *)(data + pos + family->size) )) return FALSE;
+        pos += family->size;
+
+        for (j = 0; j < family->faces; j++)
+        {
+            const struct font_index_face *face = (const struct font_index_face *)(data + pos);
+            const WCHAR *end;
+
+            if (size - pos < sizeof(*face) || face->size < sizeof(*face) ||
+                face->size > size - pos || face->size % 4) return FALSE;
+            end = (const WCHAR *)(data + pos + face->size);
+            if (!(str = get_index_string( face->names, end ))) return FALSE;
+            if (!(str = get_index_string( str, end ))) return FALSE;
+            if (!get_index_string( str, end )) return FALSE;
+            pos += face->size;
+        }
+    }
+    return pos == size;
+}
+
+static BOOL load_font_list_from_index( const DWORD serial[4] )
+{
+    const struct font_index_header *header;
+    struct gdi_font_family *family;
+    struct gdi_font_face *face;
+    DWORD i, j, pos;
+    struct stat st;
+    BOOL ret = FALSE;
+    char *path, *data;
+    int fd;
+
+    if (!(path = get_font_index_path())) return FALSE;
+    fd = open( path, O_RDONLY );
+    free( path );
+    if (fd == -1) return FALSE;
+
+    if (fstat( fd, &st ) == -1 || st.st_size < sizeof(*header) || st.st_size > INT_MAX ||
+        (data = mmap( NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0 )) == MAP_FAILED)
+    {
+        close( fd );
+        return FALSE;
+    }
+    close( fd );
+
+    header = (const struct font_index_header *)data;
+    if (header->magic != FONT_INDEX_MAGIC || header->version != FONT_INDEX_VERSION ||
+        header->size != st.st_size || memcmp( header->serial, serial, sizeof(header->serial) ) ||
+        !validate_font_index( data, st.st_size ))
+    {
+        TRACE( "font index is out of date\n" );
+        goto done;
+    }
+
+    for (i = 0, pos = sizeof(*header); i < header->families; i++)
+    {
+        const struct font_index_family *family_rec = (const struct font_index_family *)(data + pos);
+        const WCHAR *second_name = family_rec->names + lstrlenW( family_rec->names ) + 1;
+
+        pos += family_rec->size;
+        family = create_family( family_rec->names, second_name );
+        for (j = 0; j < family_rec->faces; j++)
+        {
+            const struct font_index_face *rec = (const struct font_index_face *)(data + pos);
+            const WCHAR *full_name = rec->names + lstrlenW( rec->names ) + 1;
+            const WCHAR *file = full_name + lstrlenW( full_name ) + 1;
+
+            pos += rec->size;
+            if ((face = create_face( family, rec->names, full_name, file, NULL, 0, rec->index, rec->fs,
+                                     rec->ntmflags, rec->version, rec->flags,
+                                     rec->scalable ? NULL : &rec->bitmap_size )))
+                release_face( face );
+        }
+        release_family( family );
+    }
+    TRACE( "loaded %u families from font index\n", (int)header->families );
+    ret = TRUE;
+
+done:
+    munmap( data, st.st_size );
+    return ret;
 }
 
 /* font links */
@@ -6705,7 +7029,7 @@ UINT font_init(void)
     OBJECT_ATTRIBUTES attr = { sizeof(attr) };
     UNICODE_STRING name;
     HANDLE mutex;
-    DWORD disposition;
+    DWORD disposition, serial[4];
     UINT dpi = 0;
 
     static WCHAR wine_font_mutexW[] =
@@ -6741,16 +7065,44 @@ UINT font_init(void)
 
     if (disposition == REG_CREATED_NEW_KEY)
     {
+        font_index_deferred = TRUE;
         load_registry_fonts();
         update_external_font_keys();
+        font_index_deferred = FALSE;
+        set_font_index_serial( serial );
+        write_font_index( serial );
     }
 
     NtReleaseMutant( mutex, NULL );
 
     if (disposition != REG_CREATED_NEW_KEY)
     {
+        BOOL has_serial = get_font_index_serial( serial );
+
+        /* registry fonts are loaded by every process, they don't need to invalidate the index */
+        font_index_deferred = TRUE;
         load_registry_fonts();
-        load_font_list_from_cache();
+        font_index_deferred = FALSE;
+        if (!has_serial || !load_font_list_from_index( serial ))
+        {
+            DWORD new_serial[4];
+
+            load_font_list_from_cache();
+
+            /* rebuild the index, unless the cache has been modified while we were loading it */
+            NtWaitForSingleObject( mutex, FALSE, NULL );
+            if (!get_font_index_serial( new_serial ))
+            {
+                if (!has_serial)
+                {
+                    set_font_index_serial( new_serial );
+                    write_font_index( new_serial );
+                }
+            }
+            else if (has_serial && !memcmp( serial, new_serial, sizeof(serial) ))
+                write_font_index( serial );
+            NtReleaseMutant( mutex, NULL );
+        }
     }
 
     reorder_font_list();
@@ -3127,7 +3127,10 @@ static void wined3d_cs_queue_submit(struct wined3d_cs_queue *queue, struct wined
     InterlockedExchange((LONG *)&queue->head, queue->head + packet_size);
 
     if (InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
+    {
+        InterlockedIncrement(&cs->wake_count);
         SetEvent(cs->event);
+    }
 }
 
 static void wined3d_cs_mt_submit(struct wined3d_device_context *context, enum wined3d_cs_queue_id queue_id)
@@ -3194,6 +3197,7 @@ static void *wined3d_cs_queue_require_space(struct wined3d_cs_queue *queue, size
 
         TRACE("Waiting for free space. Head %lu, tail %lu, packet size %Iu.\n",
                 head, tail, packet_size);
+        YieldProcessor();
     }
 
     packet = (struct wined3d_cs_packet *)&queue->data[head];
@@ -3268,9 +3272,28 @@ static void wined3d_cs_wait_event(struct wined3d_cs *cs)
             && InterlockedCompareExchange(&cs->waiting_for_event, FALSE, TRUE))
         return;
 
+    ++cs->sleep_count;
     WaitForSingleObject(cs->event, INFINITE);
 }
 
+/* Called when the CS thread stops spinning on an empty queue, either because
+ * new work arrived or because it is about to sleep. Sleeping means spinning
+ * was wasted, so spin for less next time; work arriving late in the spin
+ * means we almost missed it, so spin for longer. */
+static void wined3d_cs_end_spin(struct wined3d_cs *cs, unsigned int spin_count,
+        const LARGE_INTEGER *spin_start, bool sleeping)
+{
+    LARGE_INTEGER now;
+
+    QueryPerformanceCounter(&now);
+    cs->spin_time += now.QuadPart - spin_start->QuadPart;
+
+    if (sleeping)
+        cs->spin_limit = max(cs->spin_limit / 2, WINED3D_CS_SPIN_COUNT_MIN);
+    else if (spin_count > cs->spin_limit / 2)
+        cs->spin_limit = min(cs->spin_limit * 2, WINED3D_CS_SPIN_COUNT_MAX);
+}
+
 static void wined3d_cs_command_lock(const struct wined3d_cs *cs)
 {
     if (cs->serialize_commands)
@@ -3348,8 +3371,10 @@ static DWORD WINAPI wined3d_cs_run(void *ctx)
     struct wined3d_cs_queue *queue;
     unsigned int spin_count = 0;
     struct wined3d_cs *cs = ctx;
+    LARGE_INTEGER spin_start;
     HMODULE wined3d_module;
     unsigned int poll = 0;
+    bool slept = false;
     bool run = true;
 
     TRACE("Started.\n");
@@ -3377,12 +3402,33 @@ static DWORD WINAPI wined3d_cs_run(void *ctx)
             queue = &cs->queue[WINED3D_CS_QUEUE_DEFAULT];
             if (wined3d_cs_queue_is_empty(cs, queue))
             {
-                if (++spin_count >= WINED3D_CS_SPIN_COUNT && list_empty(&cs->query_poll_list))
-                    wined3d_cs_wait_event(cs);
+                /* Spinning to poll queries says nothing about when the next
+                 * command arrives, so it doesn't count towards the spin limit. */
+                if (!list_empty(&cs->query_poll_list))
+                {
+                    YieldProcessor();
+                    continue;
+                }
+                if (spin_count < cs->spin_limit)
+                {
+                    if (!spin_count++)
+                        QueryPerformanceCounter(&spin_start);
+                    YieldProcessor();
+                    continue;
+                }
+                if (!slept)
+                {
+                    wined3d_cs_end_spin(cs, spin_count, &spin_start, true);
+                    slept = true;
+                }
+                wined3d_cs_wait_event(cs);
                 continue;
             }
         }
+        if (spin_count && !slept)
+            wined3d_cs_end_spin(cs, spin_count, &spin_start, false);
         spin_count = 0;
+        slept = false;
 
         run = wined3d_cs_execute_next(cs, queue);
     }
@@ -3410,6 +3456,7 @@ struct wined3d_cs *wined3d_cs_create(struct wined3d_device *device,
 
     cs->c.ops = &wined3d_cs_st_ops;
     cs->c.device = device;
+    cs->spin_limit = WINED3D_CS_SPIN_COUNT_MAX;
     cs->serialize_commands = TRACE_ON(d3d_sync) || wined3d_settings.cs_multithreaded & WINED3D_CSMT_SERIALIZE;
 
     if (cs->serialize_commands)
@@ -3479,6 +3526,16 @@ void wined3d_cs_destroy(struct wined3d_cs *cs)
         CloseHandle(cs->thread);
         if (!CloseHandle(cs->event))
             ERR("Closing event failed.\n");
+
+        if (TRACE_ON(d3d_perf))
+        {
+            LARGE_INTEGER freq;
+
+            QueryPerformanceFrequency(&freq);
+            TRACE_(d3d_perf)("Command stream %p spun for %u ms, slept %lu times, was woken %ld times, "
+                    "final spin limit %u.\n", cs, (unsigned int)(cs->spin_time * 1000 / freq.QuadPart),
+                    cs->sleep_count, cs->wake_count, cs->spin_limit);
+        }
     }
 
     wined3d_state_destroy(cs->c.state);
@@ -5089,7 +5089,8 @@ enum wined3d_push_constants
 
 #define WINED3D_CS_QUERY_POLL_INTERVAL  10u
 #define WINED3D_CS_QUEUE_SIZE           0x400000u
-#define WINED3D_CS_SPIN_COUNT           10000000u
+#define WINED3D_CS_SPIN_COUNT_MIN       256u
+#define WINED3D_CS_SPIN_COUNT_MAX       65536u
 #define WINED3D_CS_QUEUE_MASK           (WINED3D_CS_QUEUE_SIZE - 1)
 
 C_ASSERT(!(WINED3D_CS_QUEUE_SIZE & (WINED3D_CS_QUEUE_SIZE - 1)));
@@ -5144,6 +5145,13 @@ struct wined3d_cs
     HANDLE event;
     LONG waiting_for_event;
     LONG pending_presents;
+
+    /* Number of empty queue polls before the CS thread goes to sleep. This is
+     * adjusted depending on whether work tends to arrive while spinning. */
+    unsigned int spin_limit;
+    LONG64 spin_time;
+    ULONG sleep_count;
+    LONG wake_count;
 };
 
 static inline void wined3d_device_context_lock(struct wined3d_device_context *context)
@@ -897,6 +897,87 @@ static BOOL WINAPI WS2_TransmitFile( SOCKET s, HANDLE file, DWORD file_len, DWOR
 }
 
 
+/***********************************************************************
+ *     TransmitPackets
+ */
+static BOOL WINAPI WS2_TransmitPackets( SOCKET s, TRANSMIT_PACKETS_ELEMENT *elements, DWORD count,
+                                        DWORD send_size, OVERLAPPED *overlapped, DWORD flags )
+{
+    struct afd_transmit_packets_params *params;
+    IO_STATUS_BLOCK iosb, *piosb = &iosb;
+    HANDLE event = NULL;
+    void *cvalue = NULL;
+    NTSTATUS status;
+    DWORD i, size;
+
+    TRACE( "socket %#Ix, elements %p, count %lu, send_size %lu, overlapped %p, flags %#lx\n",
+           s, elements, count, send_size, overlapped, flags );
+
+    if ((count && !elements) || count > (~0u - offsetof( struct afd_transmit_packets_params, elements[0] ))
+                                        / sizeof(params->elements[0]))
+    {
+        SetLastError( WSAEINVAL );
+        return FALSE;
+    }
+
+    size = offsetof( struct afd_transmit_packets_params, elements[count] );
+    if (!(params = malloc( size )))
+    {
+        SetLastError( WSAENOBUFS );
+        return FALSE;
+    }
+
+    params->count = count;
+    params->send_size = send_size;
+    params->flags = flags;
+    params->padding = 0;
+    for (i = 0; i < count; ++i)
+    {
+        struct afd_transmit_packets_element *element = &params->elements[i];
+
+        memset( element, 0, sizeof(*element) );
+        element->flags = elements[i].dwElFlags;
+        element->len = elements[i].cLength;
+        if (elements[i].dwElFlags & TP_ELEMENT_FILE)
+        {
+            element->file = HandleToULong( elements[i].u.s.hFile );
+            element->offset = elements[i].u.s.nFileOffset;
+            if (element->offset.QuadPart == -1)
+                element->offset.QuadPart = FILE_USE_FILE_POINTER_POSITION;
+        }
+        else
+            element->buffer_ptr = u64_from_user_ptr( elements[i].u.pBuffer );
+    }
+
+    if (overlapped)
+    {
+        piosb = (IO_STATUS_BLOCK *)overlapped;
+        if (!((ULONG_PTR)overlapped->hEvent & 1)) cvalue = overlapped;
+        event = overlapped->hEvent;
+        overlapped->Internal = STATUS_PENDING;
+        overlapped->InternalHigh = 0;
+    }
+    else if (!(event = get_sync_event()))
+    {
+        free( params );
+        return FALSE;
+    }
+
+    status = NtDeviceIoControlFile( (HANDLE)s, event, NULL, cvalue, piosb,
+                                    IOCTL_AFD_WINE_TRANSMIT_PACKETS, params, size, NULL, 0 );
+    free( params );
+    if (status == STATUS_PENDING && !overlapped)
+    {
+        if (WaitForSingleObject( event, INFINITE ) == WAIT_FAILED)
+            return FALSE;
+        status = piosb->u.Status;
+    }
+    SetLastError( NtStatusToWSAError( status ) );
+    TRACE( "status %#lx.\n", status );
+    return !status;
+}
+
+
 /***********************************************************************
  *     GetAcceptExSockaddrs
  */
@@ -2483,7 +2564,7 @@ INT WINAPI WSAIoctl(SOCKET s, DWORD code, LPVOID in_buff, DWORD in_size, LPVOID
             EXTENSION_FUNCTION(WSAID_ACCEPTEX, WS2_AcceptEx)
             EXTENSION_FUNCTION(WSAID_GETACCEPTEXSOCKADDRS, WS2_GetAcceptExSockaddrs)
             EXTENSION_FUNCTION(WSAID_TRANSMITFILE, WS2_TransmitFile)
-            /* EXTENSION_FUNCTION(WSAID_TRANSMITPACKETS, WS2_TransmitPackets) */
+            EXTENSION_FUNCTION(WSAID_TRANSMITPACKETS, WS2_TransmitPackets)
             EXTENSION_FUNCTION(WSAID_WSARECVMSG, WS2_WSARecvMsg)
             EXTENSION_FUNCTION(WSAID_WSASENDMSG, WSASendMsg)
         };
@@ -1415,6 +1415,114 @@ static void test_poll_reset(void)
     CloseHandle(event);
 }
 
+/* Wine may answer polls on sockets that were already used for I/O without going
+ * through the server; make sure that state changes are still reported. */
+static void test_poll_transitions(void)
+{
+    const struct sockaddr_in bind_addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+    OVERLAPPED overlapped = {0};
+    SOCKET client, server;
+    struct sockaddr_in addr;
+    DWORD size, flags = 0;
+    char buffer[16];
+    WSABUF wsabuf;
+    HANDLE event;
+    int ret, len;
+
+    event = CreateEventW(NULL, TRUE, FALSE, NULL);
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+
+    tcp_socketpair(&client, &server);
+
+    ret = send(client, "data", 4, 0);
+    ok(ret == 4, "got %d\n", ret);
+    ret = recv(server, buffer, sizeof(buffer), 0);
+    ok(ret == 4, "got %d\n", ret);
+    ret = send(server, "data", 4, 0);
+    ok(ret == 4, "got %d\n", ret);
+    ret = recv(client, buffer, sizeof(buffer), 0);
+    ok(ret == 4, "got %d\n", ret);
+
+    check_poll(client, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+
+    ret = send(client, "data", 4, 0);
+    ok(ret == 4, "got %d\n", ret);
+    check_poll_mask(server, event, AFD_POLL_READ, AFD_POLL_READ);
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT | AFD_POLL_READ);
+    ret = recv(server, buffer, sizeof(buffer), 0);
+    ok(ret == 4, "got %d\n", ret);
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+
+    /* data consumed by a pending receive is not reported */
+
+    wsabuf.buf = buffer;
+    wsabuf.len = sizeof(buffer);
+    ret = WSARecv(server, &wsabuf, 1, NULL, &flags, &overlapped, NULL);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == ERROR_IO_PENDING, "got error %u\n", WSAGetLastError());
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+
+    ret = send(client, "data", 4, 0);
+    ok(ret == 4, "got %d\n", ret);
+    ret = WaitForSingleObject(overlapped.hEvent, 200);
+    ok(!ret, "got %d\n", ret);
+    ret = GetOverlappedResult((HANDLE)server, &overlapped, &size, FALSE);
+    ok(ret, "got error %lu\n", GetLastError());
+    ok(size == 4, "got size %lu\n", size);
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+
+    /* graceful shutdown of the peer */
+
+    ret = shutdown(client, SD_SEND);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+    check_poll_mask(server, event, AFD_POLL_HUP, AFD_POLL_HUP);
+    check_poll(server, event, AFD_POLL_WRITE | AFD_POLL_CONNECT | AFD_POLL_HUP);
+
+    closesocket(client);
+    closesocket(server);
+
+    /* reset by the peer */
+
+    tcp_socketpair(&client, &server);
+
+    ret = send(server, "data", 4, 0);
+    ok(ret == 4, "got %d\n", ret);
+    ret = recv(client, buffer, sizeof(buffer), 0);
+    ok(ret == 4, "got %d\n", ret);
+    check_poll(client, event, AFD_POLL_WRITE | AFD_POLL_CONNECT);
+
+    close_with_rst(server);
+    check_poll_mask(client, event, AFD_POLL_RESET, AFD_POLL_RESET);
+    check_poll(client, event, AFD_POLL_WRITE | AFD_POLL_CONNECT | AFD_POLL_RESET);
+
+    closesocket(client);
+
+    /* connectionless sockets are never reported as connected */
+
+    client = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    ret = bind(client, (const struct sockaddr *)&bind_addr, sizeof(bind_addr));
+    ok(!ret, "got error %u\n", WSAGetLastError());
+    len = sizeof(addr);
+    ret = getsockname(client, (struct sockaddr *)&addr, &len);
+    ok(!ret, "got error %u\n", WSAGetLastError());
+
+    ret = sendto(client, "data", 4, 0, (struct sockaddr *)&addr, sizeof(addr));
+    ok(ret == 4, "got %d\n", ret);
+    ret = recv(client, buffer, sizeof(buffer), 0);
+    ok(ret == 4, "got %d\n", ret);
+    check_poll(client, event, AFD_POLL_WRITE);
+
+    ret = sendto(client, "data", 4, 0, (struct sockaddr *)&addr, sizeof(addr));
+    ok(ret == 4, "got %d\n", ret);
+    check_poll_mask(client, event, AFD_POLL_READ, AFD_POLL_READ);
+    check_poll(client, event, AFD_POLL_WRITE | AFD_POLL_READ);
+
+    closesocket(client);
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(event);
+}
+
 static void test_recv(void)
 {
     const struct sockaddr_in bind_addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
@@ -2764,6 +2872,7 @@ START_TEST(afd)
     test_poll_exclusive();
     test_poll_completion_port();
     test_poll_reset();
+    test_poll_transitions();
     test_recv();
     test_event_select();
     test_get_events();
@@ -9525,6 +9525,93 @@ static void test_TransmitFile(void)
     closesocket(server);
 }
 
+static void test_TransmitPackets(void)
+{
+    GUID transmit_packets_guid = WSAID_TRANSMITPACKETS;
+    LPFN_TRANSMITPACKETS pTransmitPackets = NULL;
+    char system_ini_path[MAX_PATH];
+    TRANSMIT_PACKETS_ELEMENT elements[3];
+    char header_msg[] = "hello world";
+    char footer_msg[] = "goodbye!!!";
+    DWORD num_bytes, total_sent;
+    SOCKET client, server;
+    OVERLAPPED ov = {0};
+    HANDLE file;
+    char buf[256];
+    int ret;
+    BOOL bret;
+
+    tcp_socketpair(&client, &server);
+
+    ret = WSAIoctl(client, SIO_GET_EXTENSION_FUNCTION_POINTER, &transmit_packets_guid, sizeof(transmit_packets_guid),
+                   &pTransmitPackets, sizeof(pTransmitPackets), &num_bytes, NULL, NULL);
+    ok(!ret, "failed to get TransmitPackets, error %u\n", WSAGetLastError());
+
+    GetSystemWindowsDirectoryA(system_ini_path, MAX_PATH);
+    strcat(system_ini_path, "\\system.ini");
+    file = CreateFileA(system_ini_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_ALWAYS, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "failed to open file, error %lu\n", GetLastError());
+
+    memset(elements, 0, sizeof(elements));
+    elements[0].dwElFlags = TP_ELEMENT_MEMORY;
+    elements[0].cLength = sizeof(header_msg);
+    elements[0].pBuffer = header_msg;
+    elements[1].dwElFlags = TP_ELEMENT_MEMORY | TP_ELEMENT_EOP;
+    elements[1].cLength = sizeof(footer_msg);
+    elements[1].pBuffer = footer_msg;
+
+    bret = pTransmitPackets(client, elements, 2, 0, NULL, 0);
+    ok(bret, "TransmitPackets failed, error %u\n", WSAGetLastError());
+    ret = recv(server, buf, sizeof(header_msg) + sizeof(footer_msg), MSG_WAITALL);
+    ok(ret == sizeof(header_msg) + sizeof(footer_msg), "got %d\n", ret);
+    ok(!memcmp(buf, header_msg, sizeof(header_msg)), "header didn't match\n");
+    ok(!memcmp(buf + sizeof(header_msg), footer_msg, sizeof(footer_msg)), "footer didn't match\n");
+
+    elements[1].dwElFlags = TP_ELEMENT_FILE;
+    elements[1].cLength = 0;
+    elements[1].nFileOffset.QuadPart = 0;
+    elements[1].hFile = file;
+    elements[2].dwElFlags = TP_ELEMENT_MEMORY;
+    elements[2].cLength = sizeof(footer_msg);
+    elements[2].pBuffer = footer_msg;
+
+    ov.hEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+    bret = pTransmitPackets(client, elements, 3, 0, &ov, 0);
+    ok(bret || WSAGetLastError() == ERROR_IO_PENDING, "TransmitPackets failed, error %u\n", WSAGetLastError());
+    ret = WaitForSingleObject(ov.hEvent, 2000);
+    ok(!ret, "wait timed out\n");
+    bret = WSAGetOverlappedResult(client, &ov, &total_sent, FALSE, &num_bytes);
+    ok(bret, "got error %u\n", WSAGetLastError());
+    ok(total_sent == GetFileSize(file, NULL) + sizeof(header_msg) + sizeof(footer_msg),
+       "got %lu bytes\n", total_sent);
+
+    ret = recv(server, buf, sizeof(header_msg), MSG_WAITALL);
+    ok(ret == sizeof(header_msg), "got %d\n", ret);
+    ok(!memcmp(buf, header_msg, sizeof(header_msg)), "header didn't match\n");
+    compare_file(file, server, 0);
+    ret = recv(server, buf, sizeof(footer_msg), MSG_WAITALL);
+    ok(ret == sizeof(footer_msg), "got %d\n", ret);
+    ok(!memcmp(buf, footer_msg, sizeof(footer_msg)), "footer didn't match\n");
+
+    /* TP_DISCONNECT shuts down the sending side after the last element */
+    bret = pTransmitPackets(client, elements, 1, 0, NULL, TP_DISCONNECT);
+    ok(bret, "TransmitPackets failed, error %u\n", WSAGetLastError());
+    ret = recv(server, buf, sizeof(header_msg), MSG_WAITALL);
+    ok(ret == sizeof(header_msg), "got %d\n", ret);
+    ok(!memcmp(buf, header_msg, sizeof(header_msg)), "header didn't match\n");
+    ret = recv(server, buf, sizeof(buf), 0);
+    ok(!ret, "got %d\n", ret);
+
+    ret = send(client, header_msg, sizeof(header_msg), 0);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == WSAESHUTDOWN, "got error %u\n", WSAGetLastError());
+
+    CloseHandle(ov.hEvent);
+    CloseHandle(file);
+    closesocket(client);
+    closesocket(server);
+}
+
 static void test_getpeername(void)
 {
     SOCKET sock;
@@ -12709,6 +12796,122 @@ static void test_simultaneous_async_recv(void)
     for (i = 0; i < num_io; i++) CloseHandle(events[i]);
 }
 
+struct interleaved_recv_param
+{
+    SOCKET sock;
+    char *buffer;
+    int size;
+    int received;
+};
+
+static DWORD WINAPI interleaved_recv_thread(void *arg)
+{
+    struct interleaved_recv_param *p = arg;
+    int ret;
+
+    while (p->received < p->size)
+    {
+        ret = recv(p->sock, p->buffer + p->received, p->size - p->received, 0);
+        if (ret <= 0) break;
+        p->received += ret;
+    }
+    return 0;
+}
+
+static void test_interleaved_io(void)
+{
+    static const char data1[] = "first", data2[] = "second";
+    const int big_size = 1 << 22;
+    struct interleaved_recv_param param;
+    OVERLAPPED overlapped = {0};
+    SOCKET client, server;
+    char buffer[32], buffer2[32], *big;
+    DWORD size, flags = 0;
+    WSABUF wsabuf;
+    HANDLE thread;
+    int ret, i;
+
+    overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    tcp_socketpair(&client, &server);
+
+    /* a pending overlapped receive gets the data before a later non-overlapped one */
+
+    wsabuf.buf = buffer;
+    wsabuf.len = sizeof(buffer);
+    ret = WSARecv(client, &wsabuf, 1, NULL, &flags, &overlapped, NULL);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == ERROR_IO_PENDING, "got error %u\n", WSAGetLastError());
+
+    ret = send(server, data1, sizeof(data1), 0);
+    ok(ret == sizeof(data1), "got %d\n", ret);
+
+    set_blocking(client, FALSE);
+    WSASetLastError(0xdeadbeef);
+    ret = recv(client, buffer2, sizeof(buffer2), 0);
+    ok(ret == -1, "got %d\n", ret);
+    ok(WSAGetLastError() == WSAEWOULDBLOCK, "got error %u\n", WSAGetLastError());
+    set_blocking(client, TRUE);
+
+    ret = WaitForSingleObject(overlapped.hEvent, 1000);
+    ok(!ret, "wait timed out\n");
+    size = 0;
+    ret = GetOverlappedResult((HANDLE)client, &overlapped, &size, FALSE);
+    ok(ret, "got error %lu\n", GetLastError());
+    ok(size == sizeof(data1), "got size %lu\n", size);
+    ok(!memcmp(buffer, data1, sizeof(data1)), "got %s\n", debugstr_an(buffer, size));
+
+    /* without anything queued, non-overlapped calls work as usual */
+
+    ret = send(server, data2, sizeof(data2), 0);
+    ok(ret == sizeof(data2), "got %d\n", ret);
+    ret = recv(client, buffer2, sizeof(buffer2), 0);
+    ok(ret == sizeof(data2), "got %d\n", ret);
+    ok(!memcmp(buffer2, data2, sizeof(data2)), "got %s\n", debugstr_an(buffer2, ret));
+
+    /* a non-overlapped send doesn't overtake a pending overlapped one */
+
+    big = malloc(big_size);
+    memset(big, 'x', big_size);
+    param.sock = server;
+    param.buffer = malloc(big_size + sizeof(data1));
+    param.size = big_size + sizeof(data1);
+    param.received = 0;
+
+    ResetEvent(overlapped.hEvent);
+    wsabuf.buf = big;
+    wsabuf.len = big_size;
+    ret = WSASend(client, &wsabuf, 1, NULL, 0, &overlapped, NULL);
+    ok(!ret || WSAGetLastError() == ERROR_IO_PENDING, "got error %u\n", WSAGetLastError());
+
+    thread = CreateThread(NULL, 0, interleaved_recv_thread, &param, 0, NULL);
+
+    ret = send(client, data1, sizeof(data1), 0);
+    ok(ret == sizeof(data1), "got %d\n", ret);
+
+    ret = WaitForSingleObject(overlapped.hEvent, 10000);
+    ok(!ret, "wait timed out\n");
+    size = 0;
+    ret = GetOverlappedResult((HANDLE)client, &overlapped, &size, FALSE);
+    ok(ret, "got error %lu\n", GetLastError());
+    ok(size == big_size, "got size %lu\n", size);
+
+    ret = WaitForSingleObject(thread, 10000);
+    ok(!ret, "wait timed out\n");
+    CloseHandle(thread);
+
+    ok(param.received == param.size, "got %d bytes\n", param.received);
+    for (i = 0; i < big_size; i++) if (param.buffer[i] != 'x') break;
+    ok(i == big_size, "got unexpected data at offset %d\n", i);
+    ok(!memcmp(param.buffer + big_size, data1, sizeof(data1)), "got %s\n",
+       debugstr_an(param.buffer + big_size, sizeof(data1)));
+
+    free(param.buffer);
+    free(big);
+    closesocket(client);
+    closesocket(server);
+    CloseHandle(overlapped.hEvent);
+}
+
 static void test_empty_recv(void)
 {
     OVERLAPPED overlapped = {0};
@@ -13634,6 +13837,7 @@ START_TEST( sock )
 
     test_ipv6only();
     test_TransmitFile();
+    test_TransmitPackets();
     test_AcceptEx();
     test_connect();
     test_shutdown();
@@ -13647,6 +13851,7 @@ START_TEST( sock )
     test_WSAGetOverlappedResult();
     test_nonblocking_async_recv();
     test_simultaneous_async_recv();
+    test_interleaved_io();
     test_empty_recv();
     test_timeout();
     test_tcp_reset();
@@ -1088,10 +1088,10 @@ static HRESULT reader_more(xmlreader *reader)
     }
     else
     {
-        dest_len = MultiByteToWideChar(cp, 0, src->data + src->cur, len, NULL, 0);
-        readerinput_grow(readerinput, dest_len);
+        /* every character takes at least one byte, so convert in a single pass */
+        readerinput_grow(readerinput, len);
         ptr = (WCHAR*)(dest->data + dest->written);
-        MultiByteToWideChar(cp, 0, src->data + src->cur, len, ptr, dest_len);
+        dest_len = MultiByteToWideChar(cp, 0, src->data + src->cur, len, ptr, len);
         ptr[dest_len] = 0;
         dest->written += dest_len*sizeof(WCHAR);
         /* get rid of processed data */
@@ -1146,31 +1146,55 @@ static void reader_update_position(xmlreader *reader, WCHAR ch)
         reader->position.line_position++;
 }
 
+/* moves cursor over len WCHARs that are already in the buffer */
+static void reader_skip_available(xmlreader *reader, UINT len)
+{
+    encoded_buffer *buffer = &reader->input->buffer->utf16;
+    const WCHAR *ptr = (WCHAR*)buffer->data + buffer->cur, *end = ptr + len;
+
+    while (ptr < end) reader_update_position(reader, *ptr++);
+    buffer->cur += len;
+}
+
 /* moves cursor n WCHARs forward */
 static void reader_skipn(xmlreader *reader, int n)
 {
-    encoded_buffer *buffer = &reader->input->buffer->utf16;
     const WCHAR *ptr;
+    int len;
 
-    while (*(ptr = reader_get_ptr(reader)) && n--)
+    while (n > 0 && *(ptr = reader_get_ptr(reader)))
     {
-        reader_update_position(reader, *ptr);
-        buffer->cur++;
+        for (len = 1; len < n && ptr[len]; len++)
+            ;
+        reader_skip_available(reader, len);
+        n -= len;
     }
 }
 
-/* [3] S ::= (#x20 | #x9 | #xD | #xA)+ */
-static int reader_skipspaces(xmlreader *reader)
+/* moves cursor over all chars matching 'check', which must be false for the
+   null terminator, and returns a pointer to the first one that doesn't match */
+static WCHAR *reader_skip_while(xmlreader *reader, BOOL (*check)(WCHAR))
 {
-    const WCHAR *ptr = reader_get_ptr(reader);
-    UINT start = reader_get_cur(reader);
+    WCHAR *ptr = reader_get_ptr(reader);
+    UINT len;
 
-    while (is_wchar_space(*ptr))
+    while (check(*ptr))
     {
-        reader_skipn(reader, 1);
+        for (len = 1; check(ptr[len]); len++)
+            ;
+        reader_skip_available(reader, len);
         ptr = reader_get_ptr(reader);
     }
 
+    return ptr;
+}
+
+/* [3] S ::= (#x20 | #x9 | #xD | #xA)+ */
+static int reader_skipspaces(xmlreader *reader)
+{
+    UINT start = reader_get_cur(reader);
+
+    reader_skip_while(reader, is_wchar_space);
     return reader_get_cur(reader) - start;
 }
 
@@ -1411,7 +1435,7 @@ static HRESULT reader_parse_xmldecl(xmlreader *reader)
 static HRESULT reader_parse_comment(xmlreader *reader)
 {
     WCHAR *ptr;
-    UINT start;
+    UINT start, len;
 
     if (reader->resumestate == XmlReadResumeState_Comment)
     {
@@ -1431,36 +1455,35 @@ static HRESULT reader_parse_comment(xmlreader *reader)
         reader_set_strvalue(reader, StringValue_Value, NULL);
     }
 
-    /* will exit when there's no more data, it won't attempt to
-       read more from stream */
+    /* will exit when there's no more data */
     while (*ptr)
     {
+        /* the rest of the markup may not be in the buffer yet */
         if (ptr[0] == '-')
         {
-            if (ptr[1] == '-')
+            if (!reader_cmp(reader, L"-->"))
             {
-                if (ptr[2] == '>')
-                {
-                    strval value;
+                strval value;
 
-                    reader_init_strvalue(start, reader_get_cur(reader)-start, &value);
-                    TRACE("%s\n", debug_strval(reader, &value));
+                reader_init_strvalue(start, reader_get_cur(reader)-start, &value);
+                TRACE("%s\n", debug_strval(reader, &value));
 
-                    /* skip rest of markup '->' */
-                    reader_skipn(reader, 3);
+                /* skip rest of markup '->' */
+                reader_skipn(reader, 3);
 
-                    reader_set_strvalue(reader, StringValue_Value, &value);
-                    reader->resume[XmlReadResume_Body] = 0;
-                    reader->resumestate = XmlReadResumeState_Initial;
-                    return S_OK;
-                }
-                else
-                    return WC_E_COMMENT;
+                reader_set_strvalue(reader, StringValue_Value, &value);
+                reader->resume[XmlReadResume_Body] = 0;
+                reader->resumestate = XmlReadResumeState_Initial;
+                return S_OK;
             }
+            if (!reader_cmp(reader, L"--")) return WC_E_COMMENT;
+            ptr = reader_get_ptr(reader);
         }
 
-        reader_skipn(reader, 1);
-        ptr++;
+        len = 1;
+        while (ptr[len] && ptr[len] != '-') len++;
+        reader_skip_available(reader, len);
+        ptr = reader_get_ptr(reader);
     }
 
     return S_OK;
@@ -1559,11 +1582,7 @@ static HRESULT reader_parse_name(xmlreader *reader, strval *name)
         if (!is_namestartchar(*ptr)) return WC_E_NAMECHARACTER;
     }
 
-    while (is_namechar(*ptr))
-    {
-        reader_skipn(reader, 1);
-        ptr = reader_get_ptr(reader);
-    }
+    reader_skip_while(reader, is_namechar);
 
     if (is_reader_pending(reader))
     {
@@ -1916,11 +1935,7 @@ static HRESULT reader_parse_local(xmlreader *reader, strval *local, BOOL check_f
         start = reader_get_cur(reader);
     }
 
-    while (is_ncnamechar(*ptr))
-    {
-        reader_skipn(reader, 1);
-        ptr = reader_get_ptr(reader);
-    }
+    ptr = reader_skip_while(reader, is_ncnamechar);
 
     if (check_for_separator && *ptr == ':')
         return NC_E_QNAMECOLON;
@@ -1973,11 +1988,7 @@ static HRESULT reader_parse_qname(xmlreader *reader, strval *prefix, strval *loc
     else
     {
         /* skip prefix part */
-        while (is_ncnamechar(*ptr))
-        {
-            reader_skipn(reader, 1);
-            ptr = reader_get_ptr(reader);
-        }
+        ptr = reader_skip_while(reader, is_ncnamechar);
 
         if (is_reader_pending(reader)) return E_PENDING;
 
@@ -2128,6 +2139,8 @@ static HRESULT reader_parse_reference(xmlreader *reader)
 
         ptr = reader_get_ptr(reader);
         if (*ptr != ';') return WC_E_SEMICOLON;
+        /* reading the name may have reallocated the buffer */
+        start = reader_get_ptr2(reader, cur);
 
         /* predefined entities resolve to a single character */
         ch = get_predefined_entity(reader, &name);
@@ -2186,9 +2199,16 @@ static HRESULT reader_parse_attvalue(xmlreader *reader, strval *value)
         }
         else
         {
-            /* replace all whitespace chars with ' ' */
-            if (is_wchar_space(*ptr)) *ptr = ' ';
-            reader_skipn(reader, 1);
+            UINT len = 0;
+
+            /* skip all available chars up to the next delimiter, replacing
+               whitespace chars with ' ' */
+            do
+            {
+                if (is_wchar_space(ptr[len])) ptr[len] = ' ';
+                len++;
+            } while (ptr[len] && ptr[len] != quote && ptr[len] != '<' && ptr[len] != '&');
+            reader_skip_available(reader, len);
         }
         ptr = reader_get_ptr(reader);
     }
@@ -2389,7 +2409,7 @@ static HRESULT reader_parse_cdata(xmlreader *reader)
 
     while (*ptr)
     {
-        if (*ptr == ']' && *(ptr+1) == ']' && *(ptr+2) == '>')
+        if (*ptr == ']' && !reader_cmp(reader, L"]]>"))
         {
             strval value;
 
@@ -2406,7 +2426,11 @@ static HRESULT reader_parse_cdata(xmlreader *reader)
         }
         else
         {
-            reader_skipn(reader, 1);
+            UINT len = 1;
+
+            ptr = reader_get_ptr(reader);
+            while (ptr[len] && ptr[len] != ']') len++;
+            reader_skip_available(reader, len);
             ptr = reader_get_ptr(reader);
         }
     }
@@ -2443,8 +2467,11 @@ static HRESULT reader_parse_chardata(xmlreader *reader)
     while (*ptr)
     {
         /* CDATA closing sequence ']]>' is not allowed */
-        if (ptr[0] == ']' && ptr[1] == ']' && ptr[2] == '>')
-            return WC_E_CDSECTEND;
+        if (ptr[0] == ']')
+        {
+            if (!reader_cmp(reader, L"]]>")) return WC_E_CDSECTEND;
+            ptr = reader_get_ptr(reader);
+        }
 
         /* Found next markup part */
         if (ptr[0] == '<')
@@ -2459,13 +2486,25 @@ static HRESULT reader_parse_chardata(xmlreader *reader)
             return S_OK;
         }
 
-        /* this covers a case when text has leading whitespace chars */
-        if (!is_wchar_space(*ptr)) reader->nodetype = XmlNodeType_Text;
-
-        if (!reader_cmp(reader, L"&"))
+        if (*ptr == '&')
+        {
+            /* this covers a case when text has leading whitespace chars */
+            reader->nodetype = XmlNodeType_Text;
             reader_parse_reference(reader);
+        }
         else
-            reader_skipn(reader, 1);
+        {
+            UINT len = 0;
+
+            /* skip all available chars up to the next markup or reference */
+            do
+            {
+                /* this covers a case when text has leading whitespace chars */
+                if (!is_wchar_space(ptr[len])) reader->nodetype = XmlNodeType_Text;
+                len++;
+            } while (ptr[len] && ptr[len] != '<' && ptr[len] != '&' && ptr[len] != ']');
+            reader_skip_available(reader, len);
+        }
 
         ptr = reader_get_ptr(reader);
     }
@@ -468,6 +468,40 @@ static const ISequentialStreamVtbl teststreamvtbl =
     teststream_Write
 };
 
+struct chunked_stream
+{
+    ISequentialStream ISequentialStream_iface;
+    const char *data;
+    ULONG size;
+    ULONG pos;
+    ULONG chunk_size;
+};
+
+static struct chunked_stream *impl_from_ISequentialStream(ISequentialStream *iface)
+{
+    return CONTAINING_RECORD(iface, struct chunked_stream, ISequentialStream_iface);
+}
+
+/* returns at most chunk_size bytes per call, so that the reader has to read more in the middle of tokens */
+static HRESULT WINAPI chunkedstream_Read(ISequentialStream *iface, void *pv, ULONG cb, ULONG *pread)
+{
+    struct chunked_stream *stream = impl_from_ISequentialStream(iface);
+
+    *pread = min(min(cb, stream->chunk_size), stream->size - stream->pos);
+    memcpy(pv, stream->data + stream->pos, *pread);
+    stream->pos += *pread;
+    return S_OK;
+}
+
+static const ISequentialStreamVtbl chunkedstreamvtbl =
+{
+    teststream_QueryInterface,
+    teststream_AddRef,
+    teststream_Release,
+    chunkedstream_Read,
+    teststream_Write
+};
+
 static HRESULT WINAPI resolver_QI(IXmlResolver *iface, REFIID riid, void **obj)
 {
     ok(0, "unexpected call, riid %s\n", wine_dbgstr_guid(riid));
@@ -1595,6 +1629,53 @@ static void test_read_pending(void)
     IXmlReader_Release(reader);
 }
 
+static void test_read_chunked(void)
+{
+    static const char xml[] = "<a attr=\"one\ttwo &amp; three  four\">text text &lt; more ] text"
+                              "<!-- a longer comment - with dashes --><![CDATA[cdata ]] text]]>tail</a>";
+    struct chunked_stream stream = {{&chunkedstreamvtbl}, xml, sizeof(xml) - 1};
+    IXmlReader *reader;
+    HRESULT hr;
+
+    hr = CreateXmlReader(&IID_IXmlReader, (void **)&reader, NULL);
+    ok(hr == S_OK, "Unexpected hr %#lx.\n", hr);
+
+    /* every value and markup delimiter ends up split across reads for some chunk size */
+    for (stream.chunk_size = 4; stream.chunk_size <= 16; stream.chunk_size++)
+    {
+        winetest_push_context("chunk size %lu", stream.chunk_size);
+
+        stream.pos = 0;
+        hr = IXmlReader_SetInput(reader, (IUnknown *)&stream.ISequentialStream_iface);
+        ok(hr == S_OK, "Unexpected hr %#lx.\n", hr);
+
+        read_node(reader, XmlNodeType_Element);
+        reader_name(reader, L"a");
+        next_attribute(reader);
+        reader_name(reader, L"attr");
+        reader_value(reader, L"one two & three  four");
+
+        read_node(reader, XmlNodeType_Text);
+        reader_value(reader, L"text text < more ] text");
+
+        read_node(reader, XmlNodeType_Comment);
+        reader_value(reader, L" a longer comment - with dashes ");
+
+        read_node(reader, XmlNodeType_CDATA);
+        reader_value(reader, L"cdata ]] text");
+
+        read_node(reader, XmlNodeType_Text);
+        reader_value(reader, L"tail");
+
+        read_node(reader, XmlNodeType_EndElement);
+        reader_name(reader, L"a");
+
+        winetest_pop_context();
+    }
+
+    IXmlReader_Release(reader);
+}
+
 static void test_readvaluechunk(void)
 {
     IXmlReader *reader;
@@ -2687,6 +2768,7 @@ START_TEST(reader)
     test_read_text();
     test_read_full();
     test_read_pending();
+    test_read_chunked();
     test_readvaluechunk();
     test_read_xmldeclaration();
     test_reader_properties();
@@ -0,0 +1,58 @@
+/*
+ * x86 crypto extension detection
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_CPUID_H
+#define __WINE_WINE_CPUID_H
+
+/* WINE_X86_CRYPTO_EXTENSIONS is defined when the compiler can build the
+ * SHA and AES intrinsics; callers still have to check the CPU at runtime. */
+#if (defined(__i386__) || defined(__x86_64__)) && (defined(__clang__) || __GNUC__ >= 5)
+
+#include <intrin.h>
+
+#define WINE_X86_CRYPTO_EXTENSIONS
+
+#define WINE_X86_FEATURE_SHA_NI  0x01  /* SHA, with the SSSE3 and SSE4.1 it relies on */
+#define WINE_X86_FEATURE_AES_NI  0x02
+
+static inline unsigned int wine_x86_crypto_features(void)
+{
+    static int features = -1;
+    int regs[4], max_leaf;
+
+    if (features == -1)
+    {
+        int ret = 0;
+
+        __cpuid(regs, 0);
+        max_leaf = regs[0];
+        __cpuid(regs, 1);
+        if (regs[2] & (1 << 25)) ret |= WINE_X86_FEATURE_AES_NI;
+        if (max_leaf >= 7 && (regs[2] & (1 << 19)) && (regs[2] & (1 << 9))) /* SSE4.1, SSSE3 */
+        {
+            __cpuidex(regs, 7, 0);
+            if (regs[1] & (1 << 29)) ret |= WINE_X86_FEATURE_SHA_NI;
+        }
+        features = ret;
+    }
+    return features;
+}
+
+#endif
+
+#endif  /* __WINE_WINE_CPUID_H */
@@ -0,0 +1,39 @@
+/*
+ * Wine-specific file system control codes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_FSCTL_H
+#define __WINE_WINE_FSCTL_H
+
+#include "winioctl.h"
+
+/* Copy data from another file into the file the request is issued on.
+ * Returns the number of bytes copied in the I/O status block; 0 means the
+ * end of the source file was reached. */
+#define FSCTL_WINE_COPY_FILE_RANGE      CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 0x800, METHOD_BUFFERED, FILE_WRITE_DATA)
+
+struct copy_file_range_params
+{
+    ULONG         source;           /* source file handle */
+    ULONG         padding;
+    LARGE_INTEGER source_offset;
+    LARGE_INTEGER target_offset;
+    ULONGLONG     length;           /* maximum amount of data to copy */
+};
+C_ASSERT( sizeof(struct copy_file_range_params) == 32 );
+
+#endif  /* __WINE_WINE_FSCTL_H */
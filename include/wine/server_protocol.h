@@ -1786,13 +1786,21 @@ struct unlock_file_reply
 
 
 
+#define SOCK_STATE_SLOTS 65536
+#define SOCK_STATE_RECV  0x01
+#define SOCK_STATE_SEND  0x02
+#define SOCK_STATE_POLL  0x04
+#define SOCK_STATE_CONNECTED 0x08
+
+
 struct recv_socket_request
 {
     struct request_header __header;
-    int          oob;
+    short int    oob;
+    short int    force_async;
     async_data_t async;
-    int          force_async;
-    char __pad_60[4];
+    unsigned int status;
+    unsigned int total;
 };
 struct recv_socket_reply
 {
@@ -1800,7 +1808,7 @@ struct recv_socket_reply
     obj_handle_t wait;
     unsigned int options;
     int          nonblocking;
-    char __pad_20[4];
+    unsigned int state_slot;
 };
 
 
@@ -1808,10 +1816,10 @@ struct recv_socket_reply
 struct send_socket_request
 {
     struct request_header __header;
-    char __pad_12[4];
+    unsigned int status;
     async_data_t async;
     int          force_async;
-    char __pad_60[4];
+    unsigned int total;
 };
 struct send_socket_reply
 {
@@ -1819,7 +1827,7 @@ struct send_socket_reply
     obj_handle_t wait;
     unsigned int options;
     int          nonblocking;
-    char __pad_20[4];
+    unsigned int state_slot;
 };
 
 
@@ -1954,10 +1962,10 @@ struct get_mapping_info_reply
     mem_size_t   size;
     unsigned int flags;
     obj_handle_t shared_file;
+    int          shared_unaligned;
     data_size_t  total;
     /* VARARG(image,pe_image_info); */
     /* VARARG(name,unicode_str); */
-    char __pad_28[4];
 };
 
 
@@ -6582,7 +6590,7 @@ union generic_reply
 
 /* ### protocol_version begin ### */
 
-#define SERVER_PROTOCOL_VERSION 760
+#define SERVER_PROTOCOL_VERSION 765
 
 /* ### protocol_version end ### */
 
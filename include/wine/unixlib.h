@@ -32,6 +32,7 @@ typedef NTSTATUS (*unixlib_entry_t)( void *args );
 /* some useful helpers from ntdll */
 extern const char *ntdll_get_build_dir(void);
 extern const char *ntdll_get_data_dir(void);
+extern const char *ntdll_get_config_dir(void);
 extern DWORD ntdll_umbstowcs( const char *src, DWORD srclen, WCHAR *dst, DWORD dstlen );
 extern int ntdll_wcstoumbs( const WCHAR *src, DWORD srclen, char *dst, DWORD dstlen, BOOL strict );
 extern int ntdll_wcsicmp( const WCHAR *str1, const WCHAR *str2 );
@@ -815,26 +815,18 @@ DECL_HANDLER(get_async_result)
 }
 
 /* notify direct completion of async and close the wait handle if not blocking */
-DECL_HANDLER(set_async_direct_result)
+/* store the result of an I/O operation that the client performed directly
+ * after the async was handed off with STATUS_ALERTED; returns the wait
+ * handle, or 0 if it was closed because the client doesn't need to wait */
+obj_handle_t async_set_direct_result( struct async *async, unsigned int status, apc_param_t information,
+                                      int mark_pending )
 {
-    struct async *async = (struct async *)get_handle_obj( current->process, req->handle, 0, &async_ops );
-    unsigned int status = req->status;
-
-    if (!async) return;
-
-    if (!async->unknown_status || !async->terminated || !async->alerted)
-    {
-        set_error( STATUS_INVALID_PARAMETER );
-        release_object( &async->obj );
-        return;
-    }
-
     if (status == STATUS_PENDING)
     {
         async->direct_result = 0;
         async->pending = 1;
     }
-    else if (req->mark_pending)
+    else if (mark_pending)
     {
         async->pending = 1;
     }
@@ -844,7 +836,7 @@ DECL_HANDLER(set_async_direct_result)
      * therefore, we can do async_set_result() directly and let the client skip
      * waiting on wait_handle.
      */
-    async_set_result( &async->obj, status, req->information );
+    async_set_result( &async->obj, status, information );
 
     /* close wait handle here to avoid extra server round trip, if the I/O
      * either has completed, or is pending and not blocking.
@@ -855,11 +847,27 @@ DECL_HANDLER(set_async_direct_result)
         async->wait_handle = 0;
     }
 
+    return async->wait_handle;
+}
+
+DECL_HANDLER(set_async_direct_result)
+{
+    struct async *async = (struct async *)get_handle_obj( current->process, req->handle, 0, &async_ops );
+
+    if (!async) return;
+
+    if (!async->unknown_status || !async->terminated || !async->alerted)
+    {
+        set_error( STATUS_INVALID_PARAMETER );
+        release_object( &async->obj );
+        return;
+    }
+
     /* report back to the client whether the wait handle has been closed.
      * handle will be 0 if closed by us; otherwise the original value is
      * retained
      */
-    reply->handle = async->wait_handle;
+    reply->handle = async_set_direct_result( async, req->status, req->information, req->mark_pending );
 
     release_object( &async->obj );
 }
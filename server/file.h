@@ -137,6 +137,7 @@ struct timeout_user;
 extern timeout_t current_time;
 extern timeout_t monotonic_time;
 extern struct _KUSER_SHARED_DATA *user_shared_data;
+extern unsigned int *sock_shared_state;
 
 #define TICKS_PER_SEC 10000000
 
@@ -190,6 +191,8 @@ extern struct mapping *create_fd_mapping( struct object *root, const struct unic
                                           unsigned int attr, const struct security_descriptor *sd );
 extern struct object *create_user_data_mapping( struct object *root, const struct unicode_str *name,
                                                 unsigned int attr, const struct security_descriptor *sd );
+extern struct object *create_sock_state_mapping( struct object *root, const struct unicode_str *name,
+                                                 unsigned int attr, const struct security_descriptor *sd );
 
 /* device functions */
 
@@ -234,6 +237,8 @@ extern obj_handle_t async_handoff( struct async *async, data_size_t *result, int
 extern void queue_async( struct async_queue *queue, struct async *async );
 extern void async_set_timeout( struct async *async, timeout_t timeout, unsigned int status );
 extern void async_set_result( struct object *obj, unsigned int status, apc_param_t total );
+extern obj_handle_t async_set_direct_result( struct async *async, unsigned int status, apc_param_t information,
+                                             int mark_pending );
 extern void async_set_completion_callback( struct async *async, async_completion_callback func, void *private );
 extern void async_set_unknown_status( struct async *async );
 extern void set_async_pending( struct async *async );
@@ -85,15 +85,20 @@ static const struct object_ops ranges_ops =
     ranges_destroy             /* destroy */
 };
 
-/* file backing the shared sections of a PE image mapping */
+/* file backing the shared and unaligned sections of a PE image mapping */
+/* sections are stored at their virtual address, so they can be mapped directly */
 struct shared_map
 {
     struct object   obj;             /* object header */
     struct fd      *fd;              /* file descriptor of the mapped PE file */
-    struct file    *file;            /* temp file holding the shared data */
+    struct file    *file;            /* temp file holding the sections data */
+    int             unaligned;       /* the file also holds the sections not page-aligned in the PE file */
     struct list     entry;           /* entry in global shared maps list */
 };
 
+/* maximum amount of unaligned section data copied by the server for an image */
+#define MAX_UNALIGNED_COPY_SIZE (16 * 1024 * 1024)
+
 static void shared_map_dump( struct object *obj, int verbose );
 static void shared_map_destroy( struct object *obj );
 
@@ -556,33 +561,59 @@ static int find_committed_range( struct memory_view *view, file_pos_t start, mem
     return 0;
 }
 
-/* allocate and fill the temp file for a shared PE image mapping */
+/* check if a section needs to be stored in the temp file of a PE image mapping */
+static int is_shared_map_section( const struct mapping *mapping, const IMAGE_SECTION_HEADER *sec,
+                                  int unaligned, int *shared )
+{
+    size_t file_size, map_size;
+    off_t file_start;
+
+    get_section_sizes( sec, &map_size, &file_start, &file_size );
+    if (sec->VirtualAddress > mapping->image.map_size ||
+        map_size > mapping->image.map_size - sec->VirtualAddress)
+        return 0;  /* rejected by the loader */
+
+    *shared = (sec->Characteristics & IMAGE_SCN_MEM_SHARED) && (sec->Characteristics & IMAGE_SCN_MEM_WRITE);
+    if (*shared) return 1;
+
+    if (!unaligned) return 0;
+
+    /* flat images are mapped from the file as a whole */
+    if (mapping->image.image_flags & IMAGE_FLAGS_ImageMappedFlat) return 0;
+
+    /* section data that is not page-aligned in the file can't be mapped from it, */
+    /* store an aligned copy so that its pages are shared by all processes */
+    return sec->PointerToRawData && file_size && (file_start & page_mask);
+}
+
+/* allocate and fill the temp file for a PE image mapping */
+/* if unaligned is set, the sections not page-aligned in the PE file are copied as well */
 static int build_shared_mapping( struct mapping *mapping, int fd,
-                                 IMAGE_SECTION_HEADER *sec, unsigned int nb_sec )
+                                 IMAGE_SECTION_HEADER *sec, unsigned int nb_sec, int unaligned )
 {
     struct shared_map *shared;
     struct file *file;
     unsigned int i;
-    mem_size_t total_size;
+    mem_size_t total_size, unaligned_size = 0;
     size_t file_size, map_size, max_size;
-    off_t shared_pos, read_pos, write_pos;
+    off_t read_pos, write_pos;
     char *buffer = NULL;
-    int shared_fd;
+    int shared_fd, is_shared;
     long toread;
 
-    /* compute the total size of the shared mapping */
+    /* compute the total size of the temp file */
 
     total_size = max_size = 0;
     for (i = 0; i < nb_sec; i++)
     {
-        if ((sec[i].Characteristics & IMAGE_SCN_MEM_SHARED) &&
-            (sec[i].Characteristics & IMAGE_SCN_MEM_WRITE))
-        {
-            get_section_sizes( &sec[i], &map_size, &read_pos, &file_size );
-            if (file_size > max_size) max_size = file_size;
-            total_size += map_size;
-        }
+        if (!is_shared_map_section( mapping, &sec[i], unaligned, &is_shared )) continue;
+        get_section_sizes( &sec[i], &map_size, &read_pos, &file_size );
+        if (file_size > max_size) max_size = file_size;
+        if (sec[i].VirtualAddress + map_size > total_size) total_size = sec[i].VirtualAddress + map_size;
+        if (!is_shared) unaligned_size += file_size;
     }
+    /* the copy is done synchronously, leave large images to the loader */
+    if (unaligned_size > MAX_UNALIGNED_COPY_SIZE) return build_shared_mapping( mapping, fd, sec, nb_sec, 0 );
     if (!total_size) return 1;  /* nothing to do */
 
     if ((mapping->shared = get_shared_file( mapping->fd ))) return 1;
@@ -594,16 +625,13 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
 
     if (!(buffer = malloc( max_size ))) goto error;
 
-    /* copy the shared sections data into the temp file */
+    /* copy the sections data into the temp file */
 
-    shared_pos = 0;
     for (i = 0; i < nb_sec; i++)
     {
-        if (!(sec[i].Characteristics & IMAGE_SCN_MEM_SHARED)) continue;
-        if (!(sec[i].Characteristics & IMAGE_SCN_MEM_WRITE)) continue;
+        if (!is_shared_map_section( mapping, &sec[i], unaligned, &is_shared )) continue;
         get_section_sizes( &sec[i], &map_size, &read_pos, &file_size );
-        write_pos = shared_pos;
-        shared_pos += map_size;
+        write_pos = sec[i].VirtualAddress;
         if (!sec[i].PointerToRawData || !file_size) continue;
         toread = file_size;
         while (toread)
@@ -614,7 +642,13 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
                 file_size -= toread;
                 break;
             }
-            if (res <= 0) goto error;
+            if (res <= 0)
+            {
+                if (is_shared) goto error;
+                /* truncated file, the loader will reject the section */
+                file_size -= toread;
+                break;
+            }
             toread -= res;
             read_pos += res;
         }
@@ -624,6 +658,7 @@ static int build_shared_mapping( struct mapping *mapping, int fd,
     if (!(shared = alloc_object( &shared_map_ops ))) goto error;
     shared->fd = (struct fd *)grab_object( mapping->fd );
     shared->file = file;
+    shared->unaligned = unaligned;
     list_add_head( &shared_map_list, &shared->entry );
     mapping->shared = shared;
     free( buffer );
@@ -825,7 +860,9 @@ static unsigned int get_image_params( struct mapping *mapping, file_pos_t file_s
         }
     }
 
-    if (!build_shared_mapping( mapping, unix_fd, sec, nt.FileHeader.NumberOfSections ))
+    /* copying the unaligned sections is only an optimization, the loader reads them otherwise */
+    if (!build_shared_mapping( mapping, unix_fd, sec, nt.FileHeader.NumberOfSections, 1 ) &&
+        !build_shared_mapping( mapping, unix_fd, sec, nt.FileHeader.NumberOfSections, 0 ))
         return STATUS_INVALID_FILE_FOR_SECTION;
 
     return STATUS_SUCCESS;
@@ -1120,6 +1157,19 @@ struct object *create_user_data_mapping( struct object *root, const struct unico
     return &mapping->obj;
 }
 
+struct object *create_sock_state_mapping( struct object *root, const struct unicode_str *name,
+                                         unsigned int attr, const struct security_descriptor *sd )
+{
+    void *ptr;
+    struct mapping *mapping;
+
+    if (!(mapping = create_mapping( root, name, attr, SOCK_STATE_SLOTS * sizeof(*sock_shared_state),
+                                    SEC_COMMIT, 0, FILE_READ_DATA | FILE_WRITE_DATA, sd ))) return NULL;
+    ptr = mmap( NULL, mapping->size, PROT_WRITE, MAP_SHARED, get_unix_fd( mapping->fd ), 0 );
+    if (ptr != MAP_FAILED) sock_shared_state = ptr;
+    return &mapping->obj;
+}
+
 /* create a file mapping */
 DECL_HANDLER(create_mapping)
 {
@@ -1188,8 +1238,11 @@ DECL_HANDLER(get_mapping_info)
     }
 
     if (mapping->shared)
+    {
         reply->shared_file = alloc_handle( current->process, mapping->shared->file,
                                            GENERIC_READ|GENERIC_WRITE, 0 );
+        reply->shared_unaligned = mapping->shared->unaligned;
+    }
     release_object( mapping );
 }
 
@@ -248,6 +248,7 @@ struct sock
     icmp_fixup_data[MAX_ICMP_HISTORY_LENGTH]; /* Sent ICMP packets history used to fixup reply id. */
     struct bound_addr  *bound_addr[2]; /* Links to the entries in bound addresses tree. */
     unsigned int        icmp_fixup_data_len;  /* Sent ICMP packets history length. */
+    unsigned int        state_slot;  /* index in the shared state mapping, or 0 */
     unsigned int        rd_shutdown : 1; /* is the read end shut down? */
     unsigned int        wr_shutdown : 1; /* is the write end shut down? */
     unsigned int        wr_shutdown_pending : 1; /* is a write shutdown pending? */
@@ -310,6 +311,28 @@ static int ipv4addr_from_v6( union unix_sockaddr *v4addr, const struct sockaddr_
 
 static struct rb_tree bound_addresses_tree = { addr_compare };
 
+unsigned int *sock_shared_state;          /* state published to the clients, indexed by state_slot */
+static unsigned int next_state_slot = 1;  /* first slot that was never used */
+static unsigned int *free_state_slots;    /* stack of released slots */
+static unsigned int free_state_slot_count;
+
+static unsigned int alloc_sock_state_slot(void)
+{
+    if (!sock_shared_state) return 0;
+    if (free_state_slot_count) return free_state_slots[--free_state_slot_count];
+    if (next_state_slot < SOCK_STATE_SLOTS) return next_state_slot++;
+    return 0;
+}
+
+static void free_sock_state_slot( unsigned int slot )
+{
+    if (!slot) return;
+    sock_shared_state[slot] = 0;
+    if (!free_state_slots && !(free_state_slots = malloc( SOCK_STATE_SLOTS * sizeof(*free_state_slots) )))
+        return;
+    free_state_slots[free_state_slot_count++] = slot;
+}
+
 static int should_track_conflicts_for_addr( struct sock *sock, const union unix_sockaddr *addr )
 {
     if (!is_tcp_socket( sock )) return 0;
@@ -746,6 +769,38 @@ void sock_init(void)
     }
 }
 
+static int sock_has_errors( struct sock *sock )
+{
+    unsigned int i;
+
+    for (i = 0; i < ARRAY_SIZE( sock->errors ); ++i)
+        if (sock->errors[i]) return 1;
+    return 0;
+}
+
+/* Tell the clients whether they may call recv() or send() directly. Queued asyncs must
+ * be completed first, so the data is not reordered, and a shut down socket needs the
+ * server to fail the request. Polls can only be done by the client when the result
+ * doesn't depend on state transitions that the server tracks.
+ * The state is only updated lazily when it becomes less restrictive, for instance when
+ * the queues become empty, which at worst makes the client go through the server. */
+static void sock_update_shared_state( struct sock *sock )
+{
+    unsigned int state = 0;
+
+    if (!sock->state_slot) return;
+    if (!sock->rd_shutdown && !async_queued( &sock->read_q )) state |= SOCK_STATE_RECV;
+    if (!sock->wr_shutdown && !async_queued( &sock->write_q ) && (sock->type != WS_SOCK_DGRAM || sock->bound))
+        state |= SOCK_STATE_SEND;
+    if ((sock->state == SOCK_CONNECTED || sock->state == SOCK_CONNECTIONLESS) &&
+        !sock->reset && !sock->hangup && !sock->aborted && !sock_has_errors( sock ) &&
+        !async_queued( &sock->read_q ) && !async_queued( &sock->write_q ) &&
+        !sock->accept_recv_req && !sock->connect_req)
+        state |= SOCK_STATE_POLL;
+    if (sock->state == SOCK_CONNECTED) state |= SOCK_STATE_CONNECTED;
+    sock_shared_state[sock->state_slot] = state;
+}
+
 static void sock_reselect( struct sock *sock )
 {
     int ev = sock_get_poll_events( sock->fd );
@@ -754,6 +809,7 @@ static void sock_reselect( struct sock *sock )
         fprintf(stderr,"sock_reselect(%p): new mask %x\n", sock, ev);
 
     set_fd_events( sock->fd, ev );
+    sock_update_shared_state( sock );
 }
 
 static unsigned int afd_poll_flag_to_win32( unsigned int flags )
@@ -850,6 +906,7 @@ static inline int sock_error( struct sock *sock )
         break;
     }
 
+    sock_update_shared_state( sock );
     return error;
 }
 
@@ -1690,6 +1747,7 @@ static void sock_destroy( struct object *obj )
     free_async_queue( &sock->poll_q );
     if (sock->event) release_object( sock->event );
     if (sock->fd) release_object( sock->fd );
+    free_sock_state_slot( sock->state_slot );
 }
 
 static struct sock *create_socket(void)
@@ -1732,6 +1790,7 @@ static struct sock *create_socket(void)
     sock->rcvtimeo = 0;
     sock->sndtimeo = 0;
     sock->icmp_fixup_data_len = 0;
+    sock->state_slot = alloc_sock_state_slot();
     sock->bound_addr[0] = sock->bound_addr[1] = NULL;
     init_async_queue( &sock->read_q );
     init_async_queue( &sock->write_q );
@@ -2062,6 +2121,8 @@ static int accept_into_socket( struct sock *sock, struct sock *acceptsock )
     fd_copy_completion( acceptsock->fd, newfd );
     release_object( acceptsock->fd );
     acceptsock->fd = newfd;
+    /* the socket is connected now, and can't be accepted into again */
+    allow_fd_caching( acceptsock->fd );
 
     unix_len = sizeof(unix_addr);
     if (!getsockname( get_unix_fd( newfd ), &unix_addr.addr, &unix_len ))
@@ -3736,6 +3797,7 @@ struct object *create_socket_device( struct object *root, const struct unicode_s
 DECL_HANDLER(recv_socket)
 {
     struct sock *sock = (struct sock *)get_handle_obj( current->process, req->async.handle, 0, &sock_ops );
+    int client_done = req->status != STATUS_PENDING && req->status != STATUS_DEVICE_NOT_READY;
     unsigned int status = STATUS_PENDING;
     timeout_t timeout = 0;
     struct async *async;
@@ -3747,14 +3809,21 @@ DECL_HANDLER(recv_socket)
     if (!req->force_async && !sock->nonblocking && is_fd_overlapped( fd ))
         timeout = (timeout_t)sock->rcvtimeo * -10000;
 
-    if (sock->rd_shutdown) status = STATUS_PIPE_DISCONNECTED;
+    /* The client may already have tried to receive the data itself; if that
+     * completed the request, all that is left to do is to report the result.
+     * The client only does so while the published state allows it, so a
+     * shutdown racing with the unix call is ordered after it; the data has
+     * already been transferred and the result must stand. */
+
+    if (client_done) status = req->status;
+    else if (sock->rd_shutdown) status = STATUS_PIPE_DISCONNECTED;
     else if (!async_queued( &sock->read_q ))
     {
         /* If read_q is not empty, we cannot really tell if the already queued
          * asyncs will not consume all available data; if there's no data
          * available, the current request won't be immediately satiable.
          */
-        if ((!req->force_async && sock->nonblocking) ||
+        if ((!req->force_async && sock->nonblocking && req->status != STATUS_DEVICE_NOT_READY) ||
             check_fd_events( sock->fd, req->oob && !is_oobinline( sock ) ? POLLPRI : POLLIN ))
         {
             /* Give the client opportunity to complete synchronously.
@@ -3779,7 +3848,7 @@ DECL_HANDLER(recv_socket)
 
     if ((async = create_request_async( fd, get_fd_comp_flags( fd ), &req->async )))
     {
-        set_error( status );
+        set_error( client_done ? STATUS_ALERTED : status );
 
         if (timeout)
             async_set_timeout( async, timeout, STATUS_IO_TIMEOUT );
@@ -3791,8 +3860,15 @@ DECL_HANDLER(recv_socket)
         sock_reselect( sock );
 
         reply->wait = async_handoff( async, NULL, 0 );
+        if (client_done)
+        {
+            /* same as what set_async_direct_result would do */
+            reply->wait = async_set_direct_result( async, status, req->total, 0 );
+            set_error( status );
+        }
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        reply->state_slot = sock->state_slot;
         release_object( async );
     }
     release_object( sock );
@@ -3820,6 +3896,7 @@ static void send_socket_completion_callback( void *private )
 DECL_HANDLER(send_socket)
 {
     struct sock *sock = (struct sock *)get_handle_obj( current->process, req->async.handle, 0, &sock_ops );
+    int client_done = req->status != STATUS_PENDING && req->status != STATUS_DEVICE_NOT_READY;
     unsigned int status = STATUS_PENDING;
     timeout_t timeout = 0;
     struct async *async;
@@ -3850,7 +3927,14 @@ DECL_HANDLER(send_socket)
     if (!req->force_async && !sock->nonblocking && is_fd_overlapped( fd ))
         timeout = (timeout_t)sock->sndtimeo * -10000;
 
-    if (bind_errno) status = sock_get_ntstatus( bind_errno );
+    /* The client may already have tried to send the data itself; if that
+     * completed the request, all that is left to do is to report the result.
+     * The client only does so while the published state allows it, so a
+     * shutdown racing with the unix call is ordered after it; the data has
+     * already been transferred and the result must stand. */
+
+    if (client_done) status = req->status;
+    else if (bind_errno) status = sock_get_ntstatus( bind_errno );
     else if (sock->wr_shutdown) status = STATUS_PIPE_DISCONNECTED;
     else if (!async_queued( &sock->write_q ))
     {
@@ -3858,7 +3942,8 @@ DECL_HANDLER(send_socket)
          * asyncs will not consume all available space; if there's no space
          * available, the current request won't be immediately satiable.
          */
-        if ((!req->force_async && sock->nonblocking) || check_fd_events( sock->fd, POLLOUT ))
+        if ((!req->force_async && sock->nonblocking && req->status != STATUS_DEVICE_NOT_READY) ||
+            check_fd_events( sock->fd, POLLOUT ))
         {
             /* Give the client opportunity to complete synchronously.
              * If it turns out that the I/O request is not actually immediately satiable,
@@ -3902,7 +3987,7 @@ DECL_HANDLER(send_socket)
 
         release_object( iosb );
 
-        set_error( status );
+        set_error( client_done ? STATUS_ALERTED : status );
 
         if (timeout)
             async_set_timeout( async, timeout, STATUS_IO_TIMEOUT );
@@ -3914,10 +3999,18 @@ DECL_HANDLER(send_socket)
         }
 
         reply->wait = async_handoff( async, NULL, 0 );
+        if (client_done)
+        {
+            /* same as what set_async_direct_result would do */
+            reply->wait = async_set_direct_result( async, status, req->total, 0 );
+            set_error( status );
+        }
         reply->options = get_fd_options( fd );
         reply->nonblocking = sock->nonblocking;
+        reply->state_slot = sock->state_slot;
         release_object( async );
     }
+    sock_update_shared_state( sock );
     release_object( sock );
 }
 
@@ -2057,8 +2057,10 @@ static void dump_unlock_file_request( const struct unlock_file_request *req )
 static void dump_recv_socket_request( const struct recv_socket_request *req )
 {
     fprintf( stderr, " oob=%d", req->oob );
-    dump_async_data( ", async=", &req->async );
     fprintf( stderr, ", force_async=%d", req->force_async );
+    dump_async_data( ", async=", &req->async );
+    fprintf( stderr, ", status=%08x", req->status );
+    fprintf( stderr, ", total=%08x", req->total );
 }
 
 static void dump_recv_socket_reply( const struct recv_socket_reply *req )
@@ -2066,12 +2068,15 @@ static void dump_recv_socket_reply( const struct recv_socket_reply *req )
     fprintf( stderr, " wait=%04x", req->wait );
     fprintf( stderr, ", options=%08x", req->options );
     fprintf( stderr, ", nonblocking=%d", req->nonblocking );
+    fprintf( stderr, ", state_slot=%08x", req->state_slot );
 }
 
 static void dump_send_socket_request( const struct send_socket_request *req )
 {
-    dump_async_data( " async=", &req->async );
+    fprintf( stderr, " status=%08x", req->status );
+    dump_async_data( ", async=", &req->async );
     fprintf( stderr, ", force_async=%d", req->force_async );
+    fprintf( stderr, ", total=%08x", req->total );
 }
 
 static void dump_send_socket_reply( const struct send_socket_reply *req )
@@ -2079,6 +2084,7 @@ static void dump_send_socket_reply( const struct send_socket_reply *req )
     fprintf( stderr, " wait=%04x", req->wait );
     fprintf( stderr, ", options=%08x", req->options );
     fprintf( stderr, ", nonblocking=%d", req->nonblocking );
+    fprintf( stderr, ", state_slot=%08x", req->state_slot );
 }
 
 static void dump_socket_send_icmp_id_request( const struct socket_send_icmp_id_request *req )
@@ -2173,6 +2179,7 @@ static void dump_get_mapping_info_reply( const struct get_mapping_info_reply *re
     dump_uint64( " size=", &req->size );
     fprintf( stderr, ", flags=%08x", req->flags );
     fprintf( stderr, ", shared_file=%04x", req->shared_file );
+    fprintf( stderr, ", shared_unaligned=%d", req->shared_unaligned );
     fprintf( stderr, ", total=%u", req->total );
     dump_varargs_pe_image_info( ", image=", cur_size );
     dump_varargs_unicode_str( ", name=", cur_size );